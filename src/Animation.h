@@ -19,21 +19,46 @@
 
 #import <Foundation/Foundation.h>
 #import "AnimationFrameBuffer.h"
+#import "AnimationContainer.h"
+#import "AnimationDecoder.h"
+#import "AnimationFrameCache.h"
+
+@class AnimationLibrary;
 
 @interface Animation : NSObject {
   @private
-	const AnimationContainerGlobalHeader* globalHeader_;
-	NSData* data_;
-	NSMutableArray* images_;
+	AnimationContainer container_;
+	AnimationDecoder decoder_;
+	AnimationLibrary* library_;
+	AnimationFrameCache* cache_;
 }
 
 @property (nonatomic,readonly) NSUInteger frameCount;
 @property (nonatomic,readonly) NSUInteger frameRate;
 
+// Size of the frames, in pixels
+@property (nonatomic,readonly) NSUInteger width;
+@property (nonatomic,readonly) NSUInteger height;
+
 + (id) animationNamed: (NSString*) name;
 
 - (id) initWithContentsOfFile: (NSString*) path;
 
+// Animations from the same library share the images they have in common,
+// frames showing such an image are only decoded once in a row
+- (id) initWithLibrary: (AnimationLibrary*) library name: (NSString*) name;
+
 - (void) drawFrame: (NSUInteger) frame intoFrameBuffer: (AnimationFrameBuffer*) buffer;
 
+// Same as above for code that manages its own pixels. Safe to call from any
+// thread as long as no two threads draw into the same canvas.
+
+- (AnimationStatus) drawFrame: (NSUInteger) frame intoCanvas: (AnimationCanvas*) canvas;
+
+// Keeps up to budget bytes of decoded frames, see AnimationFrameCache.h. A
+// budget of 0 turns the cache off. Not thread safe, set it before drawing.
+
+- (void) setCacheBudget: (NSUInteger) budget policy: (AnimationFrameCachePolicy) policy;
+- (void) getCacheStatistics: (AnimationFrameCacheStatistics*) statistics;
+
 @end
\ No newline at end of file
@@ -18,8 +18,58 @@
  */
 
 #import "Animation.h"
-#import "AnimationImage.h"
-#import "AnimationCompression.h"
+#import "AnimationDecoder.h"
+#import "AnimationLibrary.h"
+#import "AnimationThreadPool.h"
+
+// One pool for all animations, only large banded frames use it
+
+static AnimationThreadPool* AnimationSharedThreadPool(void)
+{
+	static AnimationThreadPool* pool;
+	static dispatch_once_t once;
+	dispatch_once(&once, ^{
+		pool = AnimationThreadPoolCreate(0);
+	});
+	return pool;
+}
+
+// Decodes 'ping' frames, the only format the portable decoder leaves to us
+
+static AnimationStatus AnimationDecodePNGImage(void* info, const AnimationContainerImageHeader* header, const void* data, AnimationCanvas* canvas)
+{
+	if (header->format != AnimationContainerImageFormatPNG) {
+		return AnimationStatusUnsupportedFormat;
+	}
+
+	AnimationStatus status = AnimationStatusInvalidHeader;
+
+	NSData* imageData = [NSData dataWithBytesNoCopy: (void*) data length: header->dataLength freeWhenDone: NO];
+	UIImage* image = [UIImage imageWithData: imageData];
+	if (image != nil)
+	{
+		CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
+		if (colorSpace != NULL)
+		{
+			CGContextRef context = CGBitmapContextCreate(canvas->pixels, canvas->width, canvas->height, 8, canvas->width*4, colorSpace, kCGImageAlphaPremultipliedLast);
+			if (context != NULL)
+			{
+				// Core Graphics puts the origin at the bottom left. Copy instead of
+				// blending so the image replaces what is in its rectangle.
+
+				CGRect rect = CGRectMake(header->xoffset, canvas->height - header->yoffset - header->height, header->width, header->height);
+				CGContextSetBlendMode(context, kCGBlendModeCopy);
+				CGContextDrawImage(context, rect, image.CGImage);
+				CGContextRelease(context);
+				status = AnimationStatusOK;
+			}
+			
+			CGColorSpaceRelease(colorSpace);
+		}
+	}
+
+	return status;
+}
 
 @implementation Animation
 
@@ -39,61 +89,50 @@
 {
 	if ((self = [super init]) != nil)
 	{
-		data_ = [[NSData dataWithContentsOfFile: path] retain];
-		if (data_ != nil)
-		{
-			images_ = [NSMutableArray new];
-			
-			globalHeader_  = (AnimationContainerGlobalHeader*) [data_ bytes];
-			const void* p = [data_ bytes] + sizeof(AnimationContainerGlobalHeader);
-			
-			for (NSUInteger i = 0; i < globalHeader_->frameCount; i++)
-			{
-				const AnimationContainerImageHeader* imageHeader = (AnimationContainerImageHeader*) p;
-			
-				AnimationImage* image = nil;
-
-				// TODO: This needs to be delegated to AnimationImage subclasses
-
-				NSData* data = [NSData dataWithBytesNoCopy: (void*) p + sizeof(AnimationContainerImageHeader) length: imageHeader->dataLength freeWhenDone: NO];
-				image = [AnimationImage animationImageWithImageHeader: imageHeader data: data];
-
-#if 0
-				switch (imageHeader->format)
-				{
-					case AnimationContainerImageFormatPNG: {
-						break;
-					}
-					case AnimationContainerImageFormatUncompressedPixels: {
-						NSLog(@"Format not supported yet");
-						exit(1);
-						break;
-					}
-					case AnimationContainerImageFormatRunLengthCompressedPixels: {
-						NSLog(@"Format not supported yet");
-						exit(1);
-						break;
-					}
-				}
-#endif
-				
-				[images_ addObject: image];
-				
-				p += sizeof(AnimationContainerImageHeader) + imageHeader->dataLength;
-				if ((imageHeader->dataLength % 4) != 0) {
-					p += 4 - (imageHeader->dataLength % 4);
-				}
-			}
+		// The container is mapped, not read. Version 2 containers are opened in
+		// constant time through their frame index. Version 1 containers are
+		// walked and validated once here.
+
+		AnimationStatus status = AnimationContainerOpenFile(&container_, [path fileSystemRepresentation]);
+		if (status != AnimationStatusOK) {
+			NSLog(@"Animation: cannot open %@ (status %d)", path, status);
+			[self release];
+			return nil;
 		}
-		
+
+		AnimationDecoderInit(&decoder_, &container_, AnimationDecodePNGImage, NULL);
+		AnimationDecoderSetThreadPool(&decoder_, AnimationSharedThreadPool());
 	}
 	
 	return self;
 }
 
+- (id) initWithLibrary: (AnimationLibrary*) library name: (NSString*) name
+{
+	if ((self = [super init]) != nil)
+	{
+		// The container borrows the library's mapping, so keep the library
+
+		AnimationStatus status = AnimationArchiveFindAnimation(library.archive, [name UTF8String], &container_);
+		if (status != AnimationStatusOK) {
+			NSLog(@"Animation: cannot open %@ (status %d)", name, status);
+			[self release];
+			return nil;
+		}
+
+		library_ = [library retain];
+		AnimationDecoderInit(&decoder_, &container_, AnimationDecodePNGImage, NULL);
+		AnimationDecoderSetThreadPool(&decoder_, AnimationSharedThreadPool());
+	}
+
+	return self;
+}
+
 - (void) dealloc
 {
-	[images_ release];
+	AnimationFrameCacheDestroy(cache_);
+	AnimationContainerClose(&container_);
+	[library_ release];
 	[super dealloc];
 }
 
@@ -101,48 +140,56 @@
 
 - (void) drawFrame: (NSUInteger) frame intoFrameBuffer: (AnimationFrameBuffer*) buffer
 {
-	// TODO: All this drawing work should be delegated to AnimationImage subclasses
-	
-	AnimationImage* animationImage = [images_ objectAtIndex: frame];
-	if (animationImage != nil)
-	{
-		switch (animationImage.format)
-		{
-			case AnimationContainerImageFormatPNG:
-			{
-				UIImage* image = [UIImage imageWithData: animationImage.data];
-			
-				CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
-				if (colorSpace != NULL)
-				{
-					CGContextRef context = CGBitmapContextCreate(buffer.pixels, buffer.width, buffer.height, 8, buffer.width*4, colorSpace, kCGImageAlphaPremultipliedLast);
-					if (context != NULL)
-					{
-						CGContextDrawImage(context, CGRectMake(0, 0, animationImage.width, animationImage.height), image.CGImage);
-						CGContextRelease(context);
-					}
-					
-					CGColorSpaceRelease(colorSpace);
-				}
-				break;
-			}
-			
-			case AnimationContainerImageFormatUncompressedPixels:
-			{
-				if (animationImage.width == buffer.width && animationImage.height == buffer.height) {
-					memcpy(buffer.pixels, [animationImage.data bytes],[animationImage.data length]);
-				}
-				break;
-			}
-			
-			case AnimationContainerImageFormatRunLengthCompressedPixels:
-			{
-				if (animationImage.width <= buffer.width && animationImage.height <= buffer.height) {
-					AnimationDecompressRunLengthEncodedPixels(buffer.pixels, (uint32_t*) [animationImage.data bytes], animationImage.width * animationImage.height);
-				}
-				break;
-			}
-		}
+	[self drawFrame: frame intoCanvas: buffer.canvas];
+}
+
+- (AnimationStatus) drawFrame: (NSUInteger) frame intoCanvas: (AnimationCanvas*) canvas
+{
+	// Containers without frames open fine, there is just nothing to draw
+
+	uint32_t frameCount = container_.header->frameCount;
+	if (frame >= frameCount) {
+		NSLog(@"Animation: cannot decode frame %d of %d", (int) frame, (int) frameCount);
+		return AnimationStatusOverflow;
+	}
+
+	// Start paging in the next frame while this one is decoded
+
+	AnimationContainerWillNeedImage(&container_, (frame + 1) % frameCount);
+
+	AnimationStatus status;
+	if (cache_ != NULL) {
+		status = AnimationFrameCacheDrawFrame(cache_, &decoder_, frame, canvas);
+	} else {
+		status = AnimationDecoderDrawFrame(&decoder_, frame, canvas);
+	}
+	if (status != AnimationStatusOK) {
+		NSLog(@"Animation: cannot decode frame %d (status %d)", (int) frame, status);
+	}
+
+	// The frame is decoded, its pages can be reclaimed
+
+	AnimationContainerDiscardImage(&container_, frame);
+
+	return status;
+}
+
+- (void) setCacheBudget: (NSUInteger) budget policy: (AnimationFrameCachePolicy) policy
+{
+	AnimationFrameCacheDestroy(cache_);
+	cache_ = NULL;
+
+	if (budget != 0) {
+		cache_ = AnimationFrameCacheCreate(&container_, budget, policy);
+	}
+}
+
+- (void) getCacheStatistics: (AnimationFrameCacheStatistics*) statistics
+{
+	if (cache_ != NULL) {
+		AnimationFrameCacheGetStatistics(cache_, statistics);
+	} else {
+		memset(statistics, 0, sizeof(AnimationFrameCacheStatistics));
 	}
 }
 
@@ -150,12 +197,22 @@
 
 - (NSUInteger) frameCount
 {
-	return globalHeader_->frameCount;
+	return container_.header->frameCount;
 }
 
 - (NSUInteger) frameRate
 {
-	return globalHeader_->frameRate;
+	return container_.header->frameRate;
+}
+
+- (NSUInteger) width
+{
+	return container_.header->width;
+}
+
+- (NSUInteger) height
+{
+	return container_.header->height;
 }
 
 @end
\ No newline at end of file
@@ -0,0 +1,191 @@
+/*
+ * (C) Copyright 2010, Stefan Arentz, Arentz Consulting Inc.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "AnimationArchive.h"
+
+#define ANIMATION_ARCHIVE_MAGIC 'arch'
+
+AnimationStatus AnimationArchiveOpen(AnimationArchive* archive, const void* bytes, size_t length)
+{
+	archive->bytes = (const uint8_t*) bytes;
+	archive->length = length;
+	archive->header = NULL;
+	archive->entries = NULL;
+	archive->mapping = NULL;
+	archive->pageSize = 0;
+
+	if (bytes == NULL || length < sizeof(AnimationArchiveHeader)) {
+		return AnimationStatusTruncated;
+	}
+
+	const AnimationArchiveHeader* header = (const AnimationArchiveHeader*) bytes;
+
+	if (header->magic != ANIMATION_ARCHIVE_MAGIC) {
+		return AnimationStatusInvalidHeader;
+	}
+
+	if (header->version != 1) {
+		return AnimationStatusUnsupportedFormat;
+	}
+
+	if (header->count > (length - sizeof(AnimationArchiveHeader)) / sizeof(AnimationArchiveEntry)) {
+		return AnimationStatusTruncated;
+	}
+
+	archive->header = header;
+	archive->entries = (const AnimationArchiveEntry*) (header + 1);
+
+	return AnimationStatusOK;
+}
+
+AnimationStatus AnimationArchiveOpenFile(AnimationArchive* archive, const char* path)
+{
+	archive->mapping = NULL;
+
+	int fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		return AnimationStatusIOError;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) == -1 || st.st_size <= 0) {
+		close(fd);
+		return AnimationStatusIOError;
+	}
+
+	size_t length = (size_t) st.st_size;
+
+	void* mapping = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (mapping == MAP_FAILED) {
+		return AnimationStatusIOError;
+	}
+
+	// Animations are picked out of the archive, there is no order to read
+	// ahead in. Each animation's own paging hints still apply.
+
+	madvise(mapping, length, MADV_RANDOM);
+
+	AnimationStatus status = AnimationArchiveOpen(archive, mapping, length);
+	if (status != AnimationStatusOK) {
+		munmap(mapping, length);
+		return status;
+	}
+
+	archive->mapping = mapping;
+	archive->pageSize = (size_t) sysconf(_SC_PAGESIZE);
+
+	return AnimationStatusOK;
+}
+
+void AnimationArchiveClose(AnimationArchive* archive)
+{
+	if (archive->mapping != NULL) {
+		munmap(archive->mapping, archive->length);
+		archive->mapping = NULL;
+	}
+	archive->header = NULL;
+	archive->entries = NULL;
+}
+
+uint32_t AnimationArchiveGetCount(const AnimationArchive* archive)
+{
+	return archive->header->count;
+}
+
+AnimationStatus AnimationArchiveGetName(const AnimationArchive* archive, uint32_t i, const char** name, uint32_t* nameLength)
+{
+	if (i >= archive->header->count) {
+		return AnimationStatusOverflow;
+	}
+
+	const AnimationArchiveEntry* entry = &archive->entries[i];
+
+	if (entry->nameOffset > archive->length || entry->nameLength > archive->length - entry->nameOffset) {
+		return AnimationStatusTruncated;
+	}
+
+	*name = (const char*) (archive->bytes + entry->nameOffset);
+	*nameLength = entry->nameLength;
+
+	return AnimationStatusOK;
+}
+
+AnimationStatus AnimationArchiveOpenAnimation(const AnimationArchive* archive, uint32_t i, AnimationContainer* container)
+{
+	if (i >= archive->header->count) {
+		return AnimationStatusOverflow;
+	}
+
+	AnimationStatus status = AnimationContainerOpenAt(container, archive->bytes, archive->length, archive->entries[i].containerOffset);
+	if (status != AnimationStatusOK) {
+		return status;
+	}
+
+	// The container borrows the archive's mapping for its paging hints
+
+	container->mapping = archive->mapping;
+	container->pageSize = archive->pageSize;
+
+	return AnimationStatusOK;
+}
+
+AnimationStatus AnimationArchiveFindAnimation(const AnimationArchive* archive, const char* name, AnimationContainer* container)
+{
+	size_t length = strlen(name);
+
+	uint32_t low = 0;
+	uint32_t high = archive->header->count;
+
+	while (low < high)
+	{
+		uint32_t middle = low + (high - low) / 2;
+
+		const char* entryName;
+		uint32_t entryLength;
+
+		AnimationStatus status = AnimationArchiveGetName(archive, middle, &entryName, &entryLength);
+		if (status != AnimationStatusOK) {
+			return status;
+		}
+
+		int order = memcmp(entryName, name, (entryLength < length) ? entryLength : length);
+		if (order == 0) {
+			order = (entryLength < length) ? -1 : (entryLength > length);
+		}
+
+		if (order == 0) {
+			return AnimationArchiveOpenAnimation(archive, middle, container);
+		}
+
+		if (order < 0) {
+			low = middle + 1;
+		} else {
+			high = middle;
+		}
+	}
+
+	return AnimationStatusInvalidHeader;
+}
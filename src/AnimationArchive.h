@@ -0,0 +1,56 @@
+/*
+ * (C) Copyright 2010, Stefan Arentz, Arentz Consulting Inc.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANIMATIONARCHIVE_H
+#define ANIMATIONARCHIVE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "AnimationCommon.h"
+#include "AnimationContainer.h"
+
+// A read-only view on an archive of named animations. Like a container it is
+// mapped rather than read, and nothing in it is trusted. Finding an animation
+// is a binary search of the directory; the container it returns borrows the
+// archive's bytes and stays valid until the archive is closed.
+
+typedef struct AnimationArchive {
+	const uint8_t* bytes;
+	size_t length;
+	const AnimationArchiveHeader* header;
+	const AnimationArchiveEntry* entries;
+	void* mapping;
+	size_t pageSize;
+} AnimationArchive;
+
+AnimationStatus AnimationArchiveOpen(AnimationArchive* archive, const void* bytes, size_t length);
+AnimationStatus AnimationArchiveOpenFile(AnimationArchive* archive, const char* path);
+void AnimationArchiveClose(AnimationArchive* archive);
+
+uint32_t AnimationArchiveGetCount(const AnimationArchive* archive);
+
+// The name of animation i, which is not zero terminated
+AnimationStatus AnimationArchiveGetName(const AnimationArchive* archive, uint32_t i, const char** name, uint32_t* nameLength);
+
+AnimationStatus AnimationArchiveOpenAnimation(const AnimationArchive* archive, uint32_t i, AnimationContainer* container);
+
+// Returns AnimationStatusInvalidHeader if there is no animation of that name
+AnimationStatus AnimationArchiveFindAnimation(const AnimationArchive* archive, const char* name, AnimationContainer* container);
+
+#endif
@@ -0,0 +1,242 @@
+/*
+ * (C) Copyright 2010, Stefan Arentz, Arentz Consulting Inc.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <pthread.h>
+#include "AnimationBufferPool.h"
+
+struct AnimationBufferPool {
+	size_t bufferSize;
+	uint32_t count;
+	void** buffers;			// Every buffer, for destroy
+	void** free;			// Stack of free buffers
+	uint32_t freeCount;
+	pthread_mutex_t lock;
+	AnimationBufferPoolStatistics statistics;
+};
+
+static void* AnimationAlignedAllocate(size_t size)
+{
+	void* p = NULL;
+	if (posix_memalign(&p, AnimationBufferAlignment, size) != 0) {
+		return NULL;
+	}
+	return p;
+}
+
+AnimationBufferPool* AnimationBufferPoolCreate(size_t bufferSize, uint32_t count)
+{
+	AnimationBufferPool* pool = (AnimationBufferPool*) calloc(1, sizeof(AnimationBufferPool));
+	if (pool == NULL) {
+		return NULL;
+	}
+
+	pool->bufferSize = bufferSize;
+	pool->buffers = (void**) calloc(count + 1, sizeof(void*));
+	pool->free = (void**) calloc(count + 1, sizeof(void*));
+	if (pool->buffers == NULL || pool->free == NULL) {
+		AnimationBufferPoolDestroy(pool);
+		return NULL;
+	}
+
+	pthread_mutex_init(&pool->lock, NULL);
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		void* buffer = AnimationAlignedAllocate(bufferSize);
+		if (buffer == NULL) {
+			AnimationBufferPoolDestroy(pool);
+			return NULL;
+		}
+
+		pool->buffers[pool->count++] = buffer;
+		pool->free[pool->freeCount++] = buffer;
+		pool->statistics.allocations++;
+	}
+
+	return pool;
+}
+
+void AnimationBufferPoolDestroy(AnimationBufferPool* pool)
+{
+	if (pool == NULL) {
+		return;
+	}
+
+	if (pool->buffers != NULL && pool->free != NULL) {
+		pthread_mutex_destroy(&pool->lock);
+	}
+
+	for (uint32_t i = 0; i < pool->count; i++) {
+		free(pool->buffers[i]);
+	}
+
+	free(pool->buffers);
+	free(pool->free);
+	free(pool);
+}
+
+void* AnimationBufferPoolAcquire(AnimationBufferPool* pool)
+{
+	void* buffer = NULL;
+
+	pthread_mutex_lock(&pool->lock);
+
+	if (pool->freeCount != 0) {
+		buffer = pool->free[--pool->freeCount];
+		pool->statistics.acquires++;
+		pool->statistics.inUse++;
+	} else {
+		pool->statistics.exhausted++;
+	}
+
+	pthread_mutex_unlock(&pool->lock);
+
+	return buffer;
+}
+
+void AnimationBufferPoolRelease(AnimationBufferPool* pool, void* buffer)
+{
+	if (buffer == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+
+	pool->free[pool->freeCount++] = buffer;
+	pool->statistics.releases++;
+	pool->statistics.inUse--;
+
+	pthread_mutex_unlock(&pool->lock);
+}
+
+void AnimationBufferPoolGetStatistics(AnimationBufferPool* pool, AnimationBufferPoolStatistics* statistics)
+{
+	pthread_mutex_lock(&pool->lock);
+	*statistics = pool->statistics;
+	pthread_mutex_unlock(&pool->lock);
+}
+
+// Scratch arena
+
+struct AnimationArenaBlock {
+	AnimationArenaBlock* next;
+	size_t size;
+	size_t used;
+	uint8_t* data;
+};
+
+static AnimationArenaBlock* AnimationArenaAddBlock(AnimationArena* arena, size_t size)
+{
+	AnimationArenaBlock* block = (AnimationArenaBlock*) malloc(sizeof(AnimationArenaBlock));
+	if (block == NULL) {
+		return NULL;
+	}
+
+	block->data = (uint8_t*) AnimationAlignedAllocate(size);
+	if (block->data == NULL) {
+		free(block);
+		return NULL;
+	}
+
+	block->size = size;
+	block->used = 0;
+	block->next = arena->blocks;
+	arena->blocks = block;
+	arena->allocations++;
+
+	return block;
+}
+
+static void AnimationArenaFreeBlocks(AnimationArena* arena)
+{
+	while (arena->blocks != NULL) {
+		AnimationArenaBlock* next = arena->blocks->next;
+		free(arena->blocks->data);
+		free(arena->blocks);
+		arena->blocks = next;
+	}
+}
+
+void AnimationArenaInit(AnimationArena* arena, size_t size)
+{
+	arena->blocks = NULL;
+	arena->used = 0;
+	arena->highWater = 0;
+	arena->allocations = 0;
+	arena->resets = 0;
+
+	if (size != 0) {
+		AnimationArenaAddBlock(arena, size);
+	}
+}
+
+void AnimationArenaDestroy(AnimationArena* arena)
+{
+	AnimationArenaFreeBlocks(arena);
+}
+
+void* AnimationArenaAllocate(AnimationArena* arena, size_t size)
+{
+	size = (size + AnimationBufferAlignment - 1) & ~(size_t) (AnimationBufferAlignment - 1);
+
+	AnimationArenaBlock* block = arena->blocks;
+	if (block == NULL || block->size - block->used < size)
+	{
+		// Chain on a block. Double the total so a growing frame settles quickly.
+
+		size_t blockSize = (block != NULL) ? block->size * 2 : 0;
+		if (blockSize < size) {
+			blockSize = size;
+		}
+
+		block = AnimationArenaAddBlock(arena, blockSize);
+		if (block == NULL) {
+			return NULL;
+		}
+	}
+
+	void* p = block->data + block->used;
+	block->used += size;
+	arena->used += size;
+
+	if (arena->used > arena->highWater) {
+		arena->highWater = arena->used;
+	}
+
+	return p;
+}
+
+void AnimationArenaReset(AnimationArena* arena)
+{
+	// More than one block means the last frame outgrew the arena. Replace the
+	// chain with a single block that fits the biggest frame so far.
+
+	if (arena->blocks != NULL && arena->blocks->next != NULL) {
+		AnimationArenaFreeBlocks(arena);
+		AnimationArenaAddBlock(arena, arena->highWater);
+	}
+
+	if (arena->blocks != NULL) {
+		arena->blocks->used = 0;
+	}
+
+	arena->used = 0;
+	arena->resets++;
+}
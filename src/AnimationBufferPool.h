@@ -0,0 +1,75 @@
+/*
+ * (C) Copyright 2010, Stefan Arentz, Arentz Consulting Inc.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANIMATIONBUFFERPOOL_H
+#define ANIMATIONBUFFERPOOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// All buffers handed out here start on a cache line
+#define AnimationBufferAlignment 64
+
+// A fixed set of equally sized buffers, allocated once. Playback takes its
+// double or triple buffered frames from a pool, so after start up no frame
+// touches the heap. The statistics are there to prove it: allocations only
+// goes up when the pool is created.
+
+typedef struct AnimationBufferPool AnimationBufferPool;
+
+typedef struct AnimationBufferPoolStatistics {
+	uint64_t allocations;	// Heap allocations made by the pool
+	uint64_t acquires;		// Buffers handed out
+	uint64_t releases;		// Buffers given back
+	uint64_t exhausted;		// Acquires that found every buffer in use
+	uint32_t inUse;			// Buffers currently handed out
+} AnimationBufferPoolStatistics;
+
+AnimationBufferPool* AnimationBufferPoolCreate(size_t bufferSize, uint32_t count);
+void AnimationBufferPoolDestroy(AnimationBufferPool* pool);
+
+// Returns NULL when all buffers are in use, the pool never grows
+void* AnimationBufferPoolAcquire(AnimationBufferPool* pool);
+void AnimationBufferPoolRelease(AnimationBufferPool* pool, void* buffer);
+
+void AnimationBufferPoolGetStatistics(AnimationBufferPool* pool, AnimationBufferPoolStatistics* statistics);
+
+// A scratch arena for per-frame temporaries. Allocations are bumped out of
+// one block and all released at once by a reset. When a frame needs more
+// than the block holds, extra blocks are chained on; the next reset merges
+// them into one block big enough for the largest frame seen, so steady state
+// encoding makes no heap allocations. Not thread safe, use one per thread.
+
+typedef struct AnimationArenaBlock AnimationArenaBlock;
+
+typedef struct AnimationArena {
+	AnimationArenaBlock* blocks;
+	size_t used;			// Bytes used since the last reset, over all blocks
+	size_t highWater;		// Most bytes used between two resets
+	uint64_t allocations;	// Heap allocations made by the arena
+	uint64_t resets;
+} AnimationArena;
+
+void AnimationArenaInit(AnimationArena* arena, size_t size);
+void AnimationArenaDestroy(AnimationArena* arena);
+
+void* AnimationArenaAllocate(AnimationArena* arena, size_t size);
+void AnimationArenaReset(AnimationArena* arena);
+
+#endif
@@ -17,10 +17,22 @@
  * limitations under the License.
  */
 
+#ifndef ANIMATIONCOMMON_H
+#define ANIMATIONCOMMON_H
+
 //#import <Foundation/Foundation.h>
 
+#include <stdint.h>
+
 typedef uint32_t AnimationPixel;
 
+typedef struct AnimationRect {
+	uint32_t	x;
+	uint32_t	y;
+	uint32_t	width;
+	uint32_t	height;
+} AnimationRect;
+
 // TODO: Rename this to AnimationContainerHeader
 struct AnimationContainerGlobalHeader {
 	uint32_t	magic;
@@ -33,6 +45,61 @@ struct AnimationContainerGlobalHeader {
 
 typedef struct AnimationContainerGlobalHeader AnimationContainerGlobalHeader;
 
+// Version 2 containers store one of these per frame right after the global
+// header, so any frame can be found without walking the ones before it.
+
+struct AnimationContainerIndexEntry {
+	uint32_t	offset;		// Offset of the image header from the start of the container
+	uint32_t	length;		// Size of the image header plus its data, without padding
+};
+
+typedef struct AnimationContainerIndexEntry AnimationContainerIndexEntry;
+
+// Version 3 containers store a palette shared by all frames between the
+// global header and the frame index: this header followed by count pixels.
+// Palette frames store an index into it per pixel.
+
+#define AnimationContainerMaxPaletteCount 256
+
+struct AnimationContainerPaletteHeader {
+	uint32_t	count;
+};
+
+typedef struct AnimationContainerPaletteHeader AnimationContainerPaletteHeader;
+
+// Block compressed frames ('dxt5') store the image as blocks of 4x4 pixels
+// in rows, 16 bytes each. Blocks on the right and bottom edges are padded
+// with transparent pixels. The image starts on a multiple of 4 so its blocks
+// line up with the blocks of the canvas.
+
+#define AnimationPixelBlockSize 4
+#define AnimationPixelBlockLength 16
+
+// An archive holds many named animations in one file. The header is followed
+// by count directory entries sorted by name (bytewise, shortest first on a
+// common prefix). Every entry points at an embedded container: a global
+// header, palette and index like a version 2 or 3 file, but with image
+// offsets relative to the start of the archive. Containers share identical
+// images by pointing at the same offset.
+
+struct AnimationArchiveHeader {
+	uint32_t	magic;
+	uint32_t	version;
+	uint32_t	count;
+	uint32_t	reserved;
+};
+
+typedef struct AnimationArchiveHeader AnimationArchiveHeader;
+
+struct AnimationArchiveEntry {
+	uint32_t	nameOffset;			// Name bytes, not terminated, relative to the archive
+	uint32_t	nameLength;
+	uint32_t	containerOffset;	// Global header of the embedded container
+	uint32_t	reserved;
+};
+
+typedef struct AnimationArchiveEntry AnimationArchiveEntry;
+
 // TODO: Rename this to AnimationImageHeader
 struct AnimationContainerImageHeader {
 	uint32_t	width;
@@ -48,5 +115,23 @@ typedef struct AnimationContainerImageHeader AnimationContainerImageHeader;
 typedef enum {
 	AnimationContainerImageFormatPNG = 'ping',
 	AnimationContainerImageFormatUncompressedPixels = 'pixl',
-	AnimationContainerImageFormatRunLengthCompressedPixels = 'rlen'
+	AnimationContainerImageFormatRunLengthCompressedPixels = 'rlen',
+	AnimationContainerImageFormatDeltaPixels = 'delt',
+	AnimationContainerImageFormatCompactRunLengthPixels = 'rle2',
+	AnimationContainerImageFormatPalette8Pixels = 'pal8',
+	AnimationContainerImageFormatPalette4Pixels = 'pal4',
+	AnimationContainerImageFormatBandedRunLengthPixels = 'rleb',
+	AnimationContainerImageFormatBlockCompressedPixels = 'dxt5'
 } AnimationContainerImageFormat;
+
+typedef enum {
+	AnimationStatusOK = 0,
+	AnimationStatusTruncated,			// The source ended before the destination was filled
+	AnimationStatusOverflow,			// A run or image does not fit in the destination
+	AnimationStatusInvalidHeader,		// A container or image header is inconsistent
+	AnimationStatusUnsupportedFormat,	// Unknown container version or image format
+	AnimationStatusIOError,				// The container file could not be opened or mapped
+	AnimationStatusNotReady				// A frame was not decoded in time to be shown
+} AnimationStatus;
+
+#endif
\ No newline at end of file
@@ -17,9 +17,609 @@
  * limitations under the License.
  */
  
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
 #include "AnimationCompression.h"
 
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define ANIMATION_HAVE_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+#if defined(__ARM_NEON__) || defined(__ARM_NEON)
+#define ANIMATION_HAVE_NEON 1
+#include <arm_neon.h>
+#endif
+
+// Runs of up to 8 pixels are written inline by the decoder. Longer runs go
+// through the fill function selected at runtime, which may assume n > 8.
+
+typedef void (*AnimationFillPixelsFunction)(uint32_t* dst, uint32_t c, uint32_t n);
+
+static void AnimationFillPixelsScalar(uint32_t* dst, uint32_t c, uint32_t n)
+{
+	while (n-- != 0) {
+		*dst++ = c;
+	}
+}
+
+#if defined(ANIMATION_HAVE_X86_SIMD)
+
+__attribute__((target("sse2")))
+static void AnimationFillPixelsSSE2(uint32_t* dst, uint32_t c, uint32_t n)
+{
+	__m128i v = _mm_set1_epi32((int) c);
+	uint32_t* end = dst + n;
+
+	for (; dst + 16 <= end; dst += 16) {
+		_mm_storeu_si128((__m128i*) (dst + 0), v);
+		_mm_storeu_si128((__m128i*) (dst + 4), v);
+		_mm_storeu_si128((__m128i*) (dst + 8), v);
+		_mm_storeu_si128((__m128i*) (dst + 12), v);
+	}
+
+	for (; dst + 4 <= end; dst += 4) {
+		_mm_storeu_si128((__m128i*) dst, v);
+	}
+
+	// The tail overlaps pixels we already wrote, which is fine since n > 8
+
+	if (dst != end) {
+		_mm_storeu_si128((__m128i*) (end - 4), v);
+	}
+}
+
+__attribute__((target("avx2")))
+static void AnimationFillPixelsAVX2(uint32_t* dst, uint32_t c, uint32_t n)
+{
+	__m256i v = _mm256_set1_epi32((int) c);
+	uint32_t* end = dst + n;
+
+	// One unaligned store for the head, then continue from the next 32 byte
+	// boundary so the bulk of the run does not straddle cache lines.
+
+	_mm256_storeu_si256((__m256i*) dst, v);
+	dst = (uint32_t*) (((uintptr_t) dst + 32) & ~(uintptr_t) 31);
+
+	for (; dst + 32 <= end; dst += 32) {
+		_mm256_store_si256((__m256i*) (dst + 0), v);
+		_mm256_store_si256((__m256i*) (dst + 8), v);
+		_mm256_store_si256((__m256i*) (dst + 16), v);
+		_mm256_store_si256((__m256i*) (dst + 24), v);
+	}
+
+	for (; dst + 8 <= end; dst += 8) {
+		_mm256_store_si256((__m256i*) dst, v);
+	}
+
+	if (dst < end) {
+		_mm256_storeu_si256((__m256i*) (end - 8), v);
+	}
+}
+
+#endif
+
+#if defined(ANIMATION_HAVE_NEON)
+
+static void AnimationFillPixelsNEON(uint32_t* dst, uint32_t c, uint32_t n)
+{
+	uint32x4_t v = vdupq_n_u32(c);
+	uint32_t* end = dst + n;
+
+	for (; dst + 16 <= end; dst += 16) {
+		vst1q_u32(dst + 0, v);
+		vst1q_u32(dst + 4, v);
+		vst1q_u32(dst + 8, v);
+		vst1q_u32(dst + 12, v);
+	}
+
+	for (; dst + 4 <= end; dst += 4) {
+		vst1q_u32(dst, v);
+	}
+
+	if (dst != end) {
+		vst1q_u32(end - 4, v);
+	}
+}
+
+#endif
+
+static pthread_once_t gAnimationFillPixelsOnce = PTHREAD_ONCE_INIT;
+static const char* gAnimationFillPixelsName = "scalar";
+static AnimationFillPixelsFunction gAnimationFillPixels = AnimationFillPixelsScalar;
+
+static void AnimationSelectFillPixels(void)
+{
+#if defined(ANIMATION_HAVE_X86_SIMD)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		gAnimationFillPixels = AnimationFillPixelsAVX2;
+		gAnimationFillPixelsName = "avx2";
+	} else if (__builtin_cpu_supports("sse2")) {
+		gAnimationFillPixels = AnimationFillPixelsSSE2;
+		gAnimationFillPixelsName = "sse2";
+	}
+#elif defined(ANIMATION_HAVE_NEON)
+	gAnimationFillPixels = AnimationFillPixelsNEON;
+	gAnimationFillPixelsName = "neon";
+#endif
+}
+
+// Decoders run on the prefetcher and thread pool threads, the first call
+// from any of them picks the function and the others wait for it
+
+static AnimationFillPixelsFunction AnimationGetFillPixels(void)
+{
+	pthread_once(&gAnimationFillPixelsOnce, AnimationSelectFillPixels);
+	return gAnimationFillPixels;
+}
+
+// Palette lookups, one index byte per pixel. The palette always has 256
+// entries so no index can read past it.
+
+typedef void (*AnimationLookupPixelsFunction)(uint32_t* dst, const uint8_t* src, uint32_t n, const uint32_t* palette);
+
+static void AnimationLookupPixelsScalar(uint32_t* dst, const uint8_t* src, uint32_t n, const uint32_t* palette)
+{
+	for (uint32_t i = 0; i < n; i++) {
+		dst[i] = palette[src[i]];
+	}
+}
+
+#if defined(ANIMATION_HAVE_X86_SIMD)
+
+__attribute__((target("avx2")))
+static void AnimationLookupPixelsAVX2(uint32_t* dst, const uint8_t* src, uint32_t n, const uint32_t* palette)
+{
+	uint32_t i = 0;
+
+	for (; i + 8 <= n; i += 8) {
+		__m256i indexes = _mm256_cvtepu8_epi32(_mm_loadl_epi64((const __m128i*) (src + i)));
+		_mm256_storeu_si256((__m256i*) (dst + i), _mm256_i32gather_epi32((const int*) palette, indexes, 4));
+	}
+
+	for (; i < n; i++) {
+		dst[i] = palette[src[i]];
+	}
+}
+
+#endif
+
+static pthread_once_t gAnimationLookupPixelsOnce = PTHREAD_ONCE_INIT;
+static AnimationLookupPixelsFunction gAnimationLookupPixels = AnimationLookupPixelsScalar;
+
+static void AnimationSelectLookupPixels(void)
+{
+#if defined(ANIMATION_HAVE_X86_SIMD)
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2")) {
+		gAnimationLookupPixels = AnimationLookupPixelsAVX2;
+	}
+#endif
+}
+
+static AnimationLookupPixelsFunction AnimationGetLookupPixels(void)
+{
+	pthread_once(&gAnimationLookupPixelsOnce, AnimationSelectLookupPixels);
+	return gAnimationLookupPixels;
+}
+
+static inline void AnimationWriteRun(uint32_t* dst, uint32_t c, uint32_t n, AnimationFillPixelsFunction fill)
+{
+	switch (n)
+	{
+		case 8: dst[7] = c;
+		case 7: dst[6] = c;
+		case 6: dst[5] = c;
+		case 5: dst[4] = c;
+		case 4: dst[3] = c;
+		case 3: dst[2] = c;
+		case 2: dst[1] = c;
+		case 1: dst[0] = c;
+		case 0: break;
+		default: fill(dst, c, n); break;
+	}
+}
+
+// Premultiplied source over: every channel of dst becomes s + d * (255 - a)
+// / 255, rounded exactly and clamped. A transparent source leaves dst alone
+// and an opaque one replaces it, so callers can skip or fill those instead.
+
+static inline uint32_t AnimationBlendChannels(uint32_t d, uint32_t s, uint32_t ia)
+{
+	// Two channels in the low bytes of two 16-bit lanes, which none of the
+	// sums overflow. A lane that passes 255 sets its bit 8 and saturates.
+
+	uint32_t t = d * ia + 0x00800080;
+	t = ((t + ((t >> 8) & 0x00ff00ff)) >> 8) & 0x00ff00ff;
+	t += s;
+	return (t | (((t >> 8) & 0x00010001) * 0xff)) & 0x00ff00ff;
+}
+
+static inline uint32_t AnimationBlendPixel(uint32_t d, uint32_t s)
+{
+	uint32_t ia = 255 - (s >> 24);
+	uint32_t rb = AnimationBlendChannels(d & 0x00ff00ff, s & 0x00ff00ff, ia);
+	uint32_t ga = AnimationBlendChannels((d >> 8) & 0x00ff00ff, (s >> 8) & 0x00ff00ff, ia);
+	return rb | (ga << 8);
+}
+
+// Blending a run blends one color over n pixels. Blending pixels blends n
+// pixels read from src, which need not be aligned; fully transparent and
+// opaque groups of them are skipped or copied.
+
+typedef void (*AnimationBlendRunFunction)(uint32_t* dst, uint32_t c, uint32_t n);
+typedef void (*AnimationBlendPixelsFunction)(uint32_t* dst, const uint8_t* src, uint32_t n);
+
+static inline uint32_t AnimationReadPixel(const uint8_t* src)
+{
+	uint32_t p;
+	memcpy(&p, src, sizeof(p));
+	return p;
+}
+
+static void AnimationBlendRunScalar(uint32_t* dst, uint32_t c, uint32_t n)
+{
+	for (uint32_t i = 0; i < n; i++) {
+		dst[i] = AnimationBlendPixel(dst[i], c);
+	}
+}
+
+static void AnimationBlendPixelsScalar(uint32_t* dst, const uint8_t* src, uint32_t n)
+{
+	for (uint32_t i = 0; i < n; i++, src += 4)
+	{
+		uint32_t s = AnimationReadPixel(src);
+		if (s >= 0xff000000) {
+			dst[i] = s;
+		} else if (s != 0) {
+			dst[i] = AnimationBlendPixel(dst[i], s);
+		}
+	}
+}
+
+#if defined(ANIMATION_HAVE_X86_SIMD)
+
+// Scales eight 16-bit channels by ia / 255, rounded like AnimationBlendPixel
+
+__attribute__((target("sse2")))
+static inline __m128i AnimationScaleChannelsSSE2(__m128i d, __m128i ia)
+{
+	__m128i t = _mm_add_epi16(_mm_mullo_epi16(d, ia), _mm_set1_epi16(128));
+	return _mm_srli_epi16(_mm_add_epi16(t, _mm_srli_epi16(t, 8)), 8);
+}
+
+__attribute__((target("sse2")))
+static void AnimationBlendRunSSE2(uint32_t* dst, uint32_t c, uint32_t n)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i s = _mm_set1_epi32((int) c);
+	__m128i ia = _mm_set1_epi16((short) (255 - (c >> 24)));
+	uint32_t i = 0;
+
+	for (; i + 4 <= n; i += 4) {
+		__m128i d = _mm_loadu_si128((const __m128i*) (dst + i));
+		__m128i lo = AnimationScaleChannelsSSE2(_mm_unpacklo_epi8(d, zero), ia);
+		__m128i hi = AnimationScaleChannelsSSE2(_mm_unpackhi_epi8(d, zero), ia);
+		_mm_storeu_si128((__m128i*) (dst + i), _mm_adds_epu8(_mm_packus_epi16(lo, hi), s));
+	}
+
+	for (; i < n; i++) {
+		dst[i] = AnimationBlendPixel(dst[i], c);
+	}
+}
+
+__attribute__((target("sse2")))
+static void AnimationBlendPixelsSSE2(uint32_t* dst, const uint8_t* src, uint32_t n)
+{
+	__m128i zero = _mm_setzero_si128();
+	__m128i opaque = _mm_set1_epi32((int) 0xff000000);
+	uint32_t i = 0;
+
+	for (; i + 4 <= n; i += 4)
+	{
+		__m128i s = _mm_loadu_si128((const __m128i*) (src + i * 4));
+
+		if (_mm_movemask_epi8(_mm_cmpeq_epi32(s, zero)) == 0xffff) {
+			continue;
+		}
+
+		if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(s, opaque), opaque)) == 0xffff) {
+			_mm_storeu_si128((__m128i*) (dst + i), s);
+			continue;
+		}
+
+		// 255 - alpha in both 16-bit halves of every pixel, then spread over
+		// the four channels of the two pixels in each half of the register
+
+		__m128i ia = _mm_sub_epi32(_mm_set1_epi32(255), _mm_srli_epi32(s, 24));
+		ia = _mm_or_si128(ia, _mm_slli_epi32(ia, 16));
+
+		__m128i d = _mm_loadu_si128((const __m128i*) (dst + i));
+		__m128i lo = AnimationScaleChannelsSSE2(_mm_unpacklo_epi8(d, zero), _mm_unpacklo_epi32(ia, ia));
+		__m128i hi = AnimationScaleChannelsSSE2(_mm_unpackhi_epi8(d, zero), _mm_unpackhi_epi32(ia, ia));
+		_mm_storeu_si128((__m128i*) (dst + i), _mm_adds_epu8(_mm_packus_epi16(lo, hi), s));
+	}
+
+	AnimationBlendPixelsScalar(dst + i, src + i * 4, n - i);
+}
+
+#endif
+
+#if defined(ANIMATION_HAVE_NEON)
+
+static inline uint8x16_t AnimationScaleChannelsNEON(uint8x16_t d, uint8x16_t ia)
+{
+	uint16x8_t half = vdupq_n_u16(128);
+	uint16x8_t lo = vmlal_u8(half, vget_low_u8(d), vget_low_u8(ia));
+	uint16x8_t hi = vmlal_u8(half, vget_high_u8(d), vget_high_u8(ia));
+	return vcombine_u8(vshrn_n_u16(vaddq_u16(lo, vshrq_n_u16(lo, 8)), 8), vshrn_n_u16(vaddq_u16(hi, vshrq_n_u16(hi, 8)), 8));
+}
+
+static void AnimationBlendRunNEON(uint32_t* dst, uint32_t c, uint32_t n)
+{
+	uint8x16_t s = vreinterpretq_u8_u32(vdupq_n_u32(c));
+	uint8x16_t ia = vdupq_n_u8((uint8_t) (255 - (c >> 24)));
+	uint32_t i = 0;
+
+	for (; i + 4 <= n; i += 4) {
+		uint8x16_t d = vld1q_u8((const uint8_t*) (dst + i));
+		vst1q_u8((uint8_t*) (dst + i), vqaddq_u8(AnimationScaleChannelsNEON(d, ia), s));
+	}
+
+	for (; i < n; i++) {
+		dst[i] = AnimationBlendPixel(dst[i], c);
+	}
+}
+
+static void AnimationBlendPixelsNEON(uint32_t* dst, const uint8_t* src, uint32_t n)
+{
+	uint32_t i = 0;
+
+	for (; i + 4 <= n; i += 4)
+	{
+		uint32x4_t s = vreinterpretq_u32_u8(vld1q_u8(src + i * 4));
+		uint64x2_t all = vreinterpretq_u64_u32(s);
+		uint64x2_t alpha = vreinterpretq_u64_u32(vandq_u32(s, vdupq_n_u32(0xff000000)));
+
+		if ((vgetq_lane_u64(all, 0) | vgetq_lane_u64(all, 1)) == 0) {
+			continue;
+		}
+
+		if ((vgetq_lane_u64(alpha, 0) & vgetq_lane_u64(alpha, 1)) == 0xff000000ff000000ull) {
+			vst1q_u32(dst + i, s);
+			continue;
+		}
+
+		// Alpha copied into every byte of its pixel, inverted to 255 - alpha
+
+		uint8x16_t ia = vmvnq_u8(vreinterpretq_u8_u32(vmulq_n_u32(vshrq_n_u32(s, 24), 0x01010101)));
+		uint8x16_t d = vld1q_u8((const uint8_t*) (dst + i));
+		vst1q_u8((uint8_t*) (dst + i), vqaddq_u8(AnimationScaleChannelsNEON(d, ia), vreinterpretq_u8_u32(s)));
+	}
+
+	AnimationBlendPixelsScalar(dst + i, src + i * 4, n - i);
+}
+
+#endif
+
+// Both functions are picked together and published with a single pointer
+
+typedef struct AnimationBlendFunctions {
+	AnimationBlendRunFunction run;
+	AnimationBlendPixelsFunction pixels;
+} AnimationBlendFunctions;
+
+static const AnimationBlendFunctions gAnimationBlendScalar = { AnimationBlendRunScalar, AnimationBlendPixelsScalar };
+#if defined(ANIMATION_HAVE_X86_SIMD)
+static const AnimationBlendFunctions gAnimationBlendSSE2 = { AnimationBlendRunSSE2, AnimationBlendPixelsSSE2 };
+#endif
+#if defined(ANIMATION_HAVE_NEON)
+static const AnimationBlendFunctions gAnimationBlendNEON = { AnimationBlendRunNEON, AnimationBlendPixelsNEON };
+#endif
+
+static const AnimationBlendFunctions* gAnimationBlend = NULL;
+
+static const AnimationBlendFunctions* AnimationGetBlend(void)
+{
+	if (gAnimationBlend == NULL)
+	{
+		const AnimationBlendFunctions* blend = &gAnimationBlendScalar;
+
+#if defined(ANIMATION_HAVE_X86_SIMD)
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("sse2")) {
+			blend = &gAnimationBlendSSE2;
+		}
+#elif defined(ANIMATION_HAVE_NEON)
+		blend = &gAnimationBlendNEON;
+#endif
+
+		gAnimationBlend = blend;
+	}
+
+	return gAnimationBlend;
+}
+
+static inline void AnimationCompositeRun(uint32_t* dst, uint32_t c, uint32_t n, AnimationFillPixelsFunction fill,
+	const AnimationBlendFunctions* blend)
+{
+	if (c >= 0xff000000) {
+		AnimationWriteRun(dst, c, n, fill);
+	} else if (c == 0) {
+		return;
+	} else if (n < 4) {
+		for (uint32_t i = 0; i < n; i++) {
+			dst[i] = AnimationBlendPixel(dst[i], c);
+		}
+	} else {
+		blend->run(dst, c, n);
+	}
+}
+
+const char* AnimationCompressionImplementationName(void)
+{
+	AnimationGetFillPixels();
+	return gAnimationFillPixelsName;
+}
+
 void AnimationDecompressRunLengthEncodedPixels(uint32_t* dst, uint32_t* src, uint32_t count)
+{
+	AnimationFillPixelsFunction fill = AnimationGetFillPixels();
+
+	while (count != 0)
+	{
+		uint32_t n = *src++;
+		uint32_t c = *src++;
+
+		AnimationWriteRun(dst, c, n, fill);
+
+		dst += n;
+		count -= n;
+	}
+}
+
+AnimationStatus AnimationDecompressRunLengthEncodedPixelsChecked(uint32_t* dst, uint32_t dstCount, const uint32_t* src, uint32_t srcLength)
+{
+	AnimationFillPixelsFunction fill = AnimationGetFillPixels();
+
+	// Checks are done once per run, never per pixel. Trailing bytes after the
+	// last run and a partial trailing run are treated the same as the
+	// unchecked decoder would: they are never read.
+
+	const uint32_t* end = src + (srcLength / 8) * 2;
+
+	while (dstCount != 0)
+	{
+		if (src == end) {
+			return AnimationStatusTruncated;
+		}
+
+		uint32_t n = *src++;
+		uint32_t c = *src++;
+
+		if (n > dstCount) {
+			return AnimationStatusOverflow;
+		}
+
+		AnimationWriteRun(dst, c, n, fill);
+
+		dst += n;
+		dstCount -= n;
+	}
+
+	return AnimationStatusOK;
+}
+
+// Writes or, when composite is set, blends the runs. Inlined into both
+// callers so neither pays for the other's branch.
+
+static inline AnimationStatus AnimationDrawRunLengthEncodedPixelsRect(uint32_t* dst, uint32_t stride, uint32_t width, uint32_t height,
+	const uint32_t* src, uint32_t srcLength, int composite)
+{
+	AnimationFillPixelsFunction fill = AnimationGetFillPixels();
+	const AnimationBlendFunctions* blend = composite ? AnimationGetBlend() : NULL;
+
+	const uint32_t* end = src + (srcLength / 8) * 2;
+	uint32_t remaining = width * height;
+	uint32_t x = 0;
+
+	while (remaining != 0)
+	{
+		if (src == end) {
+			return AnimationStatusTruncated;
+		}
+
+		uint32_t n = *src++;
+		uint32_t c = *src++;
+
+		if (n > remaining) {
+			return AnimationStatusOverflow;
+		}
+
+		remaining -= n;
+
+		while (n != 0)
+		{
+			uint32_t m = width - x;
+			if (m > n) {
+				m = n;
+			}
+
+			if (composite) {
+				AnimationCompositeRun(dst + x, c, m, fill, blend);
+			} else {
+				AnimationWriteRun(dst + x, c, m, fill);
+			}
+
+			x += m;
+			n -= m;
+
+			if (x == width) {
+				x = 0;
+				dst += stride;
+			}
+		}
+	}
+
+	return AnimationStatusOK;
+}
+
+AnimationStatus AnimationDecompressRunLengthEncodedPixelsRect(uint32_t* dst, uint32_t stride, uint32_t width, uint32_t height,
+	const uint32_t* src, uint32_t srcLength)
+{
+	// Full width rectangles are contiguous, nothing to split
+
+	if (width == stride || width == 0 || height <= 1) {
+		return AnimationDecompressRunLengthEncodedPixelsChecked(dst, width * height, src, srcLength);
+	}
+
+	return AnimationDrawRunLengthEncodedPixelsRect(dst, stride, width, height, src, srcLength, 0);
+}
+
+// The compositing twin of AnimationDecompressRunLengthEncodedPixelsChecked
+
+static AnimationStatus AnimationCompositeRunLengthEncodedPixelsChecked(uint32_t* dst, uint32_t dstCount, const uint32_t* src, uint32_t srcLength)
+{
+	AnimationFillPixelsFunction fill = AnimationGetFillPixels();
+	const AnimationBlendFunctions* blend = AnimationGetBlend();
+
+	const uint32_t* end = src + (srcLength / 8) * 2;
+
+	while (dstCount != 0)
+	{
+		if (src == end) {
+			return AnimationStatusTruncated;
+		}
+
+		uint32_t n = *src++;
+		uint32_t c = *src++;
+
+		if (n > dstCount) {
+			return AnimationStatusOverflow;
+		}
+
+		AnimationCompositeRun(dst, c, n, fill, blend);
+
+		dst += n;
+		dstCount -= n;
+	}
+
+	return AnimationStatusOK;
+}
+
+AnimationStatus AnimationCompositeRunLengthEncodedPixelsRect(uint32_t* dst, uint32_t stride, uint32_t width, uint32_t height,
+	const uint32_t* src, uint32_t srcLength)
+{
+	if (width == stride || width == 0 || height <= 1) {
+		return AnimationCompositeRunLengthEncodedPixelsChecked(dst, width * height, src, srcLength);
+	}
+
+	return AnimationDrawRunLengthEncodedPixelsRect(dst, stride, width, height, src, srcLength, 1);
+}
+
+void AnimationDecompressRunLengthEncodedPixelsScalar(uint32_t* dst, uint32_t* src, uint32_t count)
 {
 	while (count != 0)
 	{
@@ -61,4 +661,1164 @@ uint32_t AnimationCompressRunLengthEncodedPixels(uint32_t* dst, uint32_t* src, u
     }
     
     return compressedLength * 4;
-}
\ No newline at end of file
+}
+
+uint32_t AnimationCompressBandedRunLengthPixels(uint32_t* dst, uint32_t dstLength, const uint32_t* src, uint32_t width, uint32_t height,
+	uint32_t bandHeight)
+{
+	if (bandHeight == 0) {
+		return UINT32_MAX;
+	}
+
+	uint32_t bandCount = height / bandHeight + (height % bandHeight != 0);
+	uint32_t capacity = dstLength / sizeof(uint32_t);
+	uint32_t length = 2 + bandCount;
+
+	if (length > capacity) {
+		return UINT32_MAX;
+	}
+
+	dst[0] = bandHeight;
+	dst[1] = bandCount;
+
+	for (uint32_t band = 0; band < bandCount; band++)
+	{
+		uint32_t rows = height - band * bandHeight;
+		if (rows > bandHeight) {
+			rows = bandHeight;
+		}
+
+		const uint32_t* pixels = src + band * bandHeight * width;
+		uint32_t count = rows * width;
+
+		dst[2 + band] = length * sizeof(uint32_t);
+
+		// Runs stop at the last pixel of the band, so every band can be
+		// decoded without looking at the others
+
+		for (uint32_t i = 0; i < count; )
+		{
+			uint32_t c = pixels[i];
+			uint32_t n = 1;
+			while (i + n < count && pixels[i + n] == c) {
+				n++;
+			}
+
+			if (capacity - length < 2) {
+				return UINT32_MAX;
+			}
+
+			dst[length++] = n;
+			dst[length++] = c;
+			i += n;
+		}
+	}
+
+	return length * sizeof(uint32_t);
+}
+
+AnimationStatus AnimationBandedRunLengthPixelsGetBandCount(const uint32_t* src, uint32_t srcLength, uint32_t height, uint32_t* bandCount)
+{
+	if (srcLength < 2 * sizeof(uint32_t)) {
+		return AnimationStatusTruncated;
+	}
+
+	uint32_t bandHeight = src[0];
+	uint32_t count = src[1];
+
+	if (bandHeight == 0 || count != height / bandHeight + (height % bandHeight != 0)) {
+		return AnimationStatusInvalidHeader;
+	}
+
+	if (count > (srcLength - 2 * sizeof(uint32_t)) / sizeof(uint32_t)) {
+		return AnimationStatusTruncated;
+	}
+
+	// Bands follow the table in order and start on a pixel boundary
+
+	uint32_t start = (2 + count) * sizeof(uint32_t);
+
+	for (uint32_t band = 0; band < count; band++)
+	{
+		uint32_t offset = src[2 + band];
+		if (offset < start || offset > srcLength || (offset % sizeof(uint32_t)) != 0) {
+			return AnimationStatusInvalidHeader;
+		}
+		start = offset;
+	}
+
+	*bandCount = count;
+
+	return AnimationStatusOK;
+}
+
+static inline AnimationStatus AnimationDrawBandedRunLengthPixelsBand(uint32_t* dst, uint32_t stride, uint32_t width, uint32_t height,
+	const uint32_t* src, uint32_t srcLength, uint32_t band, int composite)
+{
+	uint32_t bandHeight = src[0];
+	uint32_t bandCount = src[1];
+
+	uint32_t start = src[2 + band];
+	uint32_t end = (band + 1 < bandCount) ? src[3 + band] : srcLength;
+
+	uint32_t y = band * bandHeight;
+	uint32_t rows = height - y;
+	if (rows > bandHeight) {
+		rows = bandHeight;
+	}
+
+	if (composite) {
+		return AnimationCompositeRunLengthEncodedPixelsRect(dst + y * stride, stride, width, rows,
+			src + start / sizeof(uint32_t), end - start);
+	}
+
+	return AnimationDecompressRunLengthEncodedPixelsRect(dst + y * stride, stride, width, rows,
+		src + start / sizeof(uint32_t), end - start);
+}
+
+AnimationStatus AnimationDecompressBandedRunLengthPixelsBand(uint32_t* dst, uint32_t stride, uint32_t width, uint32_t height,
+	const uint32_t* src, uint32_t srcLength, uint32_t band)
+{
+	return AnimationDrawBandedRunLengthPixelsBand(dst, stride, width, height, src, srcLength, band, 0);
+}
+
+AnimationStatus AnimationCompositeBandedRunLengthPixelsBand(uint32_t* dst, uint32_t stride, uint32_t width, uint32_t height,
+	const uint32_t* src, uint32_t srcLength, uint32_t band)
+{
+	return AnimationDrawBandedRunLengthPixelsBand(dst, stride, width, height, src, srcLength, band, 1);
+}
+
+static inline AnimationStatus AnimationDrawBandedRunLengthPixelsRect(uint32_t* dst, uint32_t stride, uint32_t width, uint32_t height,
+	const uint32_t* src, uint32_t srcLength, int composite)
+{
+	uint32_t bandCount = 0;
+
+	AnimationStatus status = AnimationBandedRunLengthPixelsGetBandCount(src, srcLength, height, &bandCount);
+
+	for (uint32_t band = 0; band < bandCount && status == AnimationStatusOK; band++) {
+		status = AnimationDrawBandedRunLengthPixelsBand(dst, stride, width, height, src, srcLength, band, composite);
+	}
+
+	return status;
+}
+
+AnimationStatus AnimationDecompressBandedRunLengthPixelsRect(uint32_t* dst, uint32_t stride, uint32_t width, uint32_t height,
+	const uint32_t* src, uint32_t srcLength)
+{
+	return AnimationDrawBandedRunLengthPixelsRect(dst, stride, width, height, src, srcLength, 0);
+}
+
+AnimationStatus AnimationCompositeBandedRunLengthPixelsRect(uint32_t* dst, uint32_t stride, uint32_t width, uint32_t height,
+	const uint32_t* src, uint32_t srcLength)
+{
+	return AnimationDrawBandedRunLengthPixelsRect(dst, stride, width, height, src, srcLength, 1);
+}
+
+uint32_t AnimationCompressDeltaPixels(uint32_t* dst, uint32_t dstLength, const uint32_t* src, const uint32_t* previous, uint32_t count)
+{
+	uint32_t compressedLength = 0;
+	uint32_t skip = 0;
+	uint32_t i = 0;
+
+	while (i < count)
+	{
+		if (src[i] == previous[i]) {
+			skip++;
+			i++;
+			continue;
+		}
+
+		// A run only covers pixels that changed, so the decoder does not
+		// rewrite unchanged pixels that happen to have the same color.
+
+		uint32_t c = src[i];
+		uint32_t n = 1;
+		for (i++; i < count && src[i] == c && previous[i] != c; i++) {
+			n++;
+		}
+
+		if (dstLength - compressedLength < 12) {
+			return UINT32_MAX;
+		}
+
+		*dst++ = skip; *dst++ = n; *dst++ = c; compressedLength += 12;
+		skip = 0;
+	}
+
+	return compressedLength;
+}
+
+AnimationStatus AnimationDecompressDeltaPixelsChecked(uint32_t* dst, uint32_t dstCount, const uint32_t* src, uint32_t srcLength)
+{
+	AnimationFillPixelsFunction fill = AnimationGetFillPixels();
+
+	const uint32_t* end = src + (srcLength / 12) * 3;
+
+	while (src != end)
+	{
+		uint32_t skip = *src++;
+		uint32_t n = *src++;
+		uint32_t c = *src++;
+
+		if (skip > dstCount || n > dstCount - skip) {
+			return AnimationStatusOverflow;
+		}
+
+		dst += skip;
+		AnimationWriteRun(dst, c, n, fill);
+
+		dst += n;
+		dstCount -= skip + n;
+	}
+
+	return AnimationStatusOK;
+}
+
+void AnimationDeltaPixelsBounds(const uint32_t* src, uint32_t srcLength, uint32_t width, uint32_t height, AnimationRect* bounds)
+{
+	const uint32_t* end = src + (srcLength / 12) * 3;
+	uint64_t count = (uint64_t) width * height;
+	uint64_t position = 0;
+
+	uint32_t left = width;
+	uint32_t top = height;
+	uint32_t right = 0;
+	uint32_t bottom = 0;
+
+	while (src != end)
+	{
+		uint32_t skip = *src++;
+		uint32_t n = *src++;
+		src++;
+
+		position += skip;
+		if (n == 0) {
+			continue;
+		}
+		if (position + n > count) {
+			break;
+		}
+
+		uint32_t firstRow = (uint32_t) (position / width);
+		uint32_t lastRow = (uint32_t) ((position + n - 1) / width);
+
+		// A run that wraps onto the next row touches both of its ends
+
+		uint32_t firstColumn = 0;
+		uint32_t lastColumn = width - 1;
+		if (firstRow == lastRow) {
+			firstColumn = (uint32_t) (position % width);
+			lastColumn = (uint32_t) ((position + n - 1) % width);
+		}
+
+		if (firstColumn < left) {
+			left = firstColumn;
+		}
+		if (lastColumn + 1 > right) {
+			right = lastColumn + 1;
+		}
+		if (firstRow < top) {
+			top = firstRow;
+		}
+		if (lastRow + 1 > bottom) {
+			bottom = lastRow + 1;
+		}
+
+		position += n;
+	}
+
+	if (right <= left || bottom <= top) {
+		right = left;
+		bottom = top;
+	}
+
+	bounds->x = left;
+	bounds->y = top;
+	bounds->width = right - left;
+	bounds->height = bottom - top;
+}
+
+AnimationStatus AnimationDecompressDeltaPixelsRect(uint32_t* dst, uint32_t stride, uint32_t width, uint32_t height,
+	const uint32_t* src, uint32_t srcLength)
+{
+	if (width == stride || width == 0 || height <= 1) {
+		return AnimationDecompressDeltaPixelsChecked(dst, width * height, src, srcLength);
+	}
+
+	AnimationFillPixelsFunction fill = AnimationGetFillPixels();
+
+	const uint32_t* end = src + (srcLength / 12) * 3;
+	uint32_t remaining = width * height;
+	uint32_t x = 0;
+
+	while (src != end)
+	{
+		uint32_t skip = *src++;
+		uint32_t n = *src++;
+		uint32_t c = *src++;
+
+		if (skip > remaining || n > remaining - skip) {
+			return AnimationStatusOverflow;
+		}
+
+		remaining -= skip + n;
+
+		x += skip;
+		if (x >= width) {
+			dst += (x / width) * stride;
+			x %= width;
+		}
+
+		while (n != 0)
+		{
+			uint32_t m = width - x;
+			if (m > n) {
+				m = n;
+			}
+
+			AnimationWriteRun(dst + x, c, m, fill);
+
+			x += m;
+			n -= m;
+
+			if (x == width) {
+				x = 0;
+				dst += stride;
+			}
+		}
+	}
+
+	return AnimationStatusOK;
+}
+
+// Pixels are RGBA in memory, so red is the low byte of an AnimationPixel
+
+static inline uint32_t AnimationPixelTo565(uint32_t p)
+{
+	uint32_t r = ((p & 0xff) * 31 + 127) / 255;
+	uint32_t g = (((p >> 8) & 0xff) * 63 + 127) / 255;
+	uint32_t b = (((p >> 16) & 0xff) * 31 + 127) / 255;
+	return (r << 11) | (g << 5) | b;
+}
+
+static inline uint32_t AnimationPixelFrom565(uint32_t v)
+{
+	uint32_t r = (v >> 11) & 0x1f;
+	uint32_t g = (v >> 5) & 0x3f;
+	uint32_t b = v & 0x1f;
+	return ((r << 3) | (r >> 2)) | (((g << 2) | (g >> 4)) << 8) | (((b << 3) | (b >> 2)) << 16) | 0xff000000;
+}
+
+static inline uint32_t AnimationPixelTo4444(uint32_t p)
+{
+	uint32_t r = ((p & 0xff) * 15 + 127) / 255;
+	uint32_t g = (((p >> 8) & 0xff) * 15 + 127) / 255;
+	uint32_t b = (((p >> 16) & 0xff) * 15 + 127) / 255;
+	uint32_t a = ((p >> 24) * 15 + 127) / 255;
+	return (r << 12) | (g << 8) | (b << 4) | a;
+}
+
+static inline uint32_t AnimationPixelFrom4444(uint32_t v)
+{
+	return ((v >> 12) & 0xf) * 0x11 | (((v >> 8) & 0xf) * 0x11) << 8 | (((v >> 4) & 0xf) * 0x11) << 16 | ((v & 0xf) * 0x11) << 24;
+}
+
+static inline uint32_t AnimationPixelModeSize(uint32_t mode)
+{
+	return (mode == AnimationPixelModeRGBA8888) ? 4 : 2;
+}
+
+static inline uint32_t AnimationLoadPixel(const uint8_t* src, uint32_t mode)
+{
+	switch (mode) {
+		case AnimationPixelModeRGB565:
+			return AnimationPixelFrom565(src[0] | (src[1] << 8));
+		case AnimationPixelModeRGBA4444:
+			return AnimationPixelFrom4444(src[0] | (src[1] << 8));
+		default:
+			return src[0] | (src[1] << 8) | (src[2] << 16) | ((uint32_t) src[3] << 24);
+	}
+}
+
+static inline uint8_t* AnimationStorePixel(uint8_t* dst, uint32_t p, uint32_t mode)
+{
+	switch (mode) {
+		case AnimationPixelModeRGB565:
+			p = AnimationPixelTo565(p);
+			break;
+		case AnimationPixelModeRGBA4444:
+			p = AnimationPixelTo4444(p);
+			break;
+		default:
+			*dst++ = p; *dst++ = p >> 8; *dst++ = p >> 16; *dst++ = p >> 24;
+			return dst;
+	}
+	*dst++ = p; *dst++ = p >> 8;
+	return dst;
+}
+
+static void AnimationLoadPixels(uint32_t* dst, const uint8_t* src, uint32_t n, uint32_t mode)
+{
+	// Literal spans of 32-bit pixels are a straight copy, the 16-bit modes
+	// expand in a loop the compiler can vectorize
+
+	switch (mode) {
+		case AnimationPixelModeRGB565:
+			for (uint32_t i = 0; i < n; i++, src += 2) {
+				dst[i] = AnimationPixelFrom565(src[0] | (src[1] << 8));
+			}
+			break;
+		case AnimationPixelModeRGBA4444:
+			for (uint32_t i = 0; i < n; i++, src += 2) {
+				dst[i] = AnimationPixelFrom4444(src[0] | (src[1] << 8));
+			}
+			break;
+		default:
+			memcpy(dst, src, n * 4);
+			break;
+	}
+}
+
+int AnimationQuantizePixels(uint32_t* pixels, uint32_t count, AnimationPixelMode mode)
+{
+	switch (mode)
+	{
+		case AnimationPixelModeRGBA8888:
+			return 1;
+
+		case AnimationPixelModeRGB565:
+			for (uint32_t i = 0; i < count; i++) {
+				if ((pixels[i] >> 24) != 0xff) {
+					return 0;
+				}
+			}
+			for (uint32_t i = 0; i < count; i++) {
+				pixels[i] = AnimationPixelFrom565(AnimationPixelTo565(pixels[i]));
+			}
+			return 1;
+
+		case AnimationPixelModeRGBA4444:
+			for (uint32_t i = 0; i < count; i++) {
+				pixels[i] = AnimationPixelFrom4444(AnimationPixelTo4444(pixels[i]));
+			}
+			return 1;
+	}
+
+	return 0;
+}
+
+static inline uint8_t* AnimationStoreVarint(uint8_t* dst, uint32_t v)
+{
+	while (v >= 0x80) {
+		*dst++ = (v & 0x7f) | 0x80;
+		v >>= 7;
+	}
+	*dst++ = v;
+	return dst;
+}
+
+uint32_t AnimationCompressCompactRunLengthPixels(uint8_t* dst, uint32_t dstLength, const uint32_t* src, uint32_t count,
+	AnimationPixelMode mode)
+{
+	uint32_t size = AnimationPixelModeSize(mode);
+
+	// A run of two only pays for its header with 32-bit pixels
+
+	uint32_t minimumRun = (size == 4) ? 2 : 3;
+
+	// Runs are found on the stored values, so colors that round to the same
+	// stored pixel join one run
+
+	uint8_t* start = dst;
+	uint8_t* end = dst + dstLength;
+
+	if (dstLength == 0) {
+		return UINT32_MAX;
+	}
+	*dst++ = (uint8_t) mode;
+
+	uint32_t literal = 0;	// Start of the pending literal span
+	uint32_t i = 0;
+
+	while (i <= count)
+	{
+		uint32_t n = 0;
+		if (i < count)
+		{
+			uint32_t c = src[i];
+			if (mode == AnimationPixelModeRGB565) {
+				c = AnimationPixelTo565(c);
+				for (n = 1; i + n < count && AnimationPixelTo565(src[i + n]) == c; n++) {
+				}
+			} else if (mode == AnimationPixelModeRGBA4444) {
+				c = AnimationPixelTo4444(c);
+				for (n = 1; i + n < count && AnimationPixelTo4444(src[i + n]) == c; n++) {
+				}
+			} else {
+				for (n = 1; i + n < count && src[i + n] == c; n++) {
+				}
+			}
+
+			if (n < minimumRun) {
+				i += n;
+				continue;
+			}
+		}
+
+		// Flush the literal span that ends here, then the run
+
+		if (i > literal)
+		{
+			uint32_t m = i - literal;
+			if ((uint32_t) (end - dst) < 5 + m * size) {
+				return UINT32_MAX;
+			}
+			dst = AnimationStoreVarint(dst, (m - 1) << 1);
+			for (uint32_t j = literal; j < i; j++) {
+				dst = AnimationStorePixel(dst, src[j], mode);
+			}
+		}
+
+		if (i == count) {
+			break;
+		}
+
+		if ((uint32_t) (end - dst) < 5 + size) {
+			return UINT32_MAX;
+		}
+		dst = AnimationStoreVarint(dst, ((n - 1) << 1) | 1);
+		dst = AnimationStorePixel(dst, src[i], mode);
+
+		i += n;
+		literal = i;
+	}
+
+	return (uint32_t) (dst - start);
+}
+
+AnimationStatus AnimationDecompressCompactRunLengthPixelsChecked(uint32_t* dst, uint32_t dstCount, const uint8_t* src, uint32_t srcLength)
+{
+	return AnimationDecompressCompactRunLengthPixelsRect(dst, dstCount, dstCount, 1, src, srcLength);
+}
+
+// Blends a literal span. 32-bit pixels are blended where they are, 4444
+// ones are expanded a chunk at a time first. RGB565 is always opaque and
+// simply loaded.
+
+static void AnimationCompositeLiteralPixels(uint32_t* dst, const uint8_t* src, uint32_t n, uint32_t mode,
+	const AnimationBlendFunctions* blend)
+{
+	switch (mode) {
+		case AnimationPixelModeRGB565:
+			AnimationLoadPixels(dst, src, n, mode);
+			break;
+		case AnimationPixelModeRGBA4444:
+		{
+			uint32_t chunk[64];
+			while (n != 0) {
+				uint32_t m = (n < 64) ? n : 64;
+				AnimationLoadPixels(chunk, src, m, mode);
+				blend->pixels(dst, (const uint8_t*) chunk, m);
+				dst += m;
+				src += m * 2;
+				n -= m;
+			}
+			break;
+		}
+		default:
+			blend->pixels(dst, src, n);
+			break;
+	}
+}
+
+static inline AnimationStatus AnimationDrawCompactRunLengthPixelsRect(uint32_t* dst, uint32_t stride, uint32_t width, uint32_t height,
+	const uint8_t* src, uint32_t srcLength, int composite)
+{
+	AnimationFillPixelsFunction fill = AnimationGetFillPixels();
+	const AnimationBlendFunctions* blend = composite ? AnimationGetBlend() : NULL;
+
+	uint32_t remaining = width * height;
+	if (remaining == 0) {
+		return AnimationStatusOK;
+	}
+
+	if (srcLength == 0) {
+		return AnimationStatusTruncated;
+	}
+
+	const uint8_t* end = src + srcLength;
+	uint32_t mode = *src++;
+	if (mode > AnimationPixelModeRGBA4444) {
+		return AnimationStatusUnsupportedFormat;
+	}
+
+	uint32_t size = AnimationPixelModeSize(mode);
+	uint32_t x = 0;
+
+	while (remaining != 0)
+	{
+		// The header is at most five bytes, anything longer can not describe
+		// a count that fits in the frame
+
+		uint64_t h = 0;
+		for (int shift = 0; ; shift += 7)
+		{
+			if (src == end) {
+				return AnimationStatusTruncated;
+			}
+			if (shift == 35) {
+				return AnimationStatusOverflow;
+			}
+			uint8_t b = *src++;
+			h |= (uint64_t) (b & 0x7f) << shift;
+			if ((b & 0x80) == 0) {
+				break;
+			}
+		}
+
+		if ((h >> 1) >= remaining) {
+			return AnimationStatusOverflow;
+		}
+
+		uint32_t n = (uint32_t) (h >> 1) + 1;
+		int run = (int) (h & 1);
+
+		if ((uint32_t) (end - src) < (run ? 1 : n) * size) {
+			return AnimationStatusTruncated;
+		}
+
+		remaining -= n;
+
+		uint32_t c = run ? AnimationLoadPixel(src, mode) : 0;
+		if (run) {
+			src += size;
+		}
+
+		while (n != 0)
+		{
+			uint32_t m = width - x;
+			if (m > n) {
+				m = n;
+			}
+
+			if (run && composite) {
+				AnimationCompositeRun(dst + x, c, m, fill, blend);
+			} else if (run) {
+				AnimationWriteRun(dst + x, c, m, fill);
+			} else if (composite) {
+				AnimationCompositeLiteralPixels(dst + x, src, m, mode, blend);
+				src += m * size;
+			} else {
+				AnimationLoadPixels(dst + x, src, m, mode);
+				src += m * size;
+			}
+
+			x += m;
+			n -= m;
+
+			if (x == width) {
+				x = 0;
+				dst += stride;
+			}
+		}
+	}
+
+	return AnimationStatusOK;
+}
+
+AnimationStatus AnimationDecompressCompactRunLengthPixelsRect(uint32_t* dst, uint32_t stride, uint32_t width, uint32_t height,
+	const uint8_t* src, uint32_t srcLength)
+{
+	return AnimationDrawCompactRunLengthPixelsRect(dst, stride, width, height, src, srcLength, 0);
+}
+
+AnimationStatus AnimationCompositeCompactRunLengthPixelsRect(uint32_t* dst, uint32_t stride, uint32_t width, uint32_t height,
+	const uint8_t* src, uint32_t srcLength)
+{
+	if (width == stride || height <= 1) {
+		width *= height;
+		height = 1;
+	}
+
+	return AnimationDrawCompactRunLengthPixelsRect(dst, stride, width, height, src, srcLength, 1);
+}
+
+uint32_t AnimationCompressPalettePixels(uint8_t* dst, uint32_t dstLength, const uint32_t* src, uint32_t count,
+	const uint32_t* palette, uint32_t paletteCount, uint32_t bits)
+{
+	uint32_t length = (bits == 4) ? (count + 1) / 2 : count;
+	if (length > dstLength || paletteCount > 256 || (bits == 4 && paletteCount > 16)) {
+		return UINT32_MAX;
+	}
+
+	// Colors to indexes through a small open addressing table. The slot
+	// holds index + 1 so zero means empty.
+
+	uint32_t colors[512];
+	uint16_t slots[512];
+	memset(slots, 0, sizeof(slots));
+
+	for (uint32_t i = 0; i < paletteCount; i++)
+	{
+		uint32_t h = (palette[i] * 2654435761u) >> 23;
+		while (slots[h] != 0 && colors[h] != palette[i]) {
+			h = (h + 1) & 511;
+		}
+		if (slots[h] == 0) {
+			colors[h] = palette[i];
+			slots[h] = (uint16_t) (i + 1);
+		}
+	}
+
+	uint32_t last = 0;
+	uint32_t lastIndex = UINT32_MAX;
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		uint32_t c = src[i];
+		if (c != last || lastIndex == UINT32_MAX)
+		{
+			uint32_t h = (c * 2654435761u) >> 23;
+			while (slots[h] != 0 && colors[h] != c) {
+				h = (h + 1) & 511;
+			}
+			if (slots[h] == 0) {
+				return UINT32_MAX;
+			}
+			last = c;
+			lastIndex = slots[h] - 1u;
+		}
+
+		if (bits == 4) {
+			if ((i & 1) == 0) {
+				dst[i / 2] = (uint8_t) lastIndex;
+			} else {
+				dst[i / 2] |= (uint8_t) (lastIndex << 4);
+			}
+		} else {
+			dst[i] = (uint8_t) lastIndex;
+		}
+	}
+
+	return length;
+}
+
+AnimationStatus AnimationDecompressPalettePixelsRect(uint32_t* dst, uint32_t stride, uint32_t width, uint32_t height,
+	const uint8_t* src, uint32_t srcLength, const uint32_t* palette, uint32_t bits)
+{
+	uint32_t count = width * height;
+
+	if (bits == 8)
+	{
+		if (srcLength < count) {
+			return AnimationStatusTruncated;
+		}
+
+		AnimationLookupPixelsFunction lookup = AnimationGetLookupPixels();
+
+		if (width == stride) {
+			lookup(dst, src, count, palette);
+		} else {
+			for (uint32_t y = 0; y < height; y++) {
+				lookup(dst + y * stride, src + y * width, width, palette);
+			}
+		}
+
+		return AnimationStatusOK;
+	}
+
+	if (srcLength < (count + 1) / 2) {
+		return AnimationStatusTruncated;
+	}
+
+	// Two pixels per byte, low nibble first. A table of both pixels for each
+	// byte value turns the pairs into single 64-bit copies.
+
+	uint32_t pairs[256][2];
+	for (uint32_t i = 0; i < 256; i++) {
+		pairs[i][0] = palette[i & 0xf];
+		pairs[i][1] = palette[i >> 4];
+	}
+
+	for (uint32_t y = 0; y < height; y++)
+	{
+		uint32_t* row = dst + y * stride;
+		uint32_t i = y * width;
+		uint32_t end = i + width;
+
+		// Rows of odd width start halfway through a byte every other row
+
+		if ((i & 1) != 0 && i < end) {
+			*row++ = pairs[src[i / 2]][1];
+			i++;
+		}
+
+		for (; i + 2 <= end; i += 2, row += 2) {
+			memcpy(row, pairs[src[i / 2]], sizeof(pairs[0]));
+		}
+
+		if (i < end) {
+			*row = pairs[src[i / 2]][0];
+		}
+	}
+
+	return AnimationStatusOK;
+}
+
+uint32_t AnimationBlockCompressedLength(uint32_t width, uint32_t height)
+{
+	return ((width + 3) / 4) * ((height + 3) / 4) * AnimationPixelBlockLength;
+}
+
+// The values a block's endpoints give, exactly as the decoder computes them.
+// Colors are expanded to 8 bits per channel in r, g, b order.
+
+static void AnimationBlockAlphaPalette(uint32_t a0, uint32_t a1, uint32_t alphas[8])
+{
+	alphas[0] = a0;
+	alphas[1] = a1;
+
+	if (a0 > a1) {
+		for (uint32_t i = 1; i < 7; i++) {
+			alphas[i + 1] = ((7 - i) * a0 + i * a1 + 3) / 7;
+		}
+	} else {
+		for (uint32_t i = 1; i < 5; i++) {
+			alphas[i + 1] = ((5 - i) * a0 + i * a1 + 2) / 5;
+		}
+		alphas[6] = 0;
+		alphas[7] = 255;
+	}
+}
+
+static void AnimationBlockColorPalette(uint32_t c0, uint32_t c1, uint32_t colors[4][3])
+{
+	uint32_t endpoints[2] = { c0, c1 };
+
+	for (uint32_t e = 0; e < 2; e++) {
+		uint32_t r = (endpoints[e] >> 11) & 0x1f;
+		uint32_t g = (endpoints[e] >> 5) & 0x3f;
+		uint32_t b = endpoints[e] & 0x1f;
+		colors[e][0] = (r << 3) | (r >> 2);
+		colors[e][1] = (g << 2) | (g >> 4);
+		colors[e][2] = (b << 3) | (b >> 2);
+	}
+
+	for (uint32_t k = 0; k < 3; k++) {
+		colors[2][k] = (2 * colors[0][k] + colors[1][k] + 1) / 3;
+		colors[3][k] = (colors[0][k] + 2 * colors[1][k] + 1) / 3;
+	}
+}
+
+// Lossy color may come out brighter than its alpha, which premultiplied
+// pixels can not be
+
+static inline uint32_t AnimationBlockPixel(const uint32_t color[3], uint32_t a)
+{
+	uint32_t r = (color[0] < a) ? color[0] : a;
+	uint32_t g = (color[1] < a) ? color[1] : a;
+	uint32_t b = (color[2] < a) ? color[2] : a;
+	return r | (g << 8) | (b << 16) | (a << 24);
+}
+
+static inline uint32_t AnimationPackColor565(const uint32_t color[3])
+{
+	return (((color[0] * 31 + 127) / 255) << 11) | (((color[1] * 63 + 127) / 255) << 5) | ((color[2] * 31 + 127) / 255);
+}
+
+static void AnimationCompressPixelBlock(uint8_t* block, const uint32_t pixels[16])
+{
+	// Alpha endpoints are the extremes, so fully transparent and fully
+	// opaque pixels always come back exact
+
+	uint32_t low = 255, high = 0;
+	for (uint32_t i = 0; i < 16; i++) {
+		uint32_t a = pixels[i] >> 24;
+		low = (a < low) ? a : low;
+		high = (a > high) ? a : high;
+	}
+
+	uint32_t alphas[8];
+	AnimationBlockAlphaPalette(high, low, alphas);
+
+	uint32_t decodedAlphas[16];
+	uint64_t alphaIndices = 0;
+
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		uint32_t a = pixels[i] >> 24;
+		uint32_t best = 0;
+		for (uint32_t j = 1; j < 8; j++) {
+			if (abs((int) alphas[j] - (int) a) < abs((int) alphas[best] - (int) a)) {
+				best = j;
+			}
+		}
+		alphaIndices |= (uint64_t) best << (3 * i);
+		decodedAlphas[i] = alphas[best];
+	}
+
+	// Color endpoints span the pixels that stay visible, pulled in by a
+	// sixteenth of the range so a few outliers do not stretch them
+
+	uint32_t lowColor[3] = { 255, 255, 255 };
+	uint32_t highColor[3] = { 0, 0, 0 };
+	int visible = 0;
+
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		if (decodedAlphas[i] == 0) {
+			continue;
+		}
+		visible = 1;
+		for (uint32_t k = 0; k < 3; k++) {
+			uint32_t v = (pixels[i] >> (8 * k)) & 0xff;
+			lowColor[k] = (v < lowColor[k]) ? v : lowColor[k];
+			highColor[k] = (v > highColor[k]) ? v : highColor[k];
+		}
+	}
+
+	for (uint32_t k = 0; k < 3; k++) {
+		if (!visible) {
+			lowColor[k] = highColor[k] = 0;
+		}
+		uint32_t inset = (highColor[k] - lowColor[k]) / 16;
+		lowColor[k] += inset;
+		highColor[k] -= inset;
+	}
+
+	uint32_t c0 = AnimationPackColor565(highColor);
+	uint32_t c1 = AnimationPackColor565(lowColor);
+
+	// Keep c0 > c1, which BC1 decoders read as the four color mode. BC3
+	// always uses four colors, so nothing is lost either way.
+
+	if (c0 < c1) {
+		uint32_t swap = c0;
+		c0 = c1;
+		c1 = swap;
+	}
+
+	uint32_t colors[4][3];
+	AnimationBlockColorPalette(c0, c1, colors);
+
+	uint32_t colorIndices = 0;
+
+	for (uint32_t i = 0; i < 16; i++)
+	{
+		uint32_t best = 0;
+		uint32_t bestError = UINT32_MAX;
+
+		for (uint32_t j = 0; j < 4; j++)
+		{
+			uint32_t decoded = AnimationBlockPixel(colors[j], decodedAlphas[i]);
+			uint32_t error = 0;
+			for (uint32_t k = 0; k < 3; k++) {
+				int d = (int) ((decoded >> (8 * k)) & 0xff) - (int) ((pixels[i] >> (8 * k)) & 0xff);
+				error += d * d;
+			}
+			if (error < bestError) {
+				best = j;
+				bestError = error;
+			}
+		}
+
+		colorIndices |= best << (2 * i);
+	}
+
+	block[0] = (uint8_t) high;
+	block[1] = (uint8_t) low;
+	for (uint32_t i = 0; i < 6; i++) {
+		block[2 + i] = (uint8_t) (alphaIndices >> (8 * i));
+	}
+
+	block[8] = (uint8_t) c0;
+	block[9] = (uint8_t) (c0 >> 8);
+	block[10] = (uint8_t) c1;
+	block[11] = (uint8_t) (c1 >> 8);
+	for (uint32_t i = 0; i < 4; i++) {
+		block[12 + i] = (uint8_t) (colorIndices >> (8 * i));
+	}
+}
+
+uint32_t AnimationCompressBlockPixels(uint8_t* dst, uint32_t dstLength, const uint32_t* src, uint32_t width, uint32_t height)
+{
+	uint32_t length = AnimationBlockCompressedLength(width, height);
+	if (length > dstLength) {
+		return UINT32_MAX;
+	}
+
+	for (uint32_t by = 0; by < height; by += AnimationPixelBlockSize)
+	{
+		for (uint32_t bx = 0; bx < width; bx += AnimationPixelBlockSize)
+		{
+			// Pixels past the edge of the image are transparent
+
+			uint32_t pixels[16] = { 0 };
+			for (uint32_t y = 0; y < 4 && by + y < height; y++) {
+				for (uint32_t x = 0; x < 4 && bx + x < width; x++) {
+					pixels[y * 4 + x] = src[(by + y) * width + bx + x];
+				}
+			}
+
+			AnimationCompressPixelBlock(dst, pixels);
+			dst += AnimationPixelBlockLength;
+		}
+	}
+
+	return length;
+}
+
+void AnimationDecompressPixelBlock(uint32_t* dst, uint32_t stride, uint32_t width, uint32_t height, const uint8_t* block)
+{
+	uint32_t alphas[8];
+	AnimationBlockAlphaPalette(block[0], block[1], alphas);
+
+	uint32_t colors[4][3];
+	AnimationBlockColorPalette(block[8] | (block[9] << 8), block[10] | (block[11] << 8), colors);
+
+	uint64_t alphaIndices = 0;
+	for (int i = 5; i >= 0; i--) {
+		alphaIndices = (alphaIndices << 8) | block[2 + i];
+	}
+
+	uint32_t colorIndices = block[12] | (block[13] << 8) | (block[14] << 16) | ((uint32_t) block[15] << 24);
+
+	for (uint32_t y = 0; y < height; y++) {
+		for (uint32_t x = 0; x < width; x++) {
+			uint32_t i = y * 4 + x;
+			dst[y * stride + x] = AnimationBlockPixel(colors[(colorIndices >> (2 * i)) & 3], alphas[(alphaIndices >> (3 * i)) & 7]);
+		}
+	}
+}
+
+AnimationStatus AnimationDecompressBlockPixelsRect(uint32_t* dst, uint32_t stride, uint32_t width, uint32_t height,
+	const uint8_t* src, uint32_t srcLength)
+{
+	if (srcLength < AnimationBlockCompressedLength(width, height)) {
+		return AnimationStatusTruncated;
+	}
+
+	for (uint32_t by = 0; by < height; by += AnimationPixelBlockSize)
+	{
+		uint32_t rows = (height - by < AnimationPixelBlockSize) ? height - by : AnimationPixelBlockSize;
+
+		for (uint32_t bx = 0; bx < width; bx += AnimationPixelBlockSize) {
+			uint32_t columns = (width - bx < AnimationPixelBlockSize) ? width - bx : AnimationPixelBlockSize;
+			AnimationDecompressPixelBlock(dst + by * stride + bx, stride, columns, rows, src);
+			src += AnimationPixelBlockLength;
+		}
+	}
+
+	return AnimationStatusOK;
+}
+
+void AnimationFindContentRect(const uint32_t* pixels, uint32_t width, uint32_t height, AnimationRect* rect)
+{
+	uint32_t top = height, bottom = 0, left = width, right = 0;
+
+	for (uint32_t y = 0; y < height; y++)
+	{
+		const uint32_t* row = pixels + y * width;
+
+		uint32_t first = 0;
+		while (first < width && row[first] == 0) {
+			first++;
+		}
+
+		if (first == width) {
+			continue;
+		}
+
+		uint32_t last = width - 1;
+		while (row[last] == 0) {
+			last--;
+		}
+
+		if (top == height) {
+			top = y;
+		}
+		bottom = y;
+
+		if (first < left) {
+			left = first;
+		}
+		if (last > right) {
+			right = last;
+		}
+	}
+
+	if (top == height) {
+		rect->x = rect->y = rect->width = rect->height = 0;
+	} else {
+		rect->x = left;
+		rect->y = top;
+		rect->width = right - left + 1;
+		rect->height = bottom - top + 1;
+	}
+}
+
+void AnimationFindChangedRect(const uint32_t* pixels, const uint32_t* previous, uint32_t width, uint32_t height, AnimationRect* rect)
+{
+	uint32_t top = height, bottom = 0, left = width, right = 0;
+
+	for (uint32_t y = 0; y < height; y++)
+	{
+		const uint32_t* row = pixels + y * width;
+		const uint32_t* previousRow = previous + y * width;
+
+		uint32_t first = 0;
+		while (first < width && row[first] == previousRow[first]) {
+			first++;
+		}
+
+		if (first == width) {
+			continue;
+		}
+
+		uint32_t last = width - 1;
+		while (row[last] == previousRow[last]) {
+			last--;
+		}
+
+		if (top == height) {
+			top = y;
+		}
+		bottom = y;
+
+		if (first < left) {
+			left = first;
+		}
+		if (last > right) {
+			right = last;
+		}
+	}
+
+	if (top == height) {
+		rect->x = rect->y = rect->width = rect->height = 0;
+	} else {
+		rect->x = left;
+		rect->y = top;
+		rect->width = right - left + 1;
+		rect->height = bottom - top + 1;
+	}
+}
+
+void AnimationCopyRect(uint32_t* dst, const uint32_t* src, uint32_t stride, const AnimationRect* rect)
+{
+	const uint32_t* row = src + rect->y * stride + rect->x;
+
+	for (uint32_t y = 0; y < rect->height; y++) {
+		memcpy(dst, row, rect->width * sizeof(uint32_t));
+		dst += rect->width;
+		row += stride;
+	}
+}
+
+void AnimationCompositePixelsRect(uint32_t* dst, uint32_t stride, const uint32_t* src, uint32_t srcStride, uint32_t width, uint32_t height)
+{
+	const AnimationBlendFunctions* blend = AnimationGetBlend();
+
+	for (uint32_t y = 0; y < height; y++) {
+		blend->pixels(dst + y * stride, (const uint8_t*) (src + y * srcStride), width);
+	}
+}
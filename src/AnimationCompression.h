@@ -21,8 +21,176 @@
 #define ANIMATIONCOMPRESSION_H
 
 #include <stdint.h>
+#include "AnimationCommon.h"
+
+// Decodes count pixels from src into dst. Long runs are filled with the widest
+// stores the CPU supports (AVX2, SSE2 or NEON), picked once at runtime.
 
 void AnimationDecompressRunLengthEncodedPixels(uint32_t* dst, uint32_t* src, uint32_t count);
+
+// The original one pixel at a time decoder. Output is byte-identical to the
+// function above; it is kept as a reference for verification and benchmarks.
+
+void AnimationDecompressRunLengthEncodedPixelsScalar(uint32_t* dst, uint32_t* src, uint32_t count);
+
+// Returns the name of the fill implementation selected for this CPU
+
+const char* AnimationCompressionImplementationName(void);
+
+// Same as AnimationDecompressRunLengthEncodedPixels but trusts nothing in src.
+// Decodes exactly dstCount pixels from at most srcLength bytes and stops at the
+// first run that would read past src or write past dst. Nothing is written
+// beyond dst + dstCount.
+
+AnimationStatus AnimationDecompressRunLengthEncodedPixelsChecked(uint32_t* dst, uint32_t dstCount, const uint32_t* src, uint32_t srcLength);
+
+// Decodes a cropped frame into a width x height rectangle of a larger buffer.
+// dst points at the top left pixel of the rectangle and stride is the row
+// length of the buffer in pixels. Runs wrap from one row to the next.
+
+AnimationStatus AnimationDecompressRunLengthEncodedPixelsRect(uint32_t* dst, uint32_t stride, uint32_t width, uint32_t height,
+	const uint32_t* src, uint32_t srcLength);
+
 uint32_t AnimationCompressRunLengthEncodedPixels(uint32_t* dst, uint32_t* src, unsigned int count);
 
+// Banded run-length frames ('rleb') split the image into bands of rows so
+// the bands can be decoded in parallel. The data starts with the band height
+// and the number of bands, followed by the byte offset of every band's runs
+// from the start of the data. Each band is an 'rlen' stream of its own that
+// covers exactly its rows, the last band may have fewer. Compression returns
+// the length in bytes, or UINT32_MAX when the result does not fit in
+// dstLength bytes.
+
+uint32_t AnimationCompressBandedRunLengthPixels(uint32_t* dst, uint32_t dstLength, const uint32_t* src, uint32_t width, uint32_t height,
+	uint32_t bandHeight);
+
+// Checks the band table of a width x height image and returns the number of
+// bands. Has to succeed before single bands are decoded.
+AnimationStatus AnimationBandedRunLengthPixelsGetBandCount(const uint32_t* src, uint32_t srcLength, uint32_t height, uint32_t* bandCount);
+
+// Decodes one band. dst points at the top left pixel of the whole image, the
+// band is written to its own rows only, so bands can be decoded at the same
+// time into the same buffer.
+AnimationStatus AnimationDecompressBandedRunLengthPixelsBand(uint32_t* dst, uint32_t stride, uint32_t width, uint32_t height,
+	const uint32_t* src, uint32_t srcLength, uint32_t band);
+
+// Decodes all bands one after the other
+AnimationStatus AnimationDecompressBandedRunLengthPixelsRect(uint32_t* dst, uint32_t stride, uint32_t width, uint32_t height,
+	const uint32_t* src, uint32_t srcLength);
+
+// Delta frames ('delt') store only what changed since the previous frame as
+// (skip, n, color) triples: leave skip pixels alone, then write n pixels of
+// color. Compression returns the length in bytes, or UINT32_MAX when the
+// result does not fit in dstLength bytes. Decompression applies the triples
+// in place on top of the previous frame.
+
+uint32_t AnimationCompressDeltaPixels(uint32_t* dst, uint32_t dstLength, const uint32_t* src, const uint32_t* previous, uint32_t count);
+AnimationStatus AnimationDecompressDeltaPixelsChecked(uint32_t* dst, uint32_t dstCount, const uint32_t* src, uint32_t srcLength);
+AnimationStatus AnimationDecompressDeltaPixelsRect(uint32_t* dst, uint32_t stride, uint32_t width, uint32_t height,
+	const uint32_t* src, uint32_t srcLength);
+
+// The smallest rectangle of a width x height image that a delta writes to,
+// found by walking the triples without decoding them. Empty if the delta
+// writes nothing; triples past the end of the image are ignored.
+void AnimationDeltaPixelsBounds(const uint32_t* src, uint32_t srcLength, uint32_t width, uint32_t height, AnimationRect* bounds);
+
+// Compact run-length frames ('rle2') are a byte stream. The first byte is the
+// pixel mode, then follow operations that each start with a varint (LEB128)
+// header h covering (h >> 1) + 1 pixels. If the low bit of h is set it is a
+// run and a single pixel follows, otherwise it is a literal span and that
+// many pixels follow. Pixels are stored little-endian in 4 or 2 bytes. The
+// 16-bit modes are lossy: RGB565 is opaque only, RGBA4444 keeps premultiplied
+// alpha. Decoders expand them back to AnimationPixel.
+
+typedef enum {
+	AnimationPixelModeRGBA8888 = 0,
+	AnimationPixelModeRGB565 = 1,
+	AnimationPixelModeRGBA4444 = 2
+} AnimationPixelMode;
+
+// Returns the length in bytes, or UINT32_MAX when the result does not fit
+// in dstLength bytes. Pixels are stored as AnimationQuantizePixels would
+// round them.
+
+uint32_t AnimationCompressCompactRunLengthPixels(uint8_t* dst, uint32_t dstLength, const uint32_t* src, uint32_t count,
+	AnimationPixelMode mode);
+AnimationStatus AnimationDecompressCompactRunLengthPixelsChecked(uint32_t* dst, uint32_t dstCount, const uint8_t* src, uint32_t srcLength);
+AnimationStatus AnimationDecompressCompactRunLengthPixelsRect(uint32_t* dst, uint32_t stride, uint32_t width, uint32_t height,
+	const uint8_t* src, uint32_t srcLength);
+
+// Rounds pixels in place to the nearest value mode can store, so an encoder
+// can work on exactly what the decoder will produce. Returns 0 and leaves
+// the pixels alone if mode can not store them at all, which is the case for
+// RGB565 and pixels that are not fully opaque.
+
+int AnimationQuantizePixels(uint32_t* pixels, uint32_t count, AnimationPixelMode mode);
+
+// Palette frames ('pal8' and 'pal4') store an index into the container's
+// palette per pixel, one byte each or two pixels per byte with the first in
+// the low nibble. Rows are packed without padding. Compression needs every
+// pixel to be in the palette and returns UINT32_MAX if one is not or if the
+// result does not fit. The decoder expects a palette of 256 entries, unused
+// ones zero, so any index is safe to look up.
+
+uint32_t AnimationCompressPalettePixels(uint8_t* dst, uint32_t dstLength, const uint32_t* src, uint32_t count,
+	const uint32_t* palette, uint32_t paletteCount, uint32_t bits);
+AnimationStatus AnimationDecompressPalettePixelsRect(uint32_t* dst, uint32_t stride, uint32_t width, uint32_t height,
+	const uint8_t* src, uint32_t srcLength, const uint32_t* palette, uint32_t bits);
+
+// Block compressed frames ('dxt5') use the BC3 (DXT5) block layout, so a
+// GPU that supports it can take the blocks as they are. A block is 8 bytes
+// of alpha, two endpoints and a 3-bit index per pixel, then 8 bytes of
+// color, two RGB565 endpoints and a 2-bit index per pixel. Every block
+// decodes on its own.
+//
+// The encoder is a fast bounding box fit, not an exhaustive search. The
+// decoder here is the reference for tools and for platforms without such a
+// GPU; it clamps color to alpha so its output is valid premultiplied alpha.
+// Hardware may round interpolated values differently by one.
+
+uint32_t AnimationBlockCompressedLength(uint32_t width, uint32_t height);
+
+// Returns the length in bytes, or UINT32_MAX when the result does not fit
+// in dstLength bytes
+uint32_t AnimationCompressBlockPixels(uint8_t* dst, uint32_t dstLength, const uint32_t* src, uint32_t width, uint32_t height);
+
+// Decodes one block into the top left width x height pixels of dst, at most
+// 4x4, so edge blocks can be cut off at the edge of the image
+void AnimationDecompressPixelBlock(uint32_t* dst, uint32_t stride, uint32_t width, uint32_t height, const uint8_t* block);
+
+AnimationStatus AnimationDecompressBlockPixelsRect(uint32_t* dst, uint32_t stride, uint32_t width, uint32_t height,
+	const uint8_t* src, uint32_t srcLength);
+
+// Compositing decoders draw a frame over what dst already holds instead of
+// replacing it, with premultiplied source over: every channel becomes
+// src + dst * (255 - alpha) / 255. Transparent runs are skipped and opaque
+// runs filled like the plain decoders do, only the runs and literal pixels
+// in between are blended, with SSE2 or NEON where available. Layers can so
+// be flattened while they are decoded, without a blend of the whole frame
+// afterwards. Input is checked the same way, but pixels before a bad run
+// have already been blended.
+
+AnimationStatus AnimationCompositeRunLengthEncodedPixelsRect(uint32_t* dst, uint32_t stride, uint32_t width, uint32_t height,
+	const uint32_t* src, uint32_t srcLength);
+AnimationStatus AnimationCompositeBandedRunLengthPixelsBand(uint32_t* dst, uint32_t stride, uint32_t width, uint32_t height,
+	const uint32_t* src, uint32_t srcLength, uint32_t band);
+AnimationStatus AnimationCompositeBandedRunLengthPixelsRect(uint32_t* dst, uint32_t stride, uint32_t width, uint32_t height,
+	const uint32_t* src, uint32_t srcLength);
+AnimationStatus AnimationCompositeCompactRunLengthPixelsRect(uint32_t* dst, uint32_t stride, uint32_t width, uint32_t height,
+	const uint8_t* src, uint32_t srcLength);
+
+// Blends a width x height rectangle of src, which has srcStride pixels per
+// row, over dst the same way, for pixels that are already decoded
+void AnimationCompositePixelsRect(uint32_t* dst, uint32_t stride, const uint32_t* src, uint32_t srcStride, uint32_t width, uint32_t height);
+
+// Encoder helpers for cropped frames. The content rectangle is the bounding
+// box of all non-transparent pixels, the changed rectangle the bounding box
+// of all pixels that differ from previous. Both are empty (0x0) if there are
+// no such pixels. AnimationCopyRect copies a rectangle out of a buffer with
+// the given stride into a tightly packed one.
+
+void AnimationFindContentRect(const uint32_t* pixels, uint32_t width, uint32_t height, AnimationRect* rect);
+void AnimationFindChangedRect(const uint32_t* pixels, const uint32_t* previous, uint32_t width, uint32_t height, AnimationRect* rect);
+void AnimationCopyRect(uint32_t* dst, const uint32_t* src, uint32_t stride, const AnimationRect* rect);
+
 #endif
\ No newline at end of file
@@ -0,0 +1,431 @@
+/*
+ * (C) Copyright 2010, Stefan Arentz, Arentz Consulting Inc.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "AnimationContainer.h"
+
+#define ANIMATION_CONTAINER_MAGIC 'anim'
+
+// Frames larger than this are rejected so width * height * 4 never overflows
+#define ANIMATION_CONTAINER_MAX_PIXELS (UINT32_MAX / sizeof(AnimationPixel))
+
+static AnimationStatus AnimationContainerBuildIndex(AnimationContainer* container)
+{
+	uint32_t frameCount = container->header->frameCount;
+
+	AnimationContainerIndexEntry* index = (AnimationContainerIndexEntry*) malloc((frameCount + 1) * sizeof(AnimationContainerIndexEntry));
+	if (index == NULL) {
+		return AnimationStatusOverflow;
+	}
+
+	size_t offset = 0;
+
+	for (uint32_t i = 0; i < frameCount; i++)
+	{
+		const AnimationContainerImageHeader* header;
+		const void* data;
+
+		AnimationStatus status = AnimationContainerNextImage(container, &offset, &header, &data);
+		if (status != AnimationStatusOK) {
+			free(index);
+			return status;
+		}
+
+		index[i].offset = (uint32_t) ((const uint8_t*) header - container->bytes);
+		index[i].length = sizeof(AnimationContainerImageHeader) + header->dataLength;
+	}
+
+	container->index = index;
+	container->ownedIndex = index;
+
+	return AnimationStatusOK;
+}
+
+static AnimationStatus AnimationContainerOpenHeader(AnimationContainer* container, const void* bytes, size_t length, size_t offset)
+{
+	container->bytes = (const uint8_t*) bytes;
+	container->length = length;
+	container->header = NULL;
+	container->index = NULL;
+	container->ownedIndex = NULL;
+	container->palette = NULL;
+	container->paletteCount = 0;
+	container->mapping = NULL;
+	container->ownedMapping = NULL;
+	container->pageSize = 0;
+
+	if (bytes == NULL || offset > length || length - offset < sizeof(AnimationContainerGlobalHeader)) {
+		return AnimationStatusTruncated;
+	}
+
+	if ((offset % 4) != 0) {
+		return AnimationStatusInvalidHeader;
+	}
+
+	const AnimationContainerGlobalHeader* header = (const AnimationContainerGlobalHeader*) (container->bytes + offset);
+
+	if (header->magic != ANIMATION_CONTAINER_MAGIC) {
+		return AnimationStatusInvalidHeader;
+	}
+
+	if (header->version < 1 || header->version > 3) {
+		return AnimationStatusUnsupportedFormat;
+	}
+
+	// Version 1 images follow their header, so they can not be shared
+
+	if (header->version == 1 && offset != 0) {
+		return AnimationStatusUnsupportedFormat;
+	}
+
+	if (header->width == 0 || header->height == 0 || header->width > ANIMATION_CONTAINER_MAX_PIXELS / header->height) {
+		return AnimationStatusInvalidHeader;
+	}
+
+	// Every frame needs at least an image header or, from version 2 on, an
+	// index entry; indexed frames may share their image. A larger count can
+	// only come from a corrupt or truncated file.
+
+	size_t frameSize = sizeof(AnimationContainerImageHeader);
+	if (header->version >= 2) {
+		frameSize = sizeof(AnimationContainerIndexEntry);
+	}
+
+	size_t indexOffset = offset + sizeof(AnimationContainerGlobalHeader);
+
+	if (header->version >= 3)
+	{
+		if (length - indexOffset < sizeof(AnimationContainerPaletteHeader)) {
+			return AnimationStatusTruncated;
+		}
+
+		const AnimationContainerPaletteHeader* palette = (const AnimationContainerPaletteHeader*) (container->bytes + indexOffset);
+		if (palette->count > AnimationContainerMaxPaletteCount) {
+			return AnimationStatusInvalidHeader;
+		}
+
+		indexOffset += sizeof(AnimationContainerPaletteHeader);
+		if (length - indexOffset < palette->count * sizeof(AnimationPixel)) {
+			return AnimationStatusTruncated;
+		}
+
+		container->palette = (const AnimationPixel*) (container->bytes + indexOffset);
+		container->paletteCount = palette->count;
+
+		indexOffset += palette->count * sizeof(AnimationPixel);
+	}
+
+	if (header->frameCount > (length - indexOffset) / frameSize) {
+		return AnimationStatusTruncated;
+	}
+
+	container->header = header;
+
+	if (header->version == 1) {
+		return AnimationContainerBuildIndex(container);
+	}
+
+	container->index = (const AnimationContainerIndexEntry*) (container->bytes + indexOffset);
+
+	return AnimationStatusOK;
+}
+
+AnimationStatus AnimationContainerOpen(AnimationContainer* container, const void* bytes, size_t length)
+{
+	return AnimationContainerOpenHeader(container, bytes, length, 0);
+}
+
+AnimationStatus AnimationContainerOpenAt(AnimationContainer* container, const void* bytes, size_t length, size_t offset)
+{
+	return AnimationContainerOpenHeader(container, bytes, length, offset);
+}
+
+AnimationStatus AnimationContainerOpenFile(AnimationContainer* container, const char* path)
+{
+	container->mapping = NULL;
+	container->ownedMapping = NULL;
+	container->ownedIndex = NULL;
+
+	int fd = open(path, O_RDONLY);
+	if (fd == -1) {
+		return AnimationStatusIOError;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) == -1 || st.st_size <= 0) {
+		close(fd);
+		return AnimationStatusIOError;
+	}
+
+	size_t length = (size_t) st.st_size;
+
+	void* mapping = mmap(NULL, length, PROT_READ, MAP_PRIVATE, fd, 0);
+	close(fd);
+
+	if (mapping == MAP_FAILED) {
+		return AnimationStatusIOError;
+	}
+
+	// Playback reads frames front to back, so let the kernel read ahead
+
+	madvise(mapping, length, MADV_SEQUENTIAL);
+
+	AnimationStatus status = AnimationContainerOpen(container, mapping, length);
+	if (status != AnimationStatusOK) {
+		munmap(mapping, length);
+		return status;
+	}
+
+	container->mapping = mapping;
+	container->ownedMapping = mapping;
+	container->pageSize = (size_t) sysconf(_SC_PAGESIZE);
+
+	// Building the index of a version 1 container touched every image header.
+	// None of those pages are needed until their frames are played.
+
+	if (container->ownedIndex != NULL) {
+		madvise(mapping, length, MADV_DONTNEED);
+	}
+
+	return AnimationStatusOK;
+}
+
+void AnimationContainerClose(AnimationContainer* container)
+{
+	if (container->ownedIndex != NULL) {
+		free(container->ownedIndex);
+		container->ownedIndex = NULL;
+	}
+	if (container->ownedMapping != NULL) {
+		munmap(container->ownedMapping, container->length);
+		container->ownedMapping = NULL;
+	}
+	container->mapping = NULL;
+	container->index = NULL;
+	container->header = NULL;
+}
+
+static void AnimationContainerAdviseImage(const AnimationContainer* container, uint32_t frame, int advice)
+{
+	if (container->mapping == NULL || frame >= container->header->frameCount) {
+		return;
+	}
+
+	const AnimationContainerIndexEntry* entry = &container->index[frame];
+
+	size_t start = entry->offset;
+	size_t end = start + entry->length;
+	if (start >= container->length) {
+		return;
+	}
+	if (end > container->length) {
+		end = container->length;
+	}
+
+	// Read-ahead covers every page the frame touches. Discarding only covers
+	// pages that belong to this frame alone, so a neighbour that shares the
+	// first or last page is not read back in again.
+
+	size_t mask = container->pageSize - 1;
+
+	if (advice == MADV_DONTNEED) {
+		start = (start + mask) & ~mask;
+		end = end & ~mask;
+	} else {
+		start = start & ~mask;
+		end = (end + mask) & ~mask;
+		if (end > container->length) {
+			end = container->length;
+		}
+	}
+
+	if (start < end) {
+		madvise((uint8_t*) container->mapping + start, end - start, advice);
+	}
+}
+
+void AnimationContainerWillNeedImage(const AnimationContainer* container, uint32_t frame)
+{
+	AnimationContainerAdviseImage(container, frame, MADV_WILLNEED);
+}
+
+void AnimationContainerDiscardImage(const AnimationContainer* container, uint32_t frame)
+{
+	AnimationContainerAdviseImage(container, frame, MADV_DONTNEED);
+}
+
+static AnimationStatus AnimationContainerValidateImage(const AnimationContainer* container, const AnimationContainerImageHeader* header)
+{
+	const AnimationContainerGlobalHeader* globalHeader = container->header;
+
+	if (header->width > globalHeader->width || header->xoffset > globalHeader->width - header->width) {
+		return AnimationStatusInvalidHeader;
+	}
+
+	if (header->height > globalHeader->height || header->yoffset > globalHeader->height - header->height) {
+		return AnimationStatusInvalidHeader;
+	}
+
+	switch (header->format)
+	{
+		case AnimationContainerImageFormatPNG:
+		case AnimationContainerImageFormatRunLengthCompressedPixels:
+		case AnimationContainerImageFormatDeltaPixels:
+		case AnimationContainerImageFormatCompactRunLengthPixels:
+		case AnimationContainerImageFormatBandedRunLengthPixels:
+			break;
+
+		case AnimationContainerImageFormatUncompressedPixels:
+			if (header->dataLength != header->width * header->height * sizeof(AnimationPixel)) {
+				return AnimationStatusInvalidHeader;
+			}
+			break;
+
+		case AnimationContainerImageFormatBlockCompressedPixels:
+			if (header->xoffset % AnimationPixelBlockSize != 0 || header->yoffset % AnimationPixelBlockSize != 0) {
+				return AnimationStatusInvalidHeader;
+			}
+			if (header->dataLength != (uint64_t) ((header->width + 3) / 4) * ((header->height + 3) / 4) * AnimationPixelBlockLength) {
+				return AnimationStatusInvalidHeader;
+			}
+			break;
+
+		// Palette frames are only valid with a palette to index into
+
+		case AnimationContainerImageFormatPalette8Pixels:
+			if (container->palette == NULL || header->dataLength != header->width * header->height) {
+				return AnimationStatusInvalidHeader;
+			}
+			break;
+
+		case AnimationContainerImageFormatPalette4Pixels:
+			if (container->palette == NULL || header->dataLength != (header->width * header->height + 1) / 2) {
+				return AnimationStatusInvalidHeader;
+			}
+			break;
+
+		default:
+			return AnimationStatusUnsupportedFormat;
+	}
+
+	return AnimationStatusOK;
+}
+
+AnimationStatus AnimationContainerNextImage(const AnimationContainer* container, size_t* offset,
+	const AnimationContainerImageHeader** header, const void** data)
+{
+	size_t position = (*offset == 0) ? sizeof(AnimationContainerGlobalHeader) : *offset;
+
+	if (position > container->length || container->length - position < sizeof(AnimationContainerImageHeader)) {
+		return AnimationStatusTruncated;
+	}
+
+	const AnimationContainerImageHeader* imageHeader = (const AnimationContainerImageHeader*) (container->bytes + position);
+	position += sizeof(AnimationContainerImageHeader);
+
+	if (imageHeader->dataLength > container->length - position) {
+		return AnimationStatusTruncated;
+	}
+
+	AnimationStatus status = AnimationContainerValidateImage(container, imageHeader);
+	if (status != AnimationStatusOK) {
+		return status;
+	}
+
+	*header = imageHeader;
+	*data = container->bytes + position;
+
+	position += imageHeader->dataLength;
+	if ((imageHeader->dataLength % 4) != 0) {
+		position += 4 - (imageHeader->dataLength % 4);
+	}
+
+	*offset = position;
+
+	return AnimationStatusOK;
+}
+
+AnimationStatus AnimationContainerGetImage(const AnimationContainer* container, uint32_t frame,
+	const AnimationContainerImageHeader** header, const void** data)
+{
+	if (container->index == NULL || frame >= container->header->frameCount) {
+		return AnimationStatusOverflow;
+	}
+
+	const AnimationContainerIndexEntry* entry = &container->index[frame];
+
+	// Headers are read in place, so they have to be aligned and in bounds
+
+	if ((entry->offset % 4) != 0 || entry->offset < sizeof(AnimationContainerGlobalHeader)) {
+		return AnimationStatusInvalidHeader;
+	}
+
+	if (entry->offset > container->length || container->length - entry->offset < sizeof(AnimationContainerImageHeader)) {
+		return AnimationStatusTruncated;
+	}
+
+	const AnimationContainerImageHeader* imageHeader = (const AnimationContainerImageHeader*) (container->bytes + entry->offset);
+
+	if (imageHeader->dataLength > container->length - entry->offset - sizeof(AnimationContainerImageHeader)) {
+		return AnimationStatusTruncated;
+	}
+
+	if (entry->length != sizeof(AnimationContainerImageHeader) + (size_t) imageHeader->dataLength) {
+		return AnimationStatusInvalidHeader;
+	}
+
+	AnimationStatus status = AnimationContainerValidateImage(container, imageHeader);
+	if (status != AnimationStatusOK) {
+		return status;
+	}
+
+	*header = imageHeader;
+	*data = imageHeader + 1;
+
+	return AnimationStatusOK;
+}
+
+AnimationStatus AnimationContainerFindKeyframe(const AnimationContainer* container, uint32_t frame, uint32_t* keyframe)
+{
+	for (uint32_t i = frame; ; i--)
+	{
+		const AnimationContainerImageHeader* header;
+		const void* data;
+
+		AnimationStatus status = AnimationContainerGetImage(container, i, &header, &data);
+		if (status != AnimationStatusOK) {
+			return status;
+		}
+
+		if (header->format != AnimationContainerImageFormatDeltaPixels) {
+			*keyframe = i;
+			return AnimationStatusOK;
+		}
+
+		// The first frame has nothing to be a delta of
+
+		if (i == 0) {
+			return AnimationStatusInvalidHeader;
+		}
+	}
+}
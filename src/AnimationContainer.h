@@ -0,0 +1,89 @@
+/*
+ * (C) Copyright 2010, Stefan Arentz, Arentz Consulting Inc.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANIMATIONCONTAINER_H
+#define ANIMATIONCONTAINER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "AnimationCommon.h"
+
+// A read-only view on the bytes of an animation container. Nothing in the
+// container is trusted: every header is checked against the length of the
+// data before it is handed out.
+//
+// Version 2 containers carry a frame index, so opening one and finding a
+// frame are constant time. For version 1 containers the index is built by
+// walking all images once when the container is opened. Version 3 adds a
+// palette, shared by all frames, in front of the index.
+
+typedef struct AnimationContainer {
+	const uint8_t* bytes;
+	size_t length;
+	const AnimationContainerGlobalHeader* header;
+	const AnimationContainerIndexEntry* index;
+	AnimationContainerIndexEntry* ownedIndex;
+	const AnimationPixel* palette;
+	uint32_t paletteCount;
+	void* mapping;			// Mapped file the bytes live in, for paging hints
+	void* ownedMapping;		// Unmapped on close, NULL if the mapping is borrowed
+	size_t pageSize;
+} AnimationContainer;
+
+AnimationStatus AnimationContainerOpen(AnimationContainer* container, const void* bytes, size_t length);
+
+// Opens a container whose global header starts at offset inside a larger
+// block of bytes, like an archive. Image offsets in its index are relative to
+// bytes, so the containers in one block can share images. Version 2 and up.
+
+AnimationStatus AnimationContainerOpenAt(AnimationContainer* container, const void* bytes, size_t length, size_t offset);
+
+// Maps the file read-only instead of reading it. Only the pages of frames
+// that are decoded are ever read, so opening is cheap no matter how large
+// the file is.
+
+AnimationStatus AnimationContainerOpenFile(AnimationContainer* container, const char* path);
+
+void AnimationContainerClose(AnimationContainer* container);
+
+// Paging hints for mapped containers, they do nothing for containers opened
+// on memory. WillNeed starts read-ahead of a frame that is about to be
+// decoded. Discard gives the pages of a frame that has been played back to
+// the OS; they are read from the file again if the frame is needed later.
+
+void AnimationContainerWillNeedImage(const AnimationContainer* container, uint32_t frame);
+void AnimationContainerDiscardImage(const AnimationContainer* container, uint32_t frame);
+
+// Finds a frame through the index and validates its header
+AnimationStatus AnimationContainerGetImage(const AnimationContainer* container, uint32_t frame,
+	const AnimationContainerImageHeader** header, const void** data);
+
+// Finds the last frame at or before frame that is not a delta frame. Decoding
+// has to start there when the previous frame is not at hand.
+
+AnimationStatus AnimationContainerFindKeyframe(const AnimationContainer* container, uint32_t frame, uint32_t* keyframe);
+
+// Walks the images of a version 1 container in order. Start with *offset set
+// to 0 and call once per frame; *offset is advanced past the image and its
+// padding on success.
+
+AnimationStatus AnimationContainerNextImage(const AnimationContainer* container, size_t* offset,
+	const AnimationContainerImageHeader** header, const void** data);
+
+#endif
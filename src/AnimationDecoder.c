@@ -0,0 +1,433 @@
+/*
+ * (C) Copyright 2010, Stefan Arentz, Arentz Consulting Inc.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <string.h>
+#include "AnimationDecoder.h"
+#include "AnimationCompression.h"
+
+void AnimationCanvasInit(AnimationCanvas* canvas, AnimationPixel* pixels, uint32_t width, uint32_t height)
+{
+	canvas->pixels = pixels;
+	canvas->width = width;
+	canvas->height = height;
+	AnimationCanvasInvalidate(canvas);
+}
+
+void AnimationCanvasInvalidate(AnimationCanvas* canvas)
+{
+	canvas->container = NULL;
+	canvas->frame = AnimationFrameNone;
+	canvas->image = NULL;
+
+	// Nothing is known about the pixels anymore, so all of them may need clearing
+
+	canvas->content.x = 0;
+	canvas->content.y = 0;
+	canvas->content.width = canvas->width;
+	canvas->content.height = canvas->height;
+	canvas->dirty = canvas->content;
+}
+
+void AnimationRectUnion(AnimationRect* rect, const AnimationRect* other)
+{
+	if (other->width == 0 || other->height == 0) {
+		return;
+	}
+
+	if (rect->width == 0 || rect->height == 0) {
+		*rect = *other;
+		return;
+	}
+
+	uint32_t right = rect->x + rect->width;
+	uint32_t bottom = rect->y + rect->height;
+
+	if (other->x + other->width > right) {
+		right = other->x + other->width;
+	}
+	if (other->y + other->height > bottom) {
+		bottom = other->y + other->height;
+	}
+	if (other->x < rect->x) {
+		rect->x = other->x;
+	}
+	if (other->y < rect->y) {
+		rect->y = other->y;
+	}
+
+	rect->width = right - rect->x;
+	rect->height = bottom - rect->y;
+}
+
+// Clears the pixels of rect that are not covered by keep
+
+static void AnimationCanvasClearOutside(AnimationCanvas* canvas, const AnimationRect* rect, const AnimationRect* keep)
+{
+	uint32_t keepRight = keep->x + keep->width;
+	uint32_t keepBottom = keep->y + keep->height;
+	uint32_t right = rect->x + rect->width;
+
+	for (uint32_t y = rect->y; y < rect->y + rect->height; y++)
+	{
+		AnimationPixel* row = canvas->pixels + y * canvas->width;
+
+		if (keep->width == 0 || y < keep->y || y >= keepBottom) {
+			memset(row + rect->x, 0, rect->width * sizeof(AnimationPixel));
+			continue;
+		}
+
+		if (rect->x < keep->x) {
+			uint32_t end = (keep->x < right) ? keep->x : right;
+			memset(row + rect->x, 0, (end - rect->x) * sizeof(AnimationPixel));
+		}
+
+		if (right > keepRight) {
+			uint32_t start = (keepRight > rect->x) ? keepRight : rect->x;
+			memset(row + start, 0, (right - start) * sizeof(AnimationPixel));
+		}
+	}
+}
+
+void AnimationCanvasCopyRect(AnimationCanvas* canvas, const AnimationPixel* pixels, uint32_t stride, const AnimationRect* rect)
+{
+	canvas->dirty = canvas->content;
+	AnimationRectUnion(&canvas->dirty, rect);
+
+	AnimationCanvasClearOutside(canvas, &canvas->content, rect);
+	canvas->content = *rect;
+
+	for (uint32_t y = rect->y; y < rect->y + rect->height; y++) {
+		memcpy(canvas->pixels + y * canvas->width + rect->x, pixels + y * stride + rect->x, rect->width * sizeof(AnimationPixel));
+	}
+}
+
+void AnimationDecoderInit(AnimationDecoder* decoder, const AnimationContainer* container,
+	AnimationDecodeImageFunction decodeImage, void* context)
+{
+	decoder->container = container;
+	decoder->decodeImage = decodeImage;
+	decoder->context = context;
+	decoder->threadPool = NULL;
+
+	memset(decoder->palette, 0, sizeof(decoder->palette));
+	if (container->palette != NULL) {
+		memcpy(decoder->palette, container->palette, container->paletteCount * sizeof(AnimationPixel));
+	}
+}
+
+void AnimationDecoderSetThreadPool(AnimationDecoder* decoder, AnimationThreadPool* pool)
+{
+	decoder->threadPool = pool;
+}
+
+// Below this many pixels waking the pool costs more than the decode saves
+#define AnimationDecoderParallelPixels (256 * 256)
+
+typedef struct AnimationDecoderBandJob {
+	AnimationPixel* origin;
+	uint32_t stride;
+	const AnimationContainerImageHeader* header;
+	const uint32_t* data;
+	int composite;
+	AnimationStatus status;
+} AnimationDecoderBandJob;
+
+static void AnimationDecoderDecodeBand(void* context, uint32_t band)
+{
+	AnimationDecoderBandJob* job = (AnimationDecoderBandJob*) context;
+
+	AnimationStatus status;
+	if (job->composite) {
+		status = AnimationCompositeBandedRunLengthPixelsBand(job->origin, job->stride, job->header->width,
+			job->header->height, job->data, job->header->dataLength, band);
+	} else {
+		status = AnimationDecompressBandedRunLengthPixelsBand(job->origin, job->stride, job->header->width,
+			job->header->height, job->data, job->header->dataLength, band);
+	}
+	if (status != AnimationStatusOK) {
+		__atomic_store_n(&job->status, status, __ATOMIC_RELAXED);
+	}
+}
+
+static AnimationStatus AnimationDecoderDrawBands(const AnimationDecoder* decoder, const AnimationContainerImageHeader* header,
+	const uint32_t* data, AnimationPixel* origin, uint32_t stride, int composite)
+{
+	if (decoder->threadPool == NULL || header->width * header->height < AnimationDecoderParallelPixels) {
+		if (composite) {
+			return AnimationCompositeBandedRunLengthPixelsRect(origin, stride, header->width, header->height, data, header->dataLength);
+		}
+		return AnimationDecompressBandedRunLengthPixelsRect(origin, stride, header->width, header->height, data, header->dataLength);
+	}
+
+	uint32_t bandCount;
+	AnimationStatus status = AnimationBandedRunLengthPixelsGetBandCount(data, header->dataLength, header->height, &bandCount);
+	if (status != AnimationStatusOK) {
+		return status;
+	}
+
+	AnimationDecoderBandJob job = { origin, stride, header, data, composite, AnimationStatusOK };
+	AnimationThreadPoolRun(decoder->threadPool, bandCount, AnimationDecoderDecodeBand, &job);
+
+	return job.status;
+}
+
+// Checks that an image fits a width x height frame
+
+static AnimationStatus AnimationDecoderCheckImageRect(const AnimationContainerImageHeader* header, uint32_t width, uint32_t height)
+{
+	if (header->width > width || header->xoffset > width - header->width) {
+		return AnimationStatusOverflow;
+	}
+
+	if (header->height > height || header->yoffset > height - header->height) {
+		return AnimationStatusOverflow;
+	}
+
+	return AnimationStatusOK;
+}
+
+static AnimationStatus AnimationDecoderDrawImage(const AnimationDecoder* decoder, const AnimationContainerImageHeader* header,
+	const void* data, AnimationCanvas* canvas)
+{
+	AnimationStatus status = AnimationDecoderCheckImageRect(header, canvas->width, canvas->height);
+	if (status != AnimationStatusOK) {
+		return status;
+	}
+
+	AnimationRect rect = { header->xoffset, header->yoffset, header->width, header->height };
+	AnimationPixel* origin = canvas->pixels + rect.y * canvas->width + rect.x;
+
+	// A delta adds to what is there. Anything else replaces the whole frame, so
+	// whatever the previous frame left outside this frame's rectangle goes.
+
+	if (header->format == AnimationContainerImageFormatDeltaPixels) {
+		AnimationRectUnion(&canvas->content, &rect);
+	} else {
+		AnimationRectUnion(&canvas->dirty, &canvas->content);
+		AnimationRectUnion(&canvas->dirty, &rect);
+		AnimationCanvasClearOutside(canvas, &canvas->content, &rect);
+		canvas->content = rect;
+	}
+
+	switch (header->format)
+	{
+		case AnimationContainerImageFormatUncompressedPixels:
+		{
+			const AnimationPixel* src = (const AnimationPixel*) data;
+			for (uint32_t y = 0; y < rect.height; y++) {
+				memcpy(origin + y * canvas->width, src + y * rect.width, rect.width * sizeof(AnimationPixel));
+			}
+			return AnimationStatusOK;
+		}
+
+		case AnimationContainerImageFormatRunLengthCompressedPixels:
+		{
+			return AnimationDecompressRunLengthEncodedPixelsRect(origin, canvas->width, rect.width, rect.height,
+				(const uint32_t*) data, header->dataLength);
+		}
+
+		case AnimationContainerImageFormatDeltaPixels:
+		{
+			// Only the pixels the triples write change
+
+			AnimationRect changed;
+			AnimationDeltaPixelsBounds((const uint32_t*) data, header->dataLength, rect.width, rect.height, &changed);
+			changed.x += rect.x;
+			changed.y += rect.y;
+			AnimationRectUnion(&canvas->dirty, &changed);
+
+			return AnimationDecompressDeltaPixelsRect(origin, canvas->width, rect.width, rect.height,
+				(const uint32_t*) data, header->dataLength);
+		}
+
+		case AnimationContainerImageFormatBandedRunLengthPixels:
+		{
+			return AnimationDecoderDrawBands(decoder, header, (const uint32_t*) data, origin, canvas->width, 0);
+		}
+
+		case AnimationContainerImageFormatBlockCompressedPixels:
+		{
+			return AnimationDecompressBlockPixelsRect(origin, canvas->width, rect.width, rect.height,
+				(const uint8_t*) data, header->dataLength);
+		}
+
+		case AnimationContainerImageFormatCompactRunLengthPixels:
+		{
+			return AnimationDecompressCompactRunLengthPixelsRect(origin, canvas->width, rect.width, rect.height,
+				(const uint8_t*) data, header->dataLength);
+		}
+
+		case AnimationContainerImageFormatPalette8Pixels:
+		case AnimationContainerImageFormatPalette4Pixels:
+		{
+			return AnimationDecompressPalettePixelsRect(origin, canvas->width, rect.width, rect.height,
+				(const uint8_t*) data, header->dataLength, decoder->palette,
+				(header->format == AnimationContainerImageFormatPalette8Pixels) ? 8 : 4);
+		}
+
+		default:
+		{
+			if (decoder->decodeImage == NULL) {
+				return AnimationStatusUnsupportedFormat;
+			}
+			return decoder->decodeImage(decoder->context, header, data, canvas);
+		}
+	}
+}
+
+static AnimationStatus AnimationDecoderDecodeImage(const AnimationDecoder* decoder, uint32_t frame, AnimationCanvas* canvas)
+{
+	const AnimationContainerImageHeader* header;
+	const void* data;
+
+	AnimationStatus status = AnimationContainerGetImage(decoder->container, frame, &header, &data);
+	if (status != AnimationStatusOK) {
+		return status;
+	}
+
+	// Frames can share an image, within a container and between the
+	// containers of an archive. A canvas that already shows this very image
+	// needs no work, unless it is a delta that builds on what was there.
+
+	if (header == canvas->image && header->format != AnimationContainerImageFormatDeltaPixels) {
+		return AnimationStatusOK;
+	}
+
+	status = AnimationDecoderDrawImage(decoder, header, data, canvas);
+	canvas->image = (status == AnimationStatusOK) ? header : NULL;
+
+	return status;
+}
+
+AnimationStatus AnimationDecoderDrawFrame(const AnimationDecoder* decoder, uint32_t frame, AnimationCanvas* canvas)
+{
+	AnimationRect unchanged = { 0, 0, 0, 0 };
+	canvas->dirty = unchanged;
+
+	if (canvas->container == decoder->container && canvas->frame == frame) {
+		return AnimationStatusOK;
+	}
+
+	// Pick the first frame to decode: the next one if the canvas holds the
+	// previous frame, otherwise the keyframe this frame's delta chain starts at
+
+	uint32_t first = frame;
+
+	if (canvas->container != decoder->container || canvas->frame == AnimationFrameNone || canvas->frame + 1 != frame)
+	{
+		AnimationStatus status = AnimationContainerFindKeyframe(decoder->container, frame, &first);
+		if (status != AnimationStatusOK) {
+			AnimationCanvasInvalidate(canvas);
+			return status;
+		}
+	}
+
+	for (uint32_t i = first; i <= frame; i++)
+	{
+		AnimationStatus status = AnimationDecoderDecodeImage(decoder, i, canvas);
+		if (status != AnimationStatusOK) {
+			AnimationCanvasInvalidate(canvas);
+			return status;
+		}
+	}
+
+	canvas->container = decoder->container;
+	canvas->frame = frame;
+
+	return AnimationStatusOK;
+}
+
+AnimationStatus AnimationDecoderCompositeFrame(const AnimationDecoder* decoder, uint32_t frame, AnimationCanvas* layer,
+	AnimationPixel* target, uint32_t stride, AnimationRect* dirty)
+{
+	const AnimationContainerImageHeader* header;
+	const void* data;
+
+	AnimationRect unchanged = { 0, 0, 0, 0 };
+	if (dirty != NULL) {
+		*dirty = unchanged;
+	}
+
+	AnimationStatus status = AnimationContainerGetImage(decoder->container, frame, &header, &data);
+	if (status != AnimationStatusOK) {
+		return status;
+	}
+
+	uint32_t width = decoder->container->header->width;
+	uint32_t height = decoder->container->header->height;
+
+	status = AnimationDecoderCheckImageRect(header, width, height);
+	if (status != AnimationStatusOK) {
+		return status;
+	}
+
+	AnimationRect rect = { header->xoffset, header->yoffset, header->width, header->height };
+	AnimationPixel* origin = target + rect.y * stride + rect.x;
+
+	switch (header->format)
+	{
+		case AnimationContainerImageFormatUncompressedPixels:
+			AnimationCompositePixelsRect(origin, stride, (const AnimationPixel*) data, rect.width, rect.width, rect.height);
+			break;
+
+		case AnimationContainerImageFormatRunLengthCompressedPixels:
+			status = AnimationCompositeRunLengthEncodedPixelsRect(origin, stride, rect.width, rect.height,
+				(const uint32_t*) data, header->dataLength);
+			break;
+
+		case AnimationContainerImageFormatBandedRunLengthPixels:
+			status = AnimationDecoderDrawBands(decoder, header, (const uint32_t*) data, origin, stride, 1);
+			break;
+
+		case AnimationContainerImageFormatCompactRunLengthPixels:
+			status = AnimationCompositeCompactRunLengthPixelsRect(origin, stride, rect.width, rect.height,
+				(const uint8_t*) data, header->dataLength);
+			break;
+
+		default:
+		{
+			// Everything else goes through the layer, which also keeps what a
+			// delta builds on
+
+			if (layer == NULL) {
+				return AnimationStatusUnsupportedFormat;
+			}
+
+			if (layer->width != width || layer->height != height) {
+				return AnimationStatusOverflow;
+			}
+
+			status = AnimationDecoderDrawFrame(decoder, frame, layer);
+			if (status != AnimationStatusOK) {
+				return status;
+			}
+
+			rect = layer->content;
+			AnimationCompositePixelsRect(target + rect.y * stride + rect.x, stride, layer->pixels + rect.y * layer->width + rect.x,
+				layer->width, rect.width, rect.height);
+			break;
+		}
+	}
+
+	if (dirty != NULL) {
+		*dirty = rect;
+	}
+
+	return status;
+}
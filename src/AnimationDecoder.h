@@ -0,0 +1,108 @@
+/*
+ * (C) Copyright 2010, Stefan Arentz, Arentz Consulting Inc.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANIMATIONDECODER_H
+#define ANIMATIONDECODER_H
+
+#include <stdint.h>
+#include "AnimationCommon.h"
+#include "AnimationContainer.h"
+#include "AnimationThreadPool.h"
+
+#define AnimationFrameNone UINT32_MAX
+
+// The pixels a frame is decoded into. The canvas remembers which frame of
+// which container it holds, so a delta frame can be applied on top of its
+// predecessor in place instead of decoding from the last keyframe.
+//
+// Frames are cropped to their content, so the canvas also tracks the
+// rectangle that may hold non-transparent pixels. Only that rectangle is
+// cleared when the next keyframe is drawn, which keeps the cost of a frame
+// proportional to its visible content rather than to the canvas size.
+//
+// Every draw also leaves the rectangle it changed in dirty, so whatever shows
+// the canvas only has to update that part. It is exact for deltas and covers
+// the old and new content for other frames.
+
+typedef struct AnimationCanvas {
+	AnimationPixel* pixels;
+	uint32_t width;
+	uint32_t height;
+	const AnimationContainer* container;
+	uint32_t frame;
+	const AnimationContainerImageHeader* image;	// Last image drawn
+	AnimationRect content;
+	AnimationRect dirty;						// Pixels the last draw changed
+} AnimationCanvas;
+
+// Grows rect to also cover other. Empty rectangles are ignored.
+void AnimationRectUnion(AnimationRect* rect, const AnimationRect* other);
+
+void AnimationCanvasInit(AnimationCanvas* canvas, AnimationPixel* pixels, uint32_t width, uint32_t height);
+
+// Call after changing the pixels of a canvas behind the decoder's back, and
+// before drawing into it again once the container it holds was closed
+void AnimationCanvasInvalidate(AnimationCanvas* canvas);
+
+// Makes rect of pixels, which has stride pixels per row, the content of the
+// canvas. Only the old content is cleared, like drawing a keyframe. The
+// caller sets what the canvas holds.
+void AnimationCanvasCopyRect(AnimationCanvas* canvas, const AnimationPixel* pixels, uint32_t stride, const AnimationRect* rect);
+
+// Decodes the formats that need platform code, like 'ping'. The image has to
+// be drawn at its xoffset/yoffset; the canvas is already cleared there.
+typedef AnimationStatus (*AnimationDecodeImageFunction)(void* context, const AnimationContainerImageHeader* header,
+	const void* data, AnimationCanvas* canvas);
+
+typedef struct AnimationDecoder {
+	const AnimationContainer* container;
+	AnimationDecodeImageFunction decodeImage;
+	void* context;
+	AnimationThreadPool* threadPool;
+	AnimationPixel palette[AnimationContainerMaxPaletteCount];	// The container's palette padded with zeros
+} AnimationDecoder;
+
+// The container has to be open, its palette is copied
+void AnimationDecoderInit(AnimationDecoder* decoder, const AnimationContainer* container,
+	AnimationDecodeImageFunction decodeImage, void* context);
+
+// Large banded frames ('rleb') are decoded on the threads of pool, one band
+// per part. NULL, the default, decodes everything on the calling thread.
+// The pool can be shared and has to outlive the decoder.
+void AnimationDecoderSetThreadPool(AnimationDecoder* decoder, AnimationThreadPool* pool);
+
+// Makes the canvas hold frame. Does nothing if it already does, applies a
+// single delta if it holds the previous frame and otherwise decodes forward
+// from the nearest keyframe.
+
+AnimationStatus AnimationDecoderDrawFrame(const AnimationDecoder* decoder, uint32_t frame, AnimationCanvas* canvas);
+
+// Draws frame over target instead of replacing it, see the compositing
+// decoders in AnimationCompression.h. target has the size of the container
+// and stride pixels per row; stacking layers in it flattens them. Keyframes
+// in 'pixl', 'rlen', 'rleb' and 'rle2' are blended straight from their data.
+// Deltas and other formats are drawn into layer, a canvas of this decoder's
+// own, and its content is blended from there; without a layer they fail with
+// AnimationStatusUnsupportedFormat. dirty, if not NULL, gets the rectangle of
+// target that may have changed.
+
+AnimationStatus AnimationDecoderCompositeFrame(const AnimationDecoder* decoder, uint32_t frame, AnimationCanvas* layer,
+	AnimationPixel* target, uint32_t stride, AnimationRect* dirty);
+
+#endif
@@ -19,17 +19,20 @@
 
 #import <Foundation/Foundation.h>
 #import "AnimationCommon.h"
+#import "AnimationDecoder.h"
 
 @interface AnimationFrameBuffer : NSObject {
   @private
 	NSUInteger width_;
 	NSUInteger height_;
 	AnimationPixel* pixels_;
+	AnimationCanvas canvas_;
 }
 
 @property (nonatomic,readonly) NSUInteger width;
 @property (nonatomic,readonly) NSUInteger height;
 @property (nonatomic,readonly) AnimationPixel* pixels;
+@property (nonatomic,readonly) AnimationCanvas* canvas;
 
 - (id) initWithWidth: (NSUInteger) width height: (NSUInteger) height;
 
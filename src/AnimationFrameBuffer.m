@@ -35,10 +35,16 @@
 			[self dealloc];
 			return nil;
 		}
+		AnimationCanvasInit(&canvas_, pixels_, width, height);
 	}
 	return self;
 }
 
+- (AnimationCanvas*) canvas
+{
+	return &canvas_;
+}
+
 - (void) dealloc
 {
 	if (pixels_ != NULL) {
@@ -0,0 +1,276 @@
+/*
+ * (C) Copyright 2010, Stefan Arentz, Arentz Consulting Inc.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "AnimationFrameCache.h"
+
+#define AnimationFrameCacheNone -1
+
+typedef struct AnimationFrameCacheEntry {
+	AnimationPixel* pixels;		// Container sized, only content is valid
+	AnimationRect content;
+	uint32_t frame;
+	int32_t newer;
+	int32_t older;
+} AnimationFrameCacheEntry;
+
+struct AnimationFrameCache {
+	const AnimationContainer* container;
+	AnimationFrameCachePolicy policy;
+	uint32_t width;
+	uint32_t height;
+	uint32_t frameCount;
+
+	AnimationFrameCacheEntry* entries;
+	uint32_t capacity;
+	uint32_t count;				// Entries in use, always the first count
+	int32_t* lookup;			// Entry of every frame, or none
+	int32_t newest;
+	int32_t oldest;
+
+	pthread_mutex_t lock;
+	AnimationFrameCacheStatistics statistics;
+};
+
+AnimationFrameCache* AnimationFrameCacheCreate(const AnimationContainer* container, size_t budget, AnimationFrameCachePolicy policy)
+{
+	AnimationFrameCache* cache = (AnimationFrameCache*) calloc(1, sizeof(AnimationFrameCache));
+	if (cache == NULL) {
+		return NULL;
+	}
+
+	cache->container = container;
+	cache->policy = policy;
+	cache->width = container->header->width;
+	cache->height = container->header->height;
+	cache->frameCount = container->header->frameCount;
+	cache->newest = AnimationFrameCacheNone;
+	cache->oldest = AnimationFrameCacheNone;
+
+	// Never more entries than frames, a short animation with a large budget
+	// only costs what it uses
+
+	size_t frameBytes = (size_t) cache->width * cache->height * sizeof(AnimationPixel);
+	size_t capacity = budget / frameBytes;
+	if (capacity > cache->frameCount) {
+		capacity = cache->frameCount;
+	}
+	cache->capacity = (uint32_t) capacity;
+	cache->statistics.capacity = cache->capacity;
+
+	cache->entries = (AnimationFrameCacheEntry*) calloc(cache->capacity + 1, sizeof(AnimationFrameCacheEntry));
+	cache->lookup = (int32_t*) malloc((cache->frameCount + 1) * sizeof(int32_t));
+	if (cache->entries == NULL || cache->lookup == NULL) {
+		free(cache->entries);
+		free(cache->lookup);
+		free(cache);
+		return NULL;
+	}
+
+	for (uint32_t i = 0; i < cache->frameCount; i++) {
+		cache->lookup[i] = AnimationFrameCacheNone;
+	}
+
+	pthread_mutex_init(&cache->lock, NULL);
+
+	return cache;
+}
+
+void AnimationFrameCacheDestroy(AnimationFrameCache* cache)
+{
+	if (cache == NULL) {
+		return;
+	}
+
+	for (uint32_t i = 0; i < cache->capacity; i++) {
+		free(cache->entries[i].pixels);
+	}
+
+	pthread_mutex_destroy(&cache->lock);
+	free(cache->entries);
+	free(cache->lookup);
+	free(cache);
+}
+
+static void AnimationFrameCacheUnlink(AnimationFrameCache* cache, int32_t i)
+{
+	AnimationFrameCacheEntry* entry = &cache->entries[i];
+
+	if (entry->newer != AnimationFrameCacheNone) {
+		cache->entries[entry->newer].older = entry->older;
+	} else {
+		cache->newest = entry->older;
+	}
+
+	if (entry->older != AnimationFrameCacheNone) {
+		cache->entries[entry->older].newer = entry->newer;
+	} else {
+		cache->oldest = entry->newer;
+	}
+}
+
+static void AnimationFrameCacheLinkNewest(AnimationFrameCache* cache, int32_t i)
+{
+	AnimationFrameCacheEntry* entry = &cache->entries[i];
+
+	entry->newer = AnimationFrameCacheNone;
+	entry->older = cache->newest;
+
+	if (cache->newest != AnimationFrameCacheNone) {
+		cache->entries[cache->newest].newer = i;
+	} else {
+		cache->oldest = i;
+	}
+	cache->newest = i;
+}
+
+// Copies a frame the canvas just decoded into a free entry, or for LRU into
+// the least recently used one. Called with the lock held.
+
+static void AnimationFrameCacheInsert(AnimationFrameCache* cache, uint32_t frame, const AnimationCanvas* canvas)
+{
+	int32_t i;
+
+	if (cache->count < cache->capacity)
+	{
+		i = (int32_t) cache->count;
+
+		if (cache->entries[i].pixels == NULL) {
+			cache->entries[i].pixels = (AnimationPixel*) malloc((size_t) cache->width * cache->height * sizeof(AnimationPixel));
+			if (cache->entries[i].pixels == NULL) {
+				return;
+			}
+			cache->statistics.allocations++;
+		}
+
+		cache->count++;
+	}
+	else if (cache->policy == AnimationFrameCachePolicyLRU && cache->oldest != AnimationFrameCacheNone)
+	{
+		i = cache->oldest;
+		AnimationFrameCacheUnlink(cache, i);
+		cache->lookup[cache->entries[i].frame] = AnimationFrameCacheNone;
+		cache->statistics.evictions++;
+	}
+	else
+	{
+		return;
+	}
+
+	AnimationFrameCacheEntry* entry = &cache->entries[i];
+	entry->frame = frame;
+	entry->content = canvas->content;
+
+	for (uint32_t y = entry->content.y; y < entry->content.y + entry->content.height; y++) {
+		memcpy(entry->pixels + y * cache->width + entry->content.x, canvas->pixels + y * canvas->width + entry->content.x,
+			entry->content.width * sizeof(AnimationPixel));
+	}
+
+	cache->lookup[frame] = i;
+	AnimationFrameCacheLinkNewest(cache, i);
+}
+
+AnimationStatus AnimationFrameCacheDrawFrame(AnimationFrameCache* cache, const AnimationDecoder* decoder, uint32_t frame, AnimationCanvas* canvas)
+{
+	if (canvas->container == decoder->container && canvas->frame == frame) {
+		AnimationRect unchanged = { 0, 0, 0, 0 };
+		canvas->dirty = unchanged;
+		return AnimationStatusOK;
+	}
+
+	// Frames are stored container sized, a smaller canvas goes straight to
+	// the decoder, which rejects images that do not fit
+
+	if (frame >= cache->frameCount || canvas->width < cache->width || canvas->height < cache->height) {
+		return AnimationDecoderDrawFrame(decoder, frame, canvas);
+	}
+
+	pthread_mutex_lock(&cache->lock);
+
+	int32_t i = cache->lookup[frame];
+	if (i != AnimationFrameCacheNone)
+	{
+		AnimationFrameCacheEntry* entry = &cache->entries[i];
+
+		if (cache->policy == AnimationFrameCachePolicyLRU) {
+			AnimationFrameCacheUnlink(cache, i);
+			AnimationFrameCacheLinkNewest(cache, i);
+		}
+
+		// Copied under the lock, another thread could evict the entry
+
+		AnimationCanvasCopyRect(canvas, entry->pixels, cache->width, &entry->content);
+		canvas->container = decoder->container;
+		canvas->frame = frame;
+		canvas->image = NULL;
+
+		cache->statistics.hits++;
+		pthread_mutex_unlock(&cache->lock);
+
+		return AnimationStatusOK;
+	}
+
+	cache->statistics.misses++;
+	pthread_mutex_unlock(&cache->lock);
+
+	AnimationStatus status = AnimationDecoderDrawFrame(decoder, frame, canvas);
+
+	// The decoder only draws inside the container, but a canvas it has not
+	// drawn into yet may claim more
+
+	if (status == AnimationStatusOK && canvas->content.x + canvas->content.width <= cache->width
+		&& canvas->content.y + canvas->content.height <= cache->height)
+	{
+		pthread_mutex_lock(&cache->lock);
+		if (cache->lookup[frame] == AnimationFrameCacheNone) {
+			AnimationFrameCacheInsert(cache, frame, canvas);
+		}
+		pthread_mutex_unlock(&cache->lock);
+	}
+
+	return status;
+}
+
+void AnimationFrameCacheClear(AnimationFrameCache* cache)
+{
+	pthread_mutex_lock(&cache->lock);
+
+	for (uint32_t i = 0; i < cache->count; i++) {
+		cache->lookup[cache->entries[i].frame] = AnimationFrameCacheNone;
+	}
+
+	cache->count = 0;
+	cache->newest = AnimationFrameCacheNone;
+	cache->oldest = AnimationFrameCacheNone;
+
+	pthread_mutex_unlock(&cache->lock);
+}
+
+void AnimationFrameCacheGetStatistics(AnimationFrameCache* cache, AnimationFrameCacheStatistics* statistics)
+{
+	pthread_mutex_lock(&cache->lock);
+
+	*statistics = cache->statistics;
+	statistics->frames = cache->count;
+	statistics->bytes = (size_t) cache->count * cache->width * cache->height * sizeof(AnimationPixel);
+
+	pthread_mutex_unlock(&cache->lock);
+}
@@ -0,0 +1,76 @@
+/*
+ * (C) Copyright 2010, Stefan Arentz, Arentz Consulting Inc.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANIMATIONFRAMECACHE_H
+#define ANIMATIONFRAMECACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "AnimationCommon.h"
+#include "AnimationContainer.h"
+#include "AnimationDecoder.h"
+
+// Keeps decoded frames of one container in memory, so a looping animation
+// that fits decodes every frame once and then plays from memory. A frame is
+// stored with the content rectangle the decoder left, so a canvas restored
+// from the cache goes on with the next delta as if it had decoded the frame
+// itself.
+//
+// The budget caps the bytes of cached pixels. Frames are allocated the first
+// time they are cached and reused after that, so once the cache is full it
+// makes no heap allocations.
+//
+// LRU suits random access. In a loop LRU always evicts the frame that comes
+// up next, so nothing hits once an animation is larger than the budget. The
+// loop policy keeps what it has and stops caching when full, so the same
+// frames come from memory on every pass.
+
+typedef enum {
+	AnimationFrameCachePolicyLRU = 0,
+	AnimationFrameCachePolicyLoop
+} AnimationFrameCachePolicy;
+
+typedef struct AnimationFrameCache AnimationFrameCache;
+
+typedef struct AnimationFrameCacheStatistics {
+	uint64_t hits;			// Frames copied from the cache
+	uint64_t misses;		// Frames decoded
+	uint64_t evictions;		// Frames dropped to make room for another
+	uint64_t allocations;	// Heap allocations for frames
+	uint32_t frames;		// Frames cached now
+	uint32_t capacity;		// Frames the budget holds
+	size_t bytes;			// Bytes of pixels cached now
+} AnimationFrameCacheStatistics;
+
+// Returns NULL if out of memory. A budget smaller than one frame makes a
+// cache that only counts misses.
+AnimationFrameCache* AnimationFrameCacheCreate(const AnimationContainer* container, size_t budget, AnimationFrameCachePolicy policy);
+void AnimationFrameCacheDestroy(AnimationFrameCache* cache);
+
+// Same as AnimationDecoderDrawFrame, for a decoder of the cache's container.
+// Safe to call from any thread as long as no two threads draw into the same
+// canvas; decoding happens outside the cache's lock.
+AnimationStatus AnimationFrameCacheDrawFrame(AnimationFrameCache* cache, const AnimationDecoder* decoder, uint32_t frame, AnimationCanvas* canvas);
+
+// Drops all frames but keeps their memory for reuse
+void AnimationFrameCacheClear(AnimationFrameCache* cache);
+
+void AnimationFrameCacheGetStatistics(AnimationFrameCache* cache, AnimationFrameCacheStatistics* statistics);
+
+#endif
@@ -0,0 +1,352 @@
+/*
+ * (C) Copyright 2010, Stefan Arentz, Arentz Consulting Inc.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include "AnimationHub.h"
+
+typedef struct AnimationHubChannel AnimationHubChannel;
+
+struct AnimationHubSubscriber {
+	AnimationHubChannel* channel;
+	AnimationHubPresentFunction present;
+	void* context;
+	int waiting;			// Has not been given the canvas on screen yet
+	AnimationHubSubscriber* next;
+};
+
+struct AnimationHubChannel {
+	AnimationHub* hub;
+	AnimationHubSource source;
+	AnimationPlayer player;
+	AnimationPrefetcher* prefetcher;	// NULL while flushed
+	const AnimationCanvas* canvas;		// On screen, NULL before the first frame
+	AnimationHubSubscriber* subscribers;
+	AnimationHubChannel* next;
+};
+
+struct AnimationHub {
+	uint32_t depth;
+	AnimationHubChannel* channels;
+	AnimationHubStatistics statistics;
+
+#if defined(ANIMATION_TRACE)
+	AnimationTrace* trace;
+#endif
+};
+
+// Without dirty only the subscribers still waiting get the frame
+
+static void AnimationHubPresent(AnimationHubChannel* channel, const AnimationRect* dirty)
+{
+	AnimationRect full = { 0, 0, channel->canvas->width, channel->canvas->height };
+
+	for (AnimationHubSubscriber* subscriber = channel->subscribers; subscriber != NULL; subscriber = subscriber->next)
+	{
+		// Whatever a new subscriber showed before has nothing to do with
+		// this channel, so it gets the whole frame
+
+		if (subscriber->waiting) {
+			subscriber->present(subscriber->context, channel->canvas, &full);
+		} else if (dirty != NULL) {
+			subscriber->present(subscriber->context, channel->canvas, dirty);
+		} else {
+			continue;
+		}
+
+		subscriber->waiting = 0;
+		channel->hub->statistics.deliveries++;
+	}
+}
+
+// Called by the channel's player when a frame is due
+
+static AnimationStatus AnimationHubDrawFrame(void* context, uint32_t frame)
+{
+	AnimationHubChannel* channel = (AnimationHubChannel*) context;
+
+	if (channel->prefetcher == NULL) {
+		return AnimationStatusNotReady;
+	}
+
+	// Only pick up frames the prefetcher already decoded, up to the one that
+	// is due. Frames before it were dropped by the player. Frames after it,
+	// which the ring starts with after a seek, are left for their own tick.
+
+	uint32_t frameCount = channel->source.frameCount;
+	const AnimationCanvas* canvas = NULL;
+	AnimationRect dirty = { 0, 0, 0, 0 };
+
+	while (canvas == NULL || canvas->frame != frame)
+	{
+		uint32_t head = AnimationPrefetcherPeekFrame(channel->prefetcher);
+		uint32_t ahead = (head + frameCount - frame) % frameCount;
+		if (head != AnimationFrameNone && ahead != 0 && ahead < channel->hub->depth) {
+			break;
+		}
+
+		const AnimationCanvas* next = AnimationPrefetcherNextFrame(channel->prefetcher);
+		if (next == NULL) {
+			break;
+		}
+		canvas = next;
+		AnimationRectUnion(&dirty, &canvas->dirty);
+	}
+
+	if (canvas == NULL) {
+		channel->hub->statistics.underruns++;
+		return AnimationStatusNotReady;
+	}
+
+	channel->canvas = canvas;
+	channel->hub->statistics.frames++;
+	AnimationHubPresent(channel, &dirty);
+
+	if (canvas->frame == frame) {
+		return AnimationStatusOK;
+	}
+
+	// The prefetcher fell behind. Show the newest frame it has and, if it is
+	// further behind than it decodes ahead, move it on to the frames that
+	// will be due instead of decoding ones that are already late.
+
+	if ((frame + frameCount - canvas->frame) % frameCount >= channel->hub->depth) {
+		AnimationPrefetcherSeek(channel->prefetcher, frame + 1);
+	}
+
+	return AnimationStatusNotReady;
+}
+
+static int AnimationHubStartDecoding(AnimationHubChannel* channel)
+{
+	AnimationHubSource* source = &channel->source;
+
+	channel->prefetcher = AnimationPrefetcherCreate(source->width, source->height, channel->hub->depth,
+		source->frameCount, source->decode, source->context);
+	if (channel->prefetcher == NULL) {
+		return 0;
+	}
+
+#if defined(ANIMATION_TRACE)
+	if (channel->hub->trace != NULL) {
+		AnimationPrefetcherSetTrace(channel->prefetcher, channel->hub->trace);
+	}
+#endif
+
+	// After a flush decoding picks up after the frame on screen
+
+	uint32_t frame = AnimationPlayerGetFrame(&channel->player);
+	if (frame != AnimationFrameNone) {
+		AnimationPrefetcherSeek(channel->prefetcher, frame + 1);
+	}
+
+	return 1;
+}
+
+static void AnimationHubStopDecoding(AnimationHubChannel* channel)
+{
+	// The canvas on screen goes with the prefetcher
+
+	if (channel->canvas != NULL)
+	{
+		for (AnimationHubSubscriber* subscriber = channel->subscribers; subscriber != NULL; subscriber = subscriber->next) {
+			subscriber->present(subscriber->context, NULL, NULL);
+			subscriber->waiting = 1;
+		}
+		channel->canvas = NULL;
+	}
+
+	AnimationPrefetcherDestroy(channel->prefetcher);
+	channel->prefetcher = NULL;
+}
+
+static AnimationHubChannel* AnimationHubFindChannel(const AnimationHub* hub, const void* key)
+{
+	for (AnimationHubChannel* channel = hub->channels; channel != NULL; channel = channel->next) {
+		if (channel->source.key == key) {
+			return channel;
+		}
+	}
+	return NULL;
+}
+
+AnimationHub* AnimationHubCreate(uint32_t depth)
+{
+	if (depth < 2) {
+		return NULL;
+	}
+
+	AnimationHub* hub = (AnimationHub*) calloc(1, sizeof(AnimationHub));
+	if (hub != NULL) {
+		hub->depth = depth;
+	}
+	return hub;
+}
+
+void AnimationHubDestroy(AnimationHub* hub)
+{
+	if (hub != NULL)
+	{
+		// The last subscriber of a channel takes the channel with it
+		while (hub->channels != NULL) {
+			AnimationHubUnsubscribe(hub, hub->channels->subscribers);
+		}
+		free(hub);
+	}
+}
+
+AnimationHubSubscriber* AnimationHubSubscribe(AnimationHub* hub, const AnimationHubSource* source,
+	AnimationHubPresentFunction present, void* context)
+{
+	if (source->frameCount == 0 || source->decode == NULL || present == NULL) {
+		return NULL;
+	}
+
+	AnimationHubSubscriber* subscriber = (AnimationHubSubscriber*) calloc(1, sizeof(AnimationHubSubscriber));
+	if (subscriber == NULL) {
+		return NULL;
+	}
+
+	AnimationHubChannel* channel = AnimationHubFindChannel(hub, source->key);
+	if (channel == NULL)
+	{
+		channel = (AnimationHubChannel*) calloc(1, sizeof(AnimationHubChannel));
+		if (channel == NULL) {
+			free(subscriber);
+			return NULL;
+		}
+
+		channel->hub = hub;
+		channel->source = *source;
+		AnimationPlayerInit(&channel->player, source->frameCount, source->frameRate, AnimationPlayerModeDrop,
+			AnimationHubDrawFrame, channel);
+
+		if (!AnimationHubStartDecoding(channel)) {
+			free(channel);
+			free(subscriber);
+			return NULL;
+		}
+
+		channel->next = hub->channels;
+		hub->channels = channel;
+		hub->statistics.channels++;
+	}
+
+	subscriber->channel = channel;
+	subscriber->present = present;
+	subscriber->context = context;
+	subscriber->waiting = 1;
+	subscriber->next = channel->subscribers;
+	channel->subscribers = subscriber;
+	hub->statistics.subscribers++;
+
+	return subscriber;
+}
+
+void AnimationHubUnsubscribe(AnimationHub* hub, AnimationHubSubscriber* subscriber)
+{
+	if (subscriber == NULL) {
+		return;
+	}
+
+	AnimationHubChannel* channel = subscriber->channel;
+
+	AnimationHubSubscriber** link = &channel->subscribers;
+	while (*link != subscriber) {
+		link = &(*link)->next;
+	}
+	*link = subscriber->next;
+	free(subscriber);
+	hub->statistics.subscribers--;
+
+	if (channel->subscribers == NULL)
+	{
+		AnimationPrefetcherDestroy(channel->prefetcher);
+
+		AnimationHubChannel** channelLink = &hub->channels;
+		while (*channelLink != channel) {
+			channelLink = &(*channelLink)->next;
+		}
+		*channelLink = channel->next;
+		free(channel);
+		hub->statistics.channels--;
+	}
+}
+
+void AnimationHubTick(AnimationHub* hub, uint64_t now)
+{
+	hub->statistics.ticks++;
+
+	for (AnimationHubChannel* channel = hub->channels; channel != NULL; channel = channel->next)
+	{
+		if (channel->prefetcher == NULL && !AnimationHubStartDecoding(channel)) {
+			continue;
+		}
+
+		AnimationPlayerTick(&channel->player, now);
+
+		// Subscribers that joined since the last frame get the one on screen
+
+		if (channel->canvas != NULL) {
+			AnimationHubPresent(channel, NULL);
+		}
+	}
+}
+
+void AnimationHubFlush(AnimationHub* hub, const void* key)
+{
+	AnimationHubChannel* channel = AnimationHubFindChannel(hub, key);
+	if (channel != NULL) {
+		AnimationHubStopDecoding(channel);
+	}
+}
+
+uint32_t AnimationHubGetFrameRate(const AnimationHub* hub)
+{
+	uint32_t frameRate = 0;
+	for (const AnimationHubChannel* channel = hub->channels; channel != NULL; channel = channel->next) {
+		if (channel->player.frameRate > frameRate) {
+			frameRate = channel->player.frameRate;
+		}
+	}
+	return frameRate;
+}
+
+void AnimationHubGetStatistics(const AnimationHub* hub, AnimationHubStatistics* statistics)
+{
+	*statistics = hub->statistics;
+}
+
+void AnimationHubGetPrefetcherStatistics(const AnimationHubSubscriber* subscriber, AnimationPrefetcherStatistics* statistics)
+{
+	AnimationPrefetcherStatistics empty = { 0 };
+	*statistics = empty;
+
+	if (subscriber->channel->prefetcher != NULL) {
+		AnimationPrefetcherGetStatistics(subscriber->channel->prefetcher, statistics);
+	}
+}
+
+#if defined(ANIMATION_TRACE)
+
+void AnimationHubSetTrace(AnimationHub* hub, AnimationTrace* trace)
+{
+	hub->trace = trace;
+}
+
+#endif
@@ -0,0 +1,108 @@
+/*
+ * (C) Copyright 2010, Stefan Arentz, Arentz Consulting Inc.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANIMATIONHUB_H
+#define ANIMATIONHUB_H
+
+#include <stdint.h>
+#include "AnimationCommon.h"
+#include "AnimationDecoder.h"
+#include "AnimationPlayer.h"
+#include "AnimationPrefetcher.h"
+#include "AnimationTrace.h"
+
+// Plays animations for many subscribers at once, like a screen full of
+// views showing the same few animations. Subscribers of the same animation
+// share a channel: one player, one prefetcher and one canvas, so every frame
+// is decoded once no matter how many subscribers show it. One tick advances
+// all channels, so a single timer drives everything.
+//
+// All subscribers of a channel see the same frame at the same time. One
+// that joins a channel that is already playing gets the frame on screen
+// with the next tick. The canvas handed to subscribers is read-only and
+// stays valid until the next tick.
+//
+// Not thread safe. Subscribe, unsubscribe and tick on one thread, usually
+// the main thread; decoding happens on the prefetcher threads.
+
+typedef struct AnimationHub AnimationHub;
+typedef struct AnimationHubSubscriber AnimationHubSubscriber;
+
+// Describes what a subscriber wants to see. Subscribers with the same key
+// share a channel, the rest of the source is taken from the first one.
+typedef struct AnimationHubSource {
+	const void* key;
+	uint32_t width;
+	uint32_t height;
+	uint32_t frameCount;
+	uint32_t frameRate;
+	AnimationPrefetchFunction decode;
+	void* context;
+} AnimationHubSource;
+
+// dirty is what changed since the frame this subscriber got before. A NULL
+// canvas means the last one is gone and must not be drawn from anymore.
+typedef void (*AnimationHubPresentFunction)(void* context, const AnimationCanvas* canvas, const AnimationRect* dirty);
+
+typedef struct AnimationHubStatistics {
+	uint64_t ticks;
+	uint64_t frames;		// Frames put on a channel's canvas, each decoded once
+	uint64_t deliveries;	// Frames handed to subscribers
+	uint64_t underruns;		// Channel ticks that found their frame not decoded yet
+	uint32_t channels;
+	uint32_t subscribers;
+} AnimationHubStatistics;
+
+// Channels decode up to depth - 1 frames ahead, see AnimationPrefetcher.h
+AnimationHub* AnimationHubCreate(uint32_t depth);
+void AnimationHubDestroy(AnimationHub* hub);
+
+// Returns NULL if the channel could not be made
+AnimationHubSubscriber* AnimationHubSubscribe(AnimationHub* hub, const AnimationHubSource* source,
+	AnimationHubPresentFunction present, void* context);
+
+// The last subscriber of a channel takes the channel with it. Not from
+// within a present function.
+void AnimationHubUnsubscribe(AnimationHub* hub, AnimationHubSubscriber* subscriber);
+
+// Shows the frames that are due at now on every channel
+void AnimationHubTick(AnimationHub* hub, uint64_t now);
+
+// Stops decoding for the channel of key and drops its frames, decoding
+// starts again with the next tick. Call before changing anything the decode
+// function depends on.
+void AnimationHubFlush(AnimationHub* hub, const void* key);
+
+// The highest frame rate of all channels, 0 without channels. Ticking twice
+// as often is enough.
+uint32_t AnimationHubGetFrameRate(const AnimationHub* hub);
+
+void AnimationHubGetStatistics(const AnimationHub* hub, AnimationHubStatistics* statistics);
+
+// Statistics of the prefetcher of a subscriber's channel, all zero while it
+// is flushed
+void AnimationHubGetPrefetcherStatistics(const AnimationHubSubscriber* subscriber, AnimationPrefetcherStatistics* statistics);
+
+#if defined(ANIMATION_TRACE)
+// Records the decoding of all channels, see AnimationPrefetcherSetTrace. Set
+// before subscribing, the trace has to outlive the hub.
+void AnimationHubSetTrace(AnimationHub* hub, AnimationTrace* trace);
+#endif
+
+#endif
@@ -0,0 +1,40 @@
+/*
+ * (C) Copyright 2010, Stefan Arentz, Arentz Consulting Inc.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#import <Foundation/Foundation.h>
+#import "AnimationArchive.h"
+
+// An archive of animations that share their images. The archive stays mapped
+// for as long as the library or any animation from it is alive.
+
+@interface AnimationLibrary : NSObject {
+  @private
+	AnimationArchive archive_;
+}
+
+@property (nonatomic,readonly) NSUInteger count;
+@property (nonatomic,readonly) const AnimationArchive* archive;
+
++ (id) libraryNamed: (NSString*) name;
+
+- (id) initWithContentsOfFile: (NSString*) path;
+
+- (id) animationNamed: (NSString*) name;
+
+@end
@@ -0,0 +1,77 @@
+/*
+ * (C) Copyright 2010, Stefan Arentz, Arentz Consulting Inc.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#import "AnimationLibrary.h"
+#import "Animation.h"
+
+@implementation AnimationLibrary
+
++ (id) libraryNamed: (NSString*) name
+{
+	AnimationLibrary* library = nil;
+
+	NSString* path = [[NSBundle mainBundle] pathForResource: name ofType: @"animations"];
+	if (path != nil) {
+		library = [[[self alloc] initWithContentsOfFile: path] autorelease];
+	}
+
+	return library;
+}
+
+- (id) initWithContentsOfFile: (NSString*) path
+{
+	if ((self = [super init]) != nil)
+	{
+		AnimationStatus status = AnimationArchiveOpenFile(&archive_, [path fileSystemRepresentation]);
+		if (status != AnimationStatusOK) {
+			NSLog(@"AnimationLibrary: cannot open %@ (status %d)", path, status);
+			[self release];
+			return nil;
+		}
+	}
+
+	return self;
+}
+
+- (void) dealloc
+{
+	AnimationArchiveClose(&archive_);
+	[super dealloc];
+}
+
+#pragma mark -
+
+- (id) animationNamed: (NSString*) name
+{
+	return [[[Animation alloc] initWithLibrary: self name: name] autorelease];
+}
+
+#pragma mark -
+
+- (NSUInteger) count
+{
+	return AnimationArchiveGetCount(&archive_);
+}
+
+- (const AnimationArchive*) archive
+{
+	return &archive_;
+}
+
+@end
@@ -0,0 +1,123 @@
+/*
+ * (C) Copyright 2010, Stefan Arentz, Arentz Consulting Inc.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "AnimationDecoder.h"
+#include "AnimationPlayer.h"
+
+void AnimationPlayerInit(AnimationPlayer* player, uint32_t frameCount, uint32_t frameRate, AnimationPlayerMode mode,
+	AnimationPlayerDrawFunction draw, void* context)
+{
+	player->frameCount = (frameCount != 0) ? frameCount : 1;
+	player->frameRate = (frameRate != 0) ? frameRate : AnimationPlayerDefaultFrameRate;
+	player->mode = mode;
+	player->draw = draw;
+	player->context = context;
+	player->origin = 0;
+	player->first = 0;
+	player->position = 0;
+	player->started = 0;
+	player->presenting = 0;
+
+	AnimationPlayerStatistics empty = { 0 };
+	player->statistics = empty;
+}
+
+void AnimationPlayerStart(AnimationPlayer* player, uint32_t first, uint64_t now)
+{
+	player->origin = now;
+	player->first = first % player->frameCount;
+	player->position = 0;
+	player->started = 1;
+	player->presenting = 0;
+}
+
+// Rounds up, so a frame is never shown before it is due
+
+static uint64_t AnimationPlayerFrameTime(const AnimationPlayer* player, uint64_t position)
+{
+	return player->origin + (position * AnimationClockNanosecondsPerSecond + player->frameRate - 1) / player->frameRate;
+}
+
+AnimationStatus AnimationPlayerTick(AnimationPlayer* player, uint64_t now)
+{
+	if (!player->started) {
+		AnimationPlayerStart(player, 0, now);
+	}
+
+	player->statistics.ticks++;
+
+	if (now + AnimationPlayerTolerance < player->origin) {
+		player->statistics.held++;
+		return AnimationStatusOK;
+	}
+
+	uint64_t due = (now + AnimationPlayerTolerance - player->origin) * player->frameRate / AnimationClockNanosecondsPerSecond;
+
+	if (player->presenting && due <= player->position) {
+		player->statistics.held++;
+		return AnimationStatusOK;
+	}
+
+	uint64_t next = player->presenting ? player->position + 1 : 0;
+	if (player->mode == AnimationPlayerModeDrop) {
+		next = due;
+	}
+
+	AnimationStatus status = player->draw(player->context, (uint32_t) ((player->first + next) % player->frameCount));
+	if (status != AnimationStatusOK) {
+		player->statistics.missed++;
+		return status;
+	}
+
+	uint64_t dueTime = AnimationPlayerFrameTime(player, next);
+	uint64_t lateness = (now > dueTime) ? now - dueTime : 0;
+
+	player->statistics.presented++;
+	player->statistics.totalLateness += lateness;
+	if (lateness > player->statistics.maxLateness) {
+		player->statistics.maxLateness = lateness;
+	}
+
+	if (player->mode == AnimationPlayerModeDrop) {
+		player->statistics.dropped += next - (player->presenting ? player->position + 1 : 0);
+	} else if (due > next) {
+		// Behind by more than a frame. Make this frame due now, so the next
+		// ones keep their spacing instead of rushing to catch up.
+		player->origin = now - (next * AnimationClockNanosecondsPerSecond) / player->frameRate;
+		player->statistics.slipped++;
+	}
+
+	player->position = next;
+	player->presenting = 1;
+
+	return AnimationStatusOK;
+}
+
+uint64_t AnimationPlayerNextFrameTime(const AnimationPlayer* player)
+{
+	return AnimationPlayerFrameTime(player, player->presenting ? player->position + 1 : 0);
+}
+
+uint32_t AnimationPlayerGetFrame(const AnimationPlayer* player)
+{
+	if (!player->presenting) {
+		return AnimationFrameNone;
+	}
+	return (uint32_t) ((player->first + player->position) % player->frameCount);
+}
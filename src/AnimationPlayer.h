@@ -0,0 +1,97 @@
+/*
+ * (C) Copyright 2010, Stefan Arentz, Arentz Consulting Inc.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANIMATIONPLAYER_H
+#define ANIMATIONPLAYER_H
+
+#include <stdint.h>
+#include "AnimationClock.h"
+#include "AnimationCommon.h"
+
+// Used when a container does not say how fast it plays
+#define AnimationPlayerDefaultFrameRate 12
+
+// A frame is shown by a tick that comes this many nanoseconds before it is
+// due. Ticks that line up with frames land a little either side of them,
+// and waiting a whole tick for the rest of a millisecond looks worse.
+#define AnimationPlayerTolerance 1000000ULL
+
+// Decides which frame is on screen at a given time. The player knows nothing
+// about the display: call AnimationPlayerTick as often as the screen can
+// change, with the time from AnimationClockNow or any other clock, and it
+// calls the draw function when a new frame is due.
+//
+// Frame n is due at start + n / frameRate, computed from the start time
+// every time, so an irregular tick never adds up to drift. When ticks come
+// late the drop mode skips to the frame that is due; the hold mode shows
+// every frame and pushes the timeline back instead, so playback runs slower
+// but never skips.
+//
+// A draw function that returns an error keeps the previous frame on screen;
+// the frame counts as missed and is tried again on the next tick. Return
+// AnimationStatusNotReady when the frame is simply not decoded yet.
+
+typedef enum {
+	AnimationPlayerModeDrop = 0,
+	AnimationPlayerModeHold
+} AnimationPlayerMode;
+
+typedef AnimationStatus (*AnimationPlayerDrawFunction)(void* context, uint32_t frame);
+
+typedef struct AnimationPlayerStatistics {
+	uint64_t ticks;
+	uint64_t presented;		// Frames drawn
+	uint64_t dropped;		// Frames skipped to catch up with the clock
+	uint64_t held;			// Ticks that kept the frame on screen because the next was not due
+	uint64_t missed;		// Ticks where the draw function failed
+	uint64_t slipped;		// Ticks where hold mode pushed the timeline back
+	uint64_t totalLateness;	// Nanoseconds frames were drawn after they were due, summed
+	uint64_t maxLateness;
+} AnimationPlayerStatistics;
+
+typedef struct AnimationPlayer {
+	uint32_t frameCount;
+	uint32_t frameRate;
+	AnimationPlayerMode mode;
+	AnimationPlayerDrawFunction draw;
+	void* context;
+	uint64_t origin;		// Time the first frame is due
+	uint32_t first;			// Frame played first
+	uint64_t position;		// Frames since the start, of the one on screen
+	int started;
+	int presenting;			// A frame has been drawn since the start
+	AnimationPlayerStatistics statistics;
+} AnimationPlayer;
+
+void AnimationPlayerInit(AnimationPlayer* player, uint32_t frameCount, uint32_t frameRate, AnimationPlayerMode mode,
+	AnimationPlayerDrawFunction draw, void* context);
+
+// Plays frame first at now and the rest from there. Also used to resume
+// after a pause, with the frame after the one on screen.
+void AnimationPlayerStart(AnimationPlayer* player, uint32_t first, uint64_t now);
+
+AnimationStatus AnimationPlayerTick(AnimationPlayer* player, uint64_t now);
+
+// When the frame after the one on screen is due, for sleeping until then
+uint64_t AnimationPlayerNextFrameTime(const AnimationPlayer* player);
+
+// The frame on screen, or AnimationFrameNone before the first one is drawn
+uint32_t AnimationPlayerGetFrame(const AnimationPlayer* player);
+
+#endif
@@ -0,0 +1,352 @@
+/*
+ * (C) Copyright 2010, Stefan Arentz, Arentz Consulting Inc.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include "AnimationBufferPool.h"
+#include "AnimationPrefetcher.h"
+
+typedef enum {
+	AnimationPrefetchSlotFree = 0,
+	AnimationPrefetchSlotReady,
+	AnimationPrefetchSlotDisplayed
+} AnimationPrefetchSlotState;
+
+typedef struct AnimationPrefetchSlot {
+	AnimationCanvas canvas;
+	AnimationPrefetchSlotState state;
+	AnimationRect stale;	// Changed in the working canvas since this slot was filled
+} AnimationPrefetchSlot;
+
+struct AnimationPrefetcher {
+	uint32_t width;
+	uint32_t height;
+	uint32_t depth;
+	uint32_t frameCount;
+	AnimationPrefetchFunction decode;
+	void* context;
+
+	// The worker decodes into its own canvas and copies finished frames into
+	// the ring. That keeps the decoder's frame history intact, so a delta
+	// frame costs one delta and not a decode from its keyframe.
+
+	AnimationCanvas working;
+	AnimationRect pending;	// Changed in the working canvas since the last frame went into the ring
+	AnimationPrefetchSlot* slots;
+	AnimationBufferPool* pool;
+
+	pthread_t thread;
+	pthread_mutex_t lock;
+	pthread_cond_t slotFree;
+	int running;
+
+	uint32_t head;			// Next slot the display takes
+	uint32_t tail;			// Next slot the worker fills
+	uint32_t nextFrame;		// Next frame the worker decodes
+	uint32_t generation;	// Bumped by a seek so in-flight work is dropped
+	int displayed;			// Slot on screen, or -1
+
+	AnimationPrefetcherStatistics statistics;
+
+#if defined(ANIMATION_TRACE)
+	AnimationTrace* trace;
+#endif
+};
+
+static void AnimationPrefetcherCopyRect(AnimationCanvas* dst, const AnimationCanvas* src, const AnimationRect* rect)
+{
+	for (uint32_t y = rect->y; y < rect->y + rect->height; y++) {
+		memcpy(dst->pixels + y * dst->width + rect->x, src->pixels + y * src->width + rect->x, rect->width * sizeof(AnimationPixel));
+	}
+}
+
+static void* AnimationPrefetcherWorker(void* argument)
+{
+	AnimationPrefetcher* prefetcher = (AnimationPrefetcher*) argument;
+
+	pthread_mutex_lock(&prefetcher->lock);
+
+	while (prefetcher->running)
+	{
+		AnimationPrefetchSlot* slot = &prefetcher->slots[prefetcher->tail];
+		if (slot->state != AnimationPrefetchSlotFree) {
+			pthread_cond_wait(&prefetcher->slotFree, &prefetcher->lock);
+			continue;
+		}
+
+		uint32_t frame = prefetcher->nextFrame;
+		uint32_t generation = prefetcher->generation;
+
+		pthread_mutex_unlock(&prefetcher->lock);
+
+		// The slot is free so nobody else looks at it while we fill it. It
+		// still holds the frame it was filled with last, so only what the
+		// decoder changed since then is copied. A failed decode may have
+		// left anything behind. Only the worker uses the stale rectangles.
+
+		ANIMATION_TRACE_BEGIN(decodeStart);
+		AnimationStatus status = prefetcher->decode(prefetcher->context, frame, &prefetcher->working);
+
+		AnimationRect changed = prefetcher->working.dirty;
+		if (status != AnimationStatusOK) {
+			AnimationRect full = { 0, 0, prefetcher->width, prefetcher->height };
+			changed = full;
+		}
+
+		for (uint32_t i = 0; i < prefetcher->depth; i++) {
+			AnimationRectUnion(&prefetcher->slots[i].stale, &changed);
+		}
+
+		AnimationPrefetcherCopyRect(&slot->canvas, &prefetcher->working, &slot->stale);
+		slot->stale.width = 0;
+		slot->stale.height = 0;
+		ANIMATION_TRACE_END(prefetcher->trace, AnimationTraceEventDecode, frame, decodeStart);
+
+		pthread_mutex_lock(&prefetcher->lock);
+
+		AnimationRectUnion(&prefetcher->pending, &changed);
+
+		if (generation != prefetcher->generation) {
+			continue;
+		}
+
+		prefetcher->statistics.decodedFrames++;
+		if (status != AnimationStatusOK) {
+			prefetcher->statistics.errors++;
+		}
+
+		// The frames in the ring follow each other, so what changed since
+		// the frame before is what the decoder changed since it was copied
+
+		slot->canvas.frame = frame;
+		slot->canvas.dirty = prefetcher->pending;
+		prefetcher->pending.width = 0;
+		prefetcher->pending.height = 0;
+		slot->state = AnimationPrefetchSlotReady;
+		prefetcher->statistics.readyFrames++;
+
+		prefetcher->tail = (prefetcher->tail + 1) % prefetcher->depth;
+		prefetcher->nextFrame = (frame + 1) % prefetcher->frameCount;
+	}
+
+	pthread_mutex_unlock(&prefetcher->lock);
+
+	return NULL;
+}
+
+// Nothing is known about what is on screen, the next frame updates all of it
+
+static void AnimationPrefetcherSetFullyDirty(AnimationPrefetcher* prefetcher)
+{
+	prefetcher->pending.x = 0;
+	prefetcher->pending.y = 0;
+	prefetcher->pending.width = prefetcher->width;
+	prefetcher->pending.height = prefetcher->height;
+}
+
+static int AnimationCanvasAcquire(AnimationCanvas* canvas, AnimationBufferPool* pool, uint32_t width, uint32_t height)
+{
+	AnimationPixel* pixels = (AnimationPixel*) AnimationBufferPoolAcquire(pool);
+	if (pixels == NULL) {
+		return 0;
+	}
+	memset(pixels, 0, width * height * sizeof(AnimationPixel));
+	AnimationCanvasInit(canvas, pixels, width, height);
+	return 1;
+}
+
+AnimationPrefetcher* AnimationPrefetcherCreate(uint32_t width, uint32_t height, uint32_t depth, uint32_t frameCount,
+	AnimationPrefetchFunction decode, void* context)
+{
+	if (depth < 2 || frameCount == 0) {
+		return NULL;
+	}
+
+	AnimationPrefetcher* prefetcher = (AnimationPrefetcher*) calloc(1, sizeof(AnimationPrefetcher));
+	if (prefetcher == NULL) {
+		return NULL;
+	}
+
+	prefetcher->width = width;
+	prefetcher->height = height;
+	prefetcher->depth = depth;
+	prefetcher->frameCount = frameCount;
+	prefetcher->decode = decode;
+	prefetcher->context = context;
+	prefetcher->displayed = -1;
+	AnimationPrefetcherSetFullyDirty(prefetcher);
+
+	// All canvases, the ring plus the working one, come out of one pool that
+	// is allocated here. Nothing is allocated while frames are played.
+
+	prefetcher->slots = (AnimationPrefetchSlot*) calloc(depth, sizeof(AnimationPrefetchSlot));
+	prefetcher->pool = AnimationBufferPoolCreate(width * height * sizeof(AnimationPixel), depth + 1);
+	if (prefetcher->slots == NULL || prefetcher->pool == NULL
+		|| !AnimationCanvasAcquire(&prefetcher->working, prefetcher->pool, width, height))
+	{
+		AnimationPrefetcherDestroy(prefetcher);
+		return NULL;
+	}
+
+	for (uint32_t i = 0; i < depth; i++) {
+		if (!AnimationCanvasAcquire(&prefetcher->slots[i].canvas, prefetcher->pool, width, height)) {
+			AnimationPrefetcherDestroy(prefetcher);
+			return NULL;
+		}
+	}
+
+	pthread_mutex_init(&prefetcher->lock, NULL);
+	pthread_cond_init(&prefetcher->slotFree, NULL);
+
+	prefetcher->running = 1;
+	if (pthread_create(&prefetcher->thread, NULL, AnimationPrefetcherWorker, prefetcher) != 0) {
+		prefetcher->running = 0;
+		AnimationPrefetcherDestroy(prefetcher);
+		return NULL;
+	}
+
+	return prefetcher;
+}
+
+void AnimationPrefetcherDestroy(AnimationPrefetcher* prefetcher)
+{
+	if (prefetcher == NULL) {
+		return;
+	}
+
+	if (prefetcher->running)
+	{
+		pthread_mutex_lock(&prefetcher->lock);
+		prefetcher->running = 0;
+		pthread_cond_broadcast(&prefetcher->slotFree);
+		pthread_mutex_unlock(&prefetcher->lock);
+
+		pthread_join(prefetcher->thread, NULL);
+
+		pthread_cond_destroy(&prefetcher->slotFree);
+		pthread_mutex_destroy(&prefetcher->lock);
+	}
+
+	// The pool owns the pixels of every canvas
+	AnimationBufferPoolDestroy(prefetcher->pool);
+
+	free(prefetcher->slots);
+	free(prefetcher);
+}
+
+const AnimationCanvas* AnimationPrefetcherNextFrame(AnimationPrefetcher* prefetcher)
+{
+	const AnimationCanvas* canvas = NULL;
+
+	pthread_mutex_lock(&prefetcher->lock);
+
+	AnimationPrefetchSlot* slot = &prefetcher->slots[prefetcher->head];
+	if (slot->state == AnimationPrefetchSlotReady)
+	{
+		// The frame that was on screen is replaced, its slot can be refilled
+
+		if (prefetcher->displayed != -1) {
+			prefetcher->slots[prefetcher->displayed].state = AnimationPrefetchSlotFree;
+			pthread_cond_signal(&prefetcher->slotFree);
+		}
+
+		slot->state = AnimationPrefetchSlotDisplayed;
+		prefetcher->displayed = (int) prefetcher->head;
+		prefetcher->head = (prefetcher->head + 1) % prefetcher->depth;
+
+		prefetcher->statistics.readyFrames--;
+		prefetcher->statistics.displayedFrames++;
+
+		canvas = &slot->canvas;
+	}
+	else
+	{
+		prefetcher->statistics.underruns++;
+		ANIMATION_TRACE_VALUE(prefetcher->trace, AnimationTraceEventDeadlineMiss,
+			(prefetcher->displayed != -1) ? prefetcher->slots[prefetcher->displayed].canvas.frame : AnimationFrameNone, 0);
+	}
+
+	ANIMATION_TRACE_VALUE(prefetcher->trace, AnimationTraceEventQueueDepth, (canvas != NULL) ? canvas->frame : AnimationFrameNone,
+		prefetcher->statistics.readyFrames);
+
+	pthread_mutex_unlock(&prefetcher->lock);
+
+	return canvas;
+}
+
+uint32_t AnimationPrefetcherPeekFrame(AnimationPrefetcher* prefetcher)
+{
+	pthread_mutex_lock(&prefetcher->lock);
+
+	AnimationPrefetchSlot* slot = &prefetcher->slots[prefetcher->head];
+	uint32_t frame = (slot->state == AnimationPrefetchSlotReady) ? slot->canvas.frame : AnimationFrameNone;
+
+	pthread_mutex_unlock(&prefetcher->lock);
+
+	return frame;
+}
+
+void AnimationPrefetcherSeek(AnimationPrefetcher* prefetcher, uint32_t frame)
+{
+	pthread_mutex_lock(&prefetcher->lock);
+
+	for (uint32_t i = 0; i < prefetcher->depth; i++) {
+		if (prefetcher->slots[i].state == AnimationPrefetchSlotReady) {
+			prefetcher->slots[i].state = AnimationPrefetchSlotFree;
+		}
+	}
+
+	// Refill the ring starting right after the frame on screen
+
+	uint32_t start = (prefetcher->displayed == -1) ? 0 : ((uint32_t) prefetcher->displayed + 1) % prefetcher->depth;
+
+	prefetcher->head = start;
+	prefetcher->tail = start;
+	prefetcher->nextFrame = frame % prefetcher->frameCount;
+	prefetcher->generation++;
+
+	// The dropped frames never reached the screen, so their changes are
+	// not on it either
+	AnimationPrefetcherSetFullyDirty(prefetcher);
+	prefetcher->statistics.readyFrames = 0;
+
+	pthread_cond_signal(&prefetcher->slotFree);
+	pthread_mutex_unlock(&prefetcher->lock);
+}
+
+void AnimationPrefetcherGetStatistics(AnimationPrefetcher* prefetcher, AnimationPrefetcherStatistics* statistics)
+{
+	pthread_mutex_lock(&prefetcher->lock);
+	*statistics = prefetcher->statistics;
+	pthread_mutex_unlock(&prefetcher->lock);
+
+	AnimationBufferPoolGetStatistics(prefetcher->pool, &statistics->buffers);
+}
+
+#if defined(ANIMATION_TRACE)
+
+void AnimationPrefetcherSetTrace(AnimationPrefetcher* prefetcher, AnimationTrace* trace)
+{
+	pthread_mutex_lock(&prefetcher->lock);
+	prefetcher->trace = trace;
+	pthread_mutex_unlock(&prefetcher->lock);
+}
+
+#endif
@@ -0,0 +1,84 @@
+/*
+ * (C) Copyright 2010, Stefan Arentz, Arentz Consulting Inc.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANIMATIONPREFETCHER_H
+#define ANIMATIONPREFETCHER_H
+
+#include <stdint.h>
+#include "AnimationCommon.h"
+#include "AnimationBufferPool.h"
+#include "AnimationDecoder.h"
+#include "AnimationTrace.h"
+
+// Decodes frames ahead of the playhead on a worker thread. Decoded frames go
+// into a ring of depth canvases, so the display tick only has to pick up a
+// frame that is already there. One canvas is always held by the frame on
+// screen, so up to depth - 1 frames are decoded ahead. The canvases are
+// taken from a buffer pool when the prefetcher is created; playing frames
+// makes no heap allocations.
+//
+// The decode function is called on the worker thread, always for frames in
+// playback order and always with the same canvas, so delta frames are
+// applied one by one.
+//
+// The dirty rectangle of a returned canvas covers everything that changed
+// since the canvas returned before it, so the display can update just that.
+// The decode function has to leave the canvas's dirty rectangle set, like
+// AnimationDecoderDrawFrame does.
+
+typedef AnimationStatus (*AnimationPrefetchFunction)(void* context, uint32_t frame, AnimationCanvas* canvas);
+
+typedef struct AnimationPrefetcher AnimationPrefetcher;
+
+typedef struct AnimationPrefetcherStatistics {
+	uint64_t decodedFrames;		// Frames decoded by the worker
+	uint64_t displayedFrames;	// Frames handed to the display
+	uint64_t underruns;			// Ticks that found no decoded frame
+	uint64_t errors;			// Frames that failed to decode
+	uint32_t readyFrames;		// Frames currently decoded and waiting
+	AnimationBufferPoolStatistics buffers;	// Canvas storage, allocated once at create
+} AnimationPrefetcherStatistics;
+
+AnimationPrefetcher* AnimationPrefetcherCreate(uint32_t width, uint32_t height, uint32_t depth, uint32_t frameCount,
+	AnimationPrefetchFunction decode, void* context);
+void AnimationPrefetcherDestroy(AnimationPrefetcher* prefetcher);
+
+// Returns the next frame in playback order, looping at the end, or NULL if
+// it is not decoded yet. NULL counts as an underrun; keep showing the
+// previous frame. The returned canvas stays valid until the next call that
+// returns a frame.
+
+const AnimationCanvas* AnimationPrefetcherNextFrame(AnimationPrefetcher* prefetcher);
+
+// The frame AnimationPrefetcherNextFrame would return, without taking it, or
+// AnimationFrameNone if it is not decoded yet. Not counted as an underrun.
+uint32_t AnimationPrefetcherPeekFrame(AnimationPrefetcher* prefetcher);
+
+// Drops everything decoded ahead and continues decoding from frame
+void AnimationPrefetcherSeek(AnimationPrefetcher* prefetcher, uint32_t frame);
+
+void AnimationPrefetcherGetStatistics(AnimationPrefetcher* prefetcher, AnimationPrefetcherStatistics* statistics);
+
+#if defined(ANIMATION_TRACE)
+// Records decode times, queue depth and underruns as deadline misses. Set
+// before playing, the trace has to outlive the prefetcher.
+void AnimationPrefetcherSetTrace(AnimationPrefetcher* prefetcher, AnimationTrace* trace);
+#endif
+
+#endif
@@ -0,0 +1,290 @@
+/*
+ * (C) Copyright 2010, Stefan Arentz, Arentz Consulting Inc.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <string.h>
+#include "AnimationCompression.h"
+#include "AnimationSink.h"
+
+void AnimationSinkInit(AnimationSink* sink, AnimationSinkPresentFunction present, void* context)
+{
+	sink->present = present;
+	sink->presentBlocks = NULL;
+	sink->context = context;
+	sink->showsBlocks = 0;
+	memset(&sink->blockContent, 0, sizeof(sink->blockContent));
+	memset(&sink->statistics, 0, sizeof(sink->statistics));
+}
+
+void AnimationSinkPresent(AnimationSink* sink, const AnimationCanvas* canvas, const AnimationRect* dirty)
+{
+	AnimationRect rect = *dirty;
+
+	// Decoded frames did not reach the surface while blocks were shown
+
+	if (sink->showsBlocks) {
+		AnimationRect all = { 0, 0, canvas->width, canvas->height };
+		rect = all;
+		sink->showsBlocks = 0;
+	}
+
+	if (rect.x >= canvas->width || rect.y >= canvas->height) {
+		rect.width = 0;
+		rect.height = 0;
+	}
+	if (rect.width > canvas->width - rect.x) {
+		rect.width = canvas->width - rect.x;
+	}
+	if (rect.height > canvas->height - rect.y) {
+		rect.height = canvas->height - rect.y;
+	}
+
+	sink->statistics.frames++;
+	sink->statistics.frameBytes += (uint64_t) canvas->width * canvas->height * sizeof(AnimationPixel);
+
+	if (rect.width == 0 || rect.height == 0) {
+		sink->statistics.unchangedFrames++;
+		return;
+	}
+
+	sink->statistics.presentedBytes += (uint64_t) rect.width * rect.height * sizeof(AnimationPixel);
+	sink->present(sink, canvas, &rect);
+}
+
+AnimationStatus AnimationSinkPresentBlocks(AnimationSink* sink, const AnimationContainer* container, uint32_t frame)
+{
+	if (sink->presentBlocks == NULL) {
+		return AnimationStatusUnsupportedFormat;
+	}
+
+	const AnimationContainerImageHeader* header;
+	const void* data;
+
+	AnimationStatus status = AnimationContainerGetImage(container, frame, &header, &data);
+	if (status != AnimationStatusOK) {
+		return status;
+	}
+
+	if (header->format != AnimationContainerImageFormatBlockCompressedPixels) {
+		return AnimationStatusUnsupportedFormat;
+	}
+
+	uint32_t width = container->header->width;
+	uint32_t height = container->header->height;
+
+	// The image replaces the last one like a keyframe does. If decoded
+	// frames were shown until now the block surface is stale everywhere.
+
+	AnimationRect rect = { header->xoffset, header->yoffset, header->width, header->height };
+	AnimationRect dirty = rect;
+
+	if (sink->showsBlocks) {
+		AnimationRectUnion(&dirty, &sink->blockContent);
+	} else {
+		AnimationRect all = { 0, 0, width, height };
+		dirty = all;
+	}
+
+	sink->showsBlocks = 1;
+	sink->blockContent = rect;
+
+	sink->statistics.frames++;
+	sink->statistics.blockFrames++;
+	sink->statistics.frameBytes += (uint64_t) width * height * sizeof(AnimationPixel);
+
+	if (dirty.width == 0 || dirty.height == 0) {
+		sink->statistics.unchangedFrames++;
+		return AnimationStatusOK;
+	}
+
+	// Blocks are only ever updated whole
+
+	uint32_t right = (dirty.x + dirty.width + AnimationPixelBlockSize - 1) / AnimationPixelBlockSize * AnimationPixelBlockSize;
+	uint32_t bottom = (dirty.y + dirty.height + AnimationPixelBlockSize - 1) / AnimationPixelBlockSize * AnimationPixelBlockSize;
+	dirty.x -= dirty.x % AnimationPixelBlockSize;
+	dirty.y -= dirty.y % AnimationPixelBlockSize;
+	dirty.width = right - dirty.x;
+	dirty.height = bottom - dirty.y;
+
+	sink->statistics.presentedBytes += (uint64_t) (dirty.width / AnimationPixelBlockSize) * (dirty.height / AnimationPixelBlockSize)
+		* AnimationPixelBlockLength;
+	sink->presentBlocks(sink, &rect, (const uint8_t*) data, &dirty);
+
+	return AnimationStatusOK;
+}
+
+typedef struct AnimationSoftwareSink {
+	AnimationSink sink;
+	AnimationPixel* pixels;
+	uint32_t width;
+	uint32_t height;
+} AnimationSoftwareSink;
+
+static void AnimationSoftwareSinkPresent(AnimationSink* sink, const AnimationCanvas* canvas, const AnimationRect* dirty)
+{
+	AnimationSoftwareSink* software = (AnimationSoftwareSink*) sink;
+
+	// Frames larger than the sink are cut off at its edges
+
+	uint32_t right = dirty->x + dirty->width;
+	uint32_t bottom = dirty->y + dirty->height;
+	if (right > software->width) {
+		right = software->width;
+	}
+	if (bottom > software->height) {
+		bottom = software->height;
+	}
+	if (dirty->x >= right) {
+		return;
+	}
+
+	for (uint32_t y = dirty->y; y < bottom; y++) {
+		memcpy(software->pixels + y * software->width + dirty->x, canvas->pixels + y * canvas->width + dirty->x,
+			(right - dirty->x) * sizeof(AnimationPixel));
+	}
+}
+
+AnimationSink* AnimationSoftwareSinkCreate(uint32_t width, uint32_t height)
+{
+	AnimationSoftwareSink* software = (AnimationSoftwareSink*) calloc(1, sizeof(AnimationSoftwareSink));
+	if (software == NULL) {
+		return NULL;
+	}
+
+	software->pixels = (AnimationPixel*) calloc((size_t) width * height + 1, sizeof(AnimationPixel));
+	if (software->pixels == NULL) {
+		free(software);
+		return NULL;
+	}
+
+	software->width = width;
+	software->height = height;
+	AnimationSinkInit(&software->sink, AnimationSoftwareSinkPresent, NULL);
+
+	return &software->sink;
+}
+
+void AnimationSoftwareSinkDestroy(AnimationSink* sink)
+{
+	if (sink != NULL) {
+		AnimationSoftwareSink* software = (AnimationSoftwareSink*) sink;
+		free(software->pixels);
+		free(software);
+	}
+}
+
+const AnimationPixel* AnimationSoftwareSinkGetPixels(const AnimationSink* sink)
+{
+	return ((const AnimationSoftwareSink*) sink)->pixels;
+}
+
+// The block sink is a software sink with a block surface next to its pixels
+
+typedef struct AnimationBlockSink {
+	AnimationSoftwareSink software;
+	uint8_t* blocks;
+	uint32_t blocksPerRow;
+	uint32_t blockRows;
+} AnimationBlockSink;
+
+static void AnimationBlockSinkPresentBlocks(AnimationSink* sink, const AnimationRect* rect, const uint8_t* blocks,
+	const AnimationRect* dirty)
+{
+	AnimationBlockSink* block = (AnimationBlockSink*) sink;
+
+	// Clear what changed, all zero bytes are a transparent block, then put
+	// the blocks of the image in place. Both are cut off at the surface.
+
+	uint32_t left = dirty->x / AnimationPixelBlockSize;
+	uint32_t top = dirty->y / AnimationPixelBlockSize;
+	uint32_t right = (dirty->x + dirty->width) / AnimationPixelBlockSize;
+	uint32_t bottom = (dirty->y + dirty->height) / AnimationPixelBlockSize;
+
+	right = (right < block->blocksPerRow) ? right : block->blocksPerRow;
+	bottom = (bottom < block->blockRows) ? bottom : block->blockRows;
+
+	for (uint32_t y = top; y < bottom && left < right; y++) {
+		memset(block->blocks + (y * block->blocksPerRow + left) * AnimationPixelBlockLength, 0, (right - left) * AnimationPixelBlockLength);
+	}
+
+	uint32_t columns = (rect->width + AnimationPixelBlockSize - 1) / AnimationPixelBlockSize;
+	uint32_t rows = (rect->height + AnimationPixelBlockSize - 1) / AnimationPixelBlockSize;
+
+	left = rect->x / AnimationPixelBlockSize;
+	top = rect->y / AnimationPixelBlockSize;
+	right = (left + columns < block->blocksPerRow) ? left + columns : block->blocksPerRow;
+	bottom = (top + rows < block->blockRows) ? top + rows : block->blockRows;
+
+	for (uint32_t y = top; y < bottom && left < right; y++) {
+		memcpy(block->blocks + (y * block->blocksPerRow + left) * AnimationPixelBlockLength,
+			blocks + (y - top) * columns * AnimationPixelBlockLength, (right - left) * AnimationPixelBlockLength);
+	}
+}
+
+AnimationSink* AnimationBlockSinkCreate(uint32_t width, uint32_t height)
+{
+	AnimationBlockSink* block = (AnimationBlockSink*) calloc(1, sizeof(AnimationBlockSink));
+	if (block == NULL) {
+		return NULL;
+	}
+
+	block->blocksPerRow = (width + AnimationPixelBlockSize - 1) / AnimationPixelBlockSize;
+	block->blockRows = (height + AnimationPixelBlockSize - 1) / AnimationPixelBlockSize;
+	block->blocks = (uint8_t*) calloc((size_t) block->blocksPerRow * block->blockRows + 1, AnimationPixelBlockLength);
+	block->software.pixels = (AnimationPixel*) calloc((size_t) width * height + 1, sizeof(AnimationPixel));
+
+	if (block->blocks == NULL || block->software.pixels == NULL) {
+		AnimationBlockSinkDestroy(&block->software.sink);
+		return NULL;
+	}
+
+	block->software.width = width;
+	block->software.height = height;
+	AnimationSinkInit(&block->software.sink, AnimationSoftwareSinkPresent, NULL);
+	block->software.sink.presentBlocks = AnimationBlockSinkPresentBlocks;
+
+	return &block->software.sink;
+}
+
+void AnimationBlockSinkDestroy(AnimationSink* sink)
+{
+	if (sink != NULL) {
+		AnimationBlockSink* block = (AnimationBlockSink*) sink;
+		free(block->blocks);
+		free(block->software.pixels);
+		free(block);
+	}
+}
+
+const uint8_t* AnimationBlockSinkGetBlocks(const AnimationSink* sink)
+{
+	return ((const AnimationBlockSink*) sink)->blocks;
+}
+
+const AnimationPixel* AnimationBlockSinkGetPixels(AnimationSink* sink)
+{
+	AnimationBlockSink* block = (AnimationBlockSink*) sink;
+
+	if (sink->showsBlocks) {
+		AnimationDecompressBlockPixelsRect(block->software.pixels, block->software.width, block->software.width, block->software.height,
+			block->blocks, block->blocksPerRow * block->blockRows * AnimationPixelBlockLength);
+	}
+
+	return block->software.pixels;
+}
@@ -0,0 +1,94 @@
+/*
+ * (C) Copyright 2010, Stefan Arentz, Arentz Consulting Inc.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANIMATIONSINK_H
+#define ANIMATIONSINK_H
+
+#include <stdint.h>
+#include "AnimationCommon.h"
+#include "AnimationContainer.h"
+#include "AnimationDecoder.h"
+
+// Where frames go to be seen. Each frame comes with the rectangle that
+// changed since the frame before, so a sink only copies, uploads or redraws
+// that part. The statistics count how much that saves over full frames.
+//
+// Sinks that can show block compressed frames ('dxt5') as they are, like a
+// GPU texture in the same format, also set presentBlocks. Those frames then
+// skip the decoder: the sink gets the blocks of the image and the block
+// aligned rectangle that changed on its block surface. Switching between
+// decoded and block frames updates the whole surface that is switched to.
+
+typedef struct AnimationSinkStatistics {
+	uint64_t frames;
+	uint64_t unchangedFrames;	// Frames with nothing to update
+	uint64_t presentedBytes;	// Bytes inside the dirty rectangles
+	uint64_t frameBytes;		// Bytes full frame updates would have taken
+	uint64_t blockFrames;		// Frames presented as compressed blocks
+} AnimationSinkStatistics;
+
+typedef struct AnimationSink AnimationSink;
+
+typedef void (*AnimationSinkPresentFunction)(AnimationSink* sink, const AnimationCanvas* canvas, const AnimationRect* dirty);
+
+// rect is where the image goes, blocks holds its blocks in rows
+typedef void (*AnimationSinkPresentBlocksFunction)(AnimationSink* sink, const AnimationRect* rect, const uint8_t* blocks,
+	const AnimationRect* dirty);
+
+struct AnimationSink {
+	AnimationSinkPresentFunction present;
+	AnimationSinkPresentBlocksFunction presentBlocks;	// NULL if the sink only takes pixels
+	void* context;
+	int showsBlocks;				// The last frame was presented as blocks
+	AnimationRect blockContent;		// Where it was
+	AnimationSinkStatistics statistics;
+};
+
+void AnimationSinkInit(AnimationSink* sink, AnimationSinkPresentFunction present, void* context);
+
+// Clips dirty to the canvas, counts it and passes it on if it is not empty
+void AnimationSinkPresent(AnimationSink* sink, const AnimationCanvas* canvas, const AnimationRect* dirty);
+
+// Passes frame on as blocks without decoding it. Returns
+// AnimationStatusUnsupportedFormat when the sink does not take blocks or the
+// frame is not block compressed; decode and present it instead. A canvas
+// that follows along has to be drawn before the next delta frame.
+AnimationStatus AnimationSinkPresentBlocks(AnimationSink* sink, const AnimationContainer* container, uint32_t frame);
+
+// A sink that copies frames into pixels of its own, like an offscreen frame
+// buffer. Tools use it to measure and check dirty rectangles without a
+// screen: after every present its pixels equal the canvas.
+
+AnimationSink* AnimationSoftwareSinkCreate(uint32_t width, uint32_t height);
+void AnimationSoftwareSinkDestroy(AnimationSink* sink);
+
+const AnimationPixel* AnimationSoftwareSinkGetPixels(const AnimationSink* sink);
+
+// A software sink that also takes blocks and keeps them on a block surface,
+// the way a GPU keeps a compressed texture. Its pixels are what is on
+// screen: the block surface is expanded with the reference decoder first if
+// the last frame was presented as blocks.
+
+AnimationSink* AnimationBlockSinkCreate(uint32_t width, uint32_t height);
+void AnimationBlockSinkDestroy(AnimationSink* sink);
+
+const uint8_t* AnimationBlockSinkGetBlocks(const AnimationSink* sink);
+const AnimationPixel* AnimationBlockSinkGetPixels(AnimationSink* sink);
+
+#endif
@@ -0,0 +1,191 @@
+/*
+ * (C) Copyright 2010, Stefan Arentz, Arentz Consulting Inc.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "AnimationThreadPool.h"
+
+struct AnimationThreadPool {
+	pthread_t* threads;
+	uint32_t threadCount;
+
+	pthread_mutex_t runLock;	// Held by the thread running a job
+	pthread_mutex_t lock;
+	pthread_cond_t work;
+	pthread_cond_t done;
+	int running;
+
+	// The current job. Workers join it under the lock and then claim
+	// indices with an atomic increment, so parts are handed out without
+	// taking the lock again.
+
+	AnimationThreadPoolFunction function;	// NULL between jobs
+	void* context;
+	uint32_t count;
+	uint32_t next;
+	uint32_t generation;	// Bumped for every job
+	uint32_t active;		// Workers that joined the current job
+};
+
+static void AnimationThreadPoolWork(AnimationThreadPoolFunction function, void* context, uint32_t count, uint32_t* next)
+{
+	uint32_t index;
+	while ((index = __atomic_fetch_add(next, 1, __ATOMIC_RELAXED)) < count) {
+		function(context, index);
+	}
+}
+
+static void* AnimationThreadPoolWorker(void* argument)
+{
+	AnimationThreadPool* pool = (AnimationThreadPool*) argument;
+	uint32_t seen = 0;
+
+	pthread_mutex_lock(&pool->lock);
+
+	while (pool->running)
+	{
+		// A worker that wakes up after a job was finished has nothing to do
+
+		if (pool->generation == seen || pool->function == NULL) {
+			seen = pool->generation;
+			pthread_cond_wait(&pool->work, &pool->lock);
+			continue;
+		}
+
+		seen = pool->generation;
+		pool->active++;
+
+		AnimationThreadPoolFunction function = pool->function;
+		void* context = pool->context;
+		uint32_t count = pool->count;
+
+		pthread_mutex_unlock(&pool->lock);
+		AnimationThreadPoolWork(function, context, count, &pool->next);
+		pthread_mutex_lock(&pool->lock);
+
+		if (--pool->active == 0) {
+			pthread_cond_signal(&pool->done);
+		}
+	}
+
+	pthread_mutex_unlock(&pool->lock);
+
+	return NULL;
+}
+
+AnimationThreadPool* AnimationThreadPoolCreate(uint32_t threadCount)
+{
+	if (threadCount == 0) {
+		long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		threadCount = (cpus > 1) ? (uint32_t) (cpus - 1) : 0;
+	}
+
+	AnimationThreadPool* pool = (AnimationThreadPool*) calloc(1, sizeof(AnimationThreadPool));
+	if (pool == NULL) {
+		return NULL;
+	}
+
+	pthread_mutex_init(&pool->runLock, NULL);
+	pthread_mutex_init(&pool->lock, NULL);
+	pthread_cond_init(&pool->work, NULL);
+	pthread_cond_init(&pool->done, NULL);
+	pool->running = 1;
+
+	if (threadCount != 0)
+	{
+		pool->threads = (pthread_t*) calloc(threadCount, sizeof(pthread_t));
+		if (pool->threads == NULL) {
+			AnimationThreadPoolDestroy(pool);
+			return NULL;
+		}
+
+		for (; pool->threadCount < threadCount; pool->threadCount++) {
+			if (pthread_create(&pool->threads[pool->threadCount], NULL, AnimationThreadPoolWorker, pool) != 0) {
+				AnimationThreadPoolDestroy(pool);
+				return NULL;
+			}
+		}
+	}
+
+	return pool;
+}
+
+void AnimationThreadPoolDestroy(AnimationThreadPool* pool)
+{
+	if (pool == NULL) {
+		return;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	pool->running = 0;
+	pthread_cond_broadcast(&pool->work);
+	pthread_mutex_unlock(&pool->lock);
+
+	for (uint32_t i = 0; i < pool->threadCount; i++) {
+		pthread_join(pool->threads[i], NULL);
+	}
+
+	pthread_cond_destroy(&pool->done);
+	pthread_cond_destroy(&pool->work);
+	pthread_mutex_destroy(&pool->lock);
+	pthread_mutex_destroy(&pool->runLock);
+
+	free(pool->threads);
+	free(pool);
+}
+
+uint32_t AnimationThreadPoolGetThreadCount(const AnimationThreadPool* pool)
+{
+	return pool->threadCount;
+}
+
+void AnimationThreadPoolRun(AnimationThreadPool* pool, uint32_t count, AnimationThreadPoolFunction function, void* context)
+{
+	// Waking workers costs more than a single part
+
+	if (pool == NULL || pool->threadCount == 0 || count < 2 || pthread_mutex_trylock(&pool->runLock) != 0) {
+		uint32_t next = 0;
+		AnimationThreadPoolWork(function, context, count, &next);
+		return;
+	}
+
+	pthread_mutex_lock(&pool->lock);
+	pool->function = function;
+	pool->context = context;
+	pool->count = count;
+	pool->next = 0;
+	pool->generation++;
+	pthread_cond_broadcast(&pool->work);
+	pthread_mutex_unlock(&pool->lock);
+
+	AnimationThreadPoolWork(function, context, count, &pool->next);
+
+	// Every part is claimed, wait for the ones still running elsewhere. Once
+	// the job is cleared no late worker can join it anymore.
+
+	pthread_mutex_lock(&pool->lock);
+	while (pool->active != 0) {
+		pthread_cond_wait(&pool->done, &pool->lock);
+	}
+	pool->function = NULL;
+	pthread_mutex_unlock(&pool->lock);
+
+	pthread_mutex_unlock(&pool->runLock);
+}
@@ -0,0 +1,48 @@
+/*
+ * (C) Copyright 2010, Stefan Arentz, Arentz Consulting Inc.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANIMATIONTHREADPOOL_H
+#define ANIMATIONTHREADPOOL_H
+
+#include <stdint.h>
+
+// A fixed set of worker threads that run the parts of one job in parallel.
+// The thread that runs a job takes parts too, so a pool of n threads splits
+// work n + 1 ways, and a pool without threads just runs everything inline.
+//
+// One job runs at a time. A run that finds the pool busy, for example
+// because two decoders share it, does its whole job on the calling thread
+// instead of waiting.
+
+typedef struct AnimationThreadPool AnimationThreadPool;
+
+// Called once for every index of a job, on any thread and in any order
+typedef void (*AnimationThreadPoolFunction)(void* context, uint32_t index);
+
+// Starts threadCount workers. 0 picks one less than the number of CPUs.
+AnimationThreadPool* AnimationThreadPoolCreate(uint32_t threadCount);
+void AnimationThreadPoolDestroy(AnimationThreadPool* pool);
+
+uint32_t AnimationThreadPoolGetThreadCount(const AnimationThreadPool* pool);
+
+// Calls function for every index below count and returns when all calls
+// have returned
+void AnimationThreadPoolRun(AnimationThreadPool* pool, uint32_t count, AnimationThreadPoolFunction function, void* context);
+
+#endif
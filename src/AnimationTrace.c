@@ -0,0 +1,219 @@
+/*
+ * (C) Copyright 2010, Stefan Arentz, Arentz Consulting Inc.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include "AnimationTrace.h"
+
+#if defined(ANIMATION_TRACE)
+
+#include <stdlib.h>
+#include <string.h>
+
+// Each slot carries the number of the event in it, plus one, and zero while
+// it is being written. A reader that sees the same number before and after
+// copying the event got a whole one.
+
+typedef struct AnimationTraceSlot {
+	uint64_t sequence;
+	AnimationTraceEvent event;
+} AnimationTraceSlot;
+
+struct AnimationTrace {
+	AnimationTraceSlot* slots;
+	uint32_t mask;
+	uint64_t next;
+};
+
+AnimationTrace* AnimationTraceCreate(uint32_t capacity)
+{
+	uint32_t size = 1;
+	while (size < capacity && size < 0x80000000U) {
+		size <<= 1;
+	}
+
+	AnimationTrace* trace = (AnimationTrace*) calloc(1, sizeof(AnimationTrace));
+	if (trace == NULL) {
+		return NULL;
+	}
+
+	trace->slots = (AnimationTraceSlot*) calloc(size, sizeof(AnimationTraceSlot));
+	if (trace->slots == NULL) {
+		free(trace);
+		return NULL;
+	}
+
+	trace->mask = size - 1;
+
+	// Sets up the clock's time base before anything is recorded
+	AnimationClockNow();
+
+	return trace;
+}
+
+void AnimationTraceDestroy(AnimationTrace* trace)
+{
+	if (trace != NULL) {
+		free(trace->slots);
+		free(trace);
+	}
+}
+
+void AnimationTraceRecord(AnimationTrace* trace, AnimationTraceEventType type, uint32_t frame, uint64_t start, uint64_t duration, uint32_t value)
+{
+	if (trace == NULL) {
+		return;
+	}
+
+	uint64_t index = __atomic_fetch_add(&trace->next, 1, __ATOMIC_RELAXED);
+	AnimationTraceSlot* slot = &trace->slots[index & trace->mask];
+
+	__atomic_store_n(&slot->sequence, 0, __ATOMIC_RELAXED);
+	__atomic_thread_fence(__ATOMIC_RELEASE);
+
+	slot->event.start = start;
+	slot->event.duration = duration;
+	slot->event.type = type;
+	slot->event.frame = frame;
+	slot->event.value = value;
+
+	__atomic_store_n(&slot->sequence, index + 1, __ATOMIC_RELEASE);
+}
+
+uint32_t AnimationTraceCopyEvents(AnimationTrace* trace, AnimationTraceEvent* events, uint32_t count)
+{
+	uint64_t next = __atomic_load_n(&trace->next, __ATOMIC_ACQUIRE);
+
+	uint64_t first = 0;
+	if (next > (uint64_t) trace->mask + 1) {
+		first = next - trace->mask - 1;
+	}
+	if (next - first > count) {
+		first = next - count;
+	}
+
+	uint32_t copied = 0;
+
+	for (uint64_t index = first; index < next; index++)
+	{
+		const AnimationTraceSlot* slot = &trace->slots[index & trace->mask];
+
+		uint64_t sequence = __atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE);
+		if (sequence != index + 1) {
+			continue;
+		}
+
+		events[copied] = slot->event;
+		__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+		if (__atomic_load_n(&slot->sequence, __ATOMIC_RELAXED) == sequence) {
+			copied++;
+		}
+	}
+
+	return copied;
+}
+
+static const char* AnimationTraceEventName(uint32_t type)
+{
+	switch (type) {
+		case AnimationTraceEventDecode:
+			return "decode";
+		case AnimationTraceEventPresent:
+			return "present";
+		case AnimationTraceEventDeadlineMiss:
+			return "deadline-miss";
+		case AnimationTraceEventQueueDepth:
+			return "queue-depth";
+		default:
+			return "unknown";
+	}
+}
+
+static AnimationTraceEvent* AnimationTraceCopyAll(AnimationTrace* trace, uint32_t* count)
+{
+	AnimationTraceEvent* events = (AnimationTraceEvent*) malloc(((size_t) trace->mask + 1) * sizeof(AnimationTraceEvent));
+	if (events != NULL) {
+		*count = AnimationTraceCopyEvents(trace, events, trace->mask + 1);
+	}
+	return events;
+}
+
+AnimationStatus AnimationTraceWriteJSON(AnimationTrace* trace, FILE* file)
+{
+	uint32_t count;
+	AnimationTraceEvent* events = AnimationTraceCopyAll(trace, &count);
+	if (events == NULL) {
+		return AnimationStatusIOError;
+	}
+
+	// Decoding shows up as its own thread. Chrome wants microseconds.
+
+	fprintf(file, "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n");
+
+	for (uint32_t i = 0; i < count; i++)
+	{
+		const AnimationTraceEvent* event = &events[i];
+		const char* separator = (i + 1 < count) ? "," : "";
+		int tid = (event->type == AnimationTraceEventDecode) ? 2 : 1;
+		double ts = event->start / 1000.0;
+
+		switch (event->type) {
+			case AnimationTraceEventDecode:
+			case AnimationTraceEventPresent:
+				fprintf(file, "  {\"name\": \"%s\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"dur\": %.3f, \"args\": {\"frame\": %u}}%s\n",
+					AnimationTraceEventName(event->type), tid, ts, event->duration / 1000.0, event->frame, separator);
+				break;
+			case AnimationTraceEventQueueDepth:
+				fprintf(file, "  {\"name\": \"%s\", \"ph\": \"C\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"args\": {\"frames\": %u}}%s\n",
+					AnimationTraceEventName(event->type), tid, ts, event->value, separator);
+				break;
+			default:
+				fprintf(file, "  {\"name\": \"%s\", \"ph\": \"i\", \"s\": \"t\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, \"args\": {\"frame\": %u}}%s\n",
+					AnimationTraceEventName(event->type), tid, ts, event->frame, separator);
+				break;
+		}
+	}
+
+	fprintf(file, "]}\n");
+
+	free(events);
+
+	return ferror(file) ? AnimationStatusIOError : AnimationStatusOK;
+}
+
+AnimationStatus AnimationTraceWriteCSV(AnimationTrace* trace, FILE* file)
+{
+	uint32_t count;
+	AnimationTraceEvent* events = AnimationTraceCopyAll(trace, &count);
+	if (events == NULL) {
+		return AnimationStatusIOError;
+	}
+
+	fprintf(file, "event,frame,start_ns,duration_ns,value\n");
+
+	for (uint32_t i = 0; i < count; i++) {
+		fprintf(file, "%s,%u,%llu,%llu,%u\n", AnimationTraceEventName(events[i].type), events[i].frame,
+			(unsigned long long) events[i].start, (unsigned long long) events[i].duration, events[i].value);
+	}
+
+	free(events);
+
+	return ferror(file) ? AnimationStatusIOError : AnimationStatusOK;
+}
+
+#endif
@@ -0,0 +1,84 @@
+/*
+ * (C) Copyright 2010, Stefan Arentz, Arentz Consulting Inc.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANIMATIONTRACE_H
+#define ANIMATIONTRACE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include "AnimationClock.h"
+#include "AnimationCommon.h"
+
+// Playback instrumentation, only built with -DANIMATION_TRACE. Without it
+// the macros below expand to nothing and there is no trace code at all.
+//
+// Events go into a fixed ring that keeps the most recent ones. Recording is
+// lock free, so the decode thread and the display never wait on each other
+// or on an export in progress. Times come from AnimationClockNow.
+
+#define ANIMATION_TRACE_DEFAULT_CAPACITY 4096
+
+typedef enum {
+	AnimationTraceEventDecode = 0,		// A frame decoded, with its duration
+	AnimationTraceEventPresent,			// A frame handed to the screen, with its duration
+	AnimationTraceEventDeadlineMiss,	// A display tick that had no new frame
+	AnimationTraceEventQueueDepth		// Frames decoded ahead, in value
+} AnimationTraceEventType;
+
+typedef struct AnimationTraceEvent {
+	uint64_t start;
+	uint64_t duration;
+	uint32_t type;
+	uint32_t frame;
+	uint32_t value;
+} AnimationTraceEvent;
+
+#if defined(ANIMATION_TRACE)
+
+typedef struct AnimationTrace AnimationTrace;
+
+// The capacity is rounded up to a power of two
+AnimationTrace* AnimationTraceCreate(uint32_t capacity);
+void AnimationTraceDestroy(AnimationTrace* trace);
+
+void AnimationTraceRecord(AnimationTrace* trace, AnimationTraceEventType type, uint32_t frame, uint64_t start, uint64_t duration, uint32_t value);
+
+// Copies up to count of the recorded events, oldest first. Events being
+// written at the same time are left out.
+uint32_t AnimationTraceCopyEvents(AnimationTrace* trace, AnimationTraceEvent* events, uint32_t count);
+
+// Chrome trace JSON loads in chrome://tracing and Perfetto
+AnimationStatus AnimationTraceWriteJSON(AnimationTrace* trace, FILE* file);
+AnimationStatus AnimationTraceWriteCSV(AnimationTrace* trace, FILE* file);
+
+#define ANIMATION_TRACE_BEGIN(start) uint64_t start = AnimationClockNow()
+#define ANIMATION_TRACE_END(trace, type, frame, start) \
+	AnimationTraceRecord((trace), (type), (frame), (start), AnimationClockNow() - (start), 0)
+#define ANIMATION_TRACE_VALUE(trace, type, frame, value) \
+	AnimationTraceRecord((trace), (type), (frame), AnimationClockNow(), 0, (value))
+
+#else
+
+#define ANIMATION_TRACE_BEGIN(start)
+#define ANIMATION_TRACE_END(trace, type, frame, start)
+#define ANIMATION_TRACE_VALUE(trace, type, frame, value)
+
+#endif
+
+#endif
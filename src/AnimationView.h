@@ -19,21 +19,56 @@
 
 #import <UIKit/UIKit.h>
 #import "Animation.h"
-#import "AnimationFrameBuffer.h"
+#import "AnimationHub.h"
+#import "AnimationSink.h"
+
+// Frames are decoded this many frames ahead, minus the one on screen
+#define AnimationViewPrefetchDepth 3
+
+// Decoded frames kept per animation, so short loops are decoded only once
+#define AnimationViewDefaultCacheBudget (4 * 1024 * 1024)
 
 @interface AnimationView : UIView {
   @private
     Animation* animation_;
-	UIImageView* imageView_;
-	NSTimer* timer_;
-	int frame_;
-	float framesPerSecond_;
-	AnimationFrameBuffer* frameBuffer_;
+	AnimationSink viewSink_;
+	AnimationSink* sink_;
+	const AnimationCanvas* canvas_;
+	AnimationHubSubscriber* subscriber_;
+	NSUInteger cacheBudget_;
+	CGColorSpaceRef colorSpace_;
+	CGDataProviderRef providers_[AnimationViewPrefetchDepth];
+	const AnimationPixel* providerPixels_[AnimationViewPrefetchDepth];
 }
 
 @property (nonatomic,retain) Animation* animation;
 
+// Bytes of decoded frames the animation keeps with the loop policy. Set on
+// the animation when it is shown, 0 turns the cache off.
+@property (nonatomic,assign) NSUInteger cacheBudget;
+
+// Display ticks that found no decoded frame and kept showing the previous
+// one, counted for everything that shows the same animation
+@property (nonatomic,readonly) NSUInteger underrunCount;
+
+// Frames go to this sink instead of the view when set. The view itself only
+// redraws the part of a frame that changed.
+@property (nonatomic,assign) AnimationSink* sink;
+
+// Bytes presented against bytes full frames would have taken
+@property (nonatomic,readonly) AnimationSinkStatistics sinkStatistics;
+
+// All views play from one shared hub and timer. Views showing the same
+// animation share its decoding and play in step: a view that starts while
+// others show its animation joins at the frame they are on.
+
 - (void) start;
 - (void) stop;
 
+#if defined(ANIMATION_TRACE)
+// Writes the recent decode and present times, deadline misses and queue
+// depth of all views. Chrome trace JSON, or CSV if the path ends in .csv.
+- (BOOL) writeTraceToFile: (NSString*) path;
+#endif
+
 @end
\ No newline at end of file
@@ -19,9 +19,132 @@
 
 #import "AnimationView.h"
 
+// Runs on the prefetch thread
+
+static AnimationStatus AnimationViewDecodeFrame(void* context, uint32_t frame, AnimationCanvas* canvas)
+{
+	NSAutoreleasePool* pool = [NSAutoreleasePool new];
+	AnimationStatus status = [(Animation*) context drawFrame: frame intoCanvas: canvas];
+	[pool release];
+	return status;
+}
+
+@interface AnimationView ()
+- (void) presentCanvas: (const AnimationCanvas*) canvas dirty: (const AnimationRect*) dirty;
+- (void) displayCanvas: (const AnimationCanvas*) canvas inRect: (CGRect) rect;
+@end
+
+// All views share one hub and one timer, so an animation shown by several
+// views is decoded once and all of them are updated by the same tick. Views
+// live on the main thread, so these do too.
+
+static AnimationHub* gAnimationViewHub = NULL;
+static NSTimer* gAnimationViewTimer = nil;
+#if defined(ANIMATION_TRACE)
+static AnimationTrace* gAnimationViewTrace = NULL;
+#endif
+
+static AnimationHub* AnimationViewSharedHub(void)
+{
+	if (gAnimationViewHub == NULL) {
+		gAnimationViewHub = AnimationHubCreate(AnimationViewPrefetchDepth);
+#if defined(ANIMATION_TRACE)
+		gAnimationViewTrace = AnimationTraceCreate(ANIMATION_TRACE_DEFAULT_CAPACITY);
+		if (gAnimationViewHub != NULL) {
+			AnimationHubSetTrace(gAnimationViewHub, gAnimationViewTrace);
+		}
+#endif
+	}
+	return gAnimationViewHub;
+}
+
+// Runs on the main thread, from the shared timer
+
+static void AnimationViewPresentFrame(void* context, const AnimationCanvas* canvas, const AnimationRect* dirty)
+{
+	[(AnimationView*) context presentCanvas: canvas dirty: dirty];
+}
+
+// The view's own sink, redraws the dirty rectangle from the canvas
+
+static void AnimationViewSinkPresent(AnimationSink* sink, const AnimationCanvas* canvas, const AnimationRect* dirty)
+{
+	[(AnimationView*) sink->context displayCanvas: canvas inRect: CGRectMake(dirty->x, dirty->y, dirty->width, dirty->height)];
+}
+
 @implementation AnimationView
 
 @synthesize animation = animation_;
+@synthesize cacheBudget = cacheBudget_;
+@synthesize sink = sink_;
+
+// The hub shows frames from the canvases of the animation's prefetcher,
+// which live as long as the prefetcher, so a data provider per canvas is
+// made once and reused for every frame shown from it
+
+- (CGDataProviderRef) providerForCanvas: (const AnimationCanvas*) canvas
+{
+	for (int i = 0; i < AnimationViewPrefetchDepth; i++)
+	{
+		if (providers_[i] == NULL) {
+			providers_[i] = CGDataProviderCreateWithData(NULL, (const void*) canvas->pixels, canvas->width*canvas->height*4, NULL);
+			providerPixels_[i] = canvas->pixels;
+		}
+
+		if (providerPixels_[i] == canvas->pixels) {
+			return providers_[i];
+		}
+	}
+	return NULL;
+}
+
+- (void) releaseProviders
+{
+	for (int i = 0; i < AnimationViewPrefetchDepth; i++) {
+		CGDataProviderRelease(providers_[i]);
+		providers_[i] = NULL;
+		providerPixels_[i] = NULL;
+	}
+
+	// The canvas on screen belonged to a prefetcher of the hub
+	canvas_ = NULL;
+}
+
+- (void) applyCacheBudget
+{
+	// The hub decodes through the cache, so decoding of the animation stops
+	// while the cache is replaced and picks up again with the next tick
+
+	if (gAnimationViewHub != NULL) {
+		AnimationHubFlush(gAnimationViewHub, animation_);
+	}
+	[animation_ setCacheBudget: cacheBudget_ policy: AnimationFrameCachePolicyLoop];
+}
+
+- (void) setAnimation: (Animation*) animation
+{
+	if (animation != animation_)
+	{
+		BOOL playing = (subscriber_ != NULL);
+		[self stop];
+
+		[animation_ release];
+		animation_ = [animation retain];
+		[self applyCacheBudget];
+
+		if (playing) {
+			[self start];
+		}
+	}
+}
+
+- (void) setCacheBudget: (NSUInteger) cacheBudget
+{
+	if (cacheBudget != cacheBudget_) {
+		cacheBudget_ = cacheBudget;
+		[self applyCacheBudget];
+	}
+}
 
 #pragma mark -
 
@@ -29,70 +152,209 @@
 {
 	if ((self = [super initWithCoder: coder]) != nil)
 	{
- 		imageView_ = [[[UIImageView alloc] initWithFrame: CGRectMake(0, 0, self.frame.size.width, self.frame.size.height)] autorelease];
-		[self addSubview: imageView_];
+		// Frames are drawn with a copy over the part that changed, the rest
+		// of the backing store is still right
+
+		self.clearsContextBeforeDrawing = NO;
+		AnimationSinkInit(&viewSink_, AnimationViewSinkPresent, self);
 
-		framesPerSecond_ = 12.0;
-		frameBuffer_ = [[AnimationFrameBuffer alloc] initWithWidth: self.frame.size.width height: self.frame.size.height];
+		cacheBudget_ = AnimationViewDefaultCacheBudget;
+		colorSpace_ = CGColorSpaceCreateDeviceRGB();
 	}
 	return self;
 }
 
 - (void) dealloc
 {
+	[self stop];
+	[self releaseProviders];
+	CGColorSpaceRelease(colorSpace_);
+	[animation_ release];
 	[super dealloc];
 }
 
 #pragma mark -
 
-- (void) displayNextFrame: (NSTimer*) timer
+- (void) displayCanvas: (const AnimationCanvas*) canvas inRect: (CGRect) rect
 {
-	[animation_ drawFrame: frame_ intoFrameBuffer: frameBuffer_];
+	canvas_ = canvas;
+	[self setNeedsDisplayInRect: rect];
+}
 
-	frame_++;
-	if (frame_ == animation_.frameCount) {
-		frame_ = 0;
+- (void) drawRect: (CGRect) rect
+{
+	if (canvas_ == NULL || colorSpace_ == NULL) {
+		return;
 	}
 
-	// TODO: There must be a much better way to do this.
+	// The color space and the provider are cached. The image is a small
+	// object around the same pixels; UIKit clips drawing to the rectangle
+	// that was marked, so only those pixels are copied.
 
-	CGDataProviderRef provider = CGDataProviderCreateWithData(NULL, (const void*) frameBuffer_.pixels, self.frame.size.width*self.frame.size.height*4, NULL);
-	if (provider != NULL)
+	CGDataProviderRef provider = [self providerForCanvas: canvas_];
+	if (provider == NULL) {
+		return;
+	}
+
+	CGImageRef image = CGImageCreate(canvas_->width, canvas_->height, 8, 32, 4 * canvas_->width, colorSpace_, kCGImageAlphaPremultipliedLast, /*kCGImageAlphaNoneSkipLast,*/ provider, NULL, NO, kCGRenderingIntentDefault);
+	if (image != NULL)
 	{
-		CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
-		if (colorSpace != NULL)
-		{
-			CGImageRef image = CGImageCreate(self.frame.size.width, self.frame.size.height, 8, 32, 4 * self.frame.size.width, colorSpace, kCGImageAlphaPremultipliedLast, /*kCGImageAlphaNoneSkipLast,*/ provider, NULL, NO, kCGRenderingIntentDefault);
-			if (image != NULL)
-			{
-				imageView_.image = [UIImage imageWithCGImage: image];		
-				CGImageRelease(image);
-			}
-			
-			CGColorSpaceRelease(colorSpace);
-		}
+		// UIKit puts the origin at the top left, images are drawn bottom up
 
-		CGDataProviderRelease(provider);
+		CGContextRef context = UIGraphicsGetCurrentContext();
+		CGContextSaveGState(context);
+		CGContextTranslateCTM(context, 0, canvas_->height);
+		CGContextScaleCTM(context, 1.0, -1.0);
+		CGContextSetBlendMode(context, kCGBlendModeCopy);
+		CGContextDrawImage(context, CGRectMake(0, 0, canvas_->width, canvas_->height), image);
+		CGContextRestoreGState(context);
+
+		CGImageRelease(image);
+	}
+}
+
+- (void) showCanvas: (const AnimationCanvas*) canvas dirty: (const AnimationRect*) dirty
+{
+	ANIMATION_TRACE_BEGIN(presentStart);
+	AnimationSinkPresent((sink_ != NULL) ? sink_ : &viewSink_, canvas, dirty);
+	ANIMATION_TRACE_END(gAnimationViewTrace, AnimationTraceEventPresent, canvas->frame, presentStart);
+}
+
+
+- (void) presentCanvas: (const AnimationCanvas*) canvas dirty: (const AnimationRect*) dirty
+{
+	// Without a canvas the hub dropped the one on screen, the next frame
+	// comes whole
+
+	if (canvas == NULL) {
+		[self releaseProviders];
+		return;
+	}
+
+	[self showCanvas: canvas dirty: dirty];
+}
+
+- (void) setSink: (AnimationSink*) sink
+{
+	// Whatever was drawn while frames went elsewhere is out of date
+	sink_ = sink;
+	[self setNeedsDisplay];
+}
+
+- (AnimationSinkStatistics) sinkStatistics
+{
+	return ((sink_ != NULL) ? sink_ : &viewSink_)->statistics;
+}
+
+- (NSUInteger) underrunCount
+{
+	AnimationPrefetcherStatistics statistics = { 0 };
+	if (subscriber_ != NULL) {
+		AnimationHubGetPrefetcherStatistics(subscriber_, &statistics);
 	}
+	return (NSUInteger) statistics.underruns;
 }
 
 #pragma mark -
 
++ (void) displayNextFrames: (NSTimer*) timer
+{
+	AnimationHubTick(gAnimationViewHub, AnimationClockNow());
+}
+
++ (void) updateTimer
+{
+	// The hub works out which frames are due from the clock, the timer only
+	// has to check often enough: twice per frame of the fastest animation,
+	// but not faster than the screen refreshes.
+
+	uint32_t frameRate = AnimationHubGetFrameRate(gAnimationViewHub);
+
+	NSTimeInterval interval = 0;
+	if (frameRate != 0) {
+		interval = 0.5 / frameRate;
+		if (interval < 1.0 / 60.0) {
+			interval = 1.0 / 60.0;
+		}
+	}
+
+	if (gAnimationViewTimer != nil && [gAnimationViewTimer timeInterval] == interval) {
+		return;
+	}
+
+	[gAnimationViewTimer invalidate];
+	[gAnimationViewTimer release];
+	gAnimationViewTimer = nil;
+
+	if (interval != 0) {
+		gAnimationViewTimer = [[NSTimer scheduledTimerWithTimeInterval: interval target: self
+			selector: @selector(displayNextFrames:) userInfo: nil repeats: YES] retain];
+	}
+}
+
 - (void) start
 {
-	if (timer_ == nil) {
-		timer_ = [[NSTimer scheduledTimerWithTimeInterval: 1.0 / framesPerSecond_ target: self
-			selector: @selector(displayNextFrame:) userInfo: nil repeats: YES] retain];
+	AnimationHub* hub = AnimationViewSharedHub();
+
+	if (subscriber_ == NULL && animation_ != nil && hub != NULL)
+	{
+		AnimationHubSource source;
+		source.key = animation_;
+		source.width = animation_.width;
+		source.height = animation_.height;
+		source.frameCount = animation_.frameCount;
+		source.frameRate = animation_.frameRate;
+		source.decode = AnimationViewDecodeFrame;
+		source.context = animation_;
+
+		subscriber_ = AnimationHubSubscribe(hub, &source, AnimationViewPresentFrame, self);
+		[AnimationView updateTimer];
 	}
 }
 
 - (void) stop
 {
-	if (timer_ != nil) {
-		[timer_ invalidate];
-		[timer_ release];
-		timer_ = nil;
+	if (subscriber_ != NULL)
+	{
+		AnimationHubUnsubscribe(gAnimationViewHub, subscriber_);
+		subscriber_ = NULL;
+		[AnimationView updateTimer];
+
+		// The canvas on screen may have gone with the animation's channel
+		[self releaseProviders];
+	}
+}
+
+#if defined(ANIMATION_TRACE)
+
+#pragma mark -
+
+- (BOOL) writeTraceToFile: (NSString*) path
+{
+	AnimationViewSharedHub();
+	if (gAnimationViewTrace == NULL) {
+		return NO;
+	}
+
+	FILE* file = fopen([path fileSystemRepresentation], "w");
+	if (file == NULL) {
+		return NO;
+	}
+
+	AnimationStatus status;
+	if ([[path pathExtension] isEqualToString: @"csv"]) {
+		status = AnimationTraceWriteCSV(gAnimationViewTrace, file);
+	} else {
+		status = AnimationTraceWriteJSON(gAnimationViewTrace, file);
 	}
+
+	if (fclose(file) != 0) {
+		status = AnimationStatusIOError;
+	}
+
+	return status == AnimationStatusOK;
 }
 
+#endif
+
 @end
\ No newline at end of file
@@ -0,0 +1,329 @@
+/*
+ * (C) Copyright 2010, Stefan Arentz, Arentz Consulting Inc.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "AnimationContainerWriter.h"
+
+// Payloads at least this large skip the buffer
+#define AnimationContainerWriterBufferSize (256 * 1024)
+
+static const uint8_t kPadding[4] = { 0, 0, 0, 0 };
+
+AnimationContainerWriter::AnimationContainerWriter()
+    : fd_(-1), paletted_(false), frame_(0), indexOffset_(0), offset_(0), buffered_(0)
+{
+}
+
+AnimationContainerWriter::~AnimationContainerWriter()
+{
+    Abort();
+}
+
+bool AnimationContainerWriter::Fail(const char* message, bool useErrno)
+{
+    error_ = message;
+    if (useErrno) {
+        error_ += ": ";
+        error_ += strerror(errno);
+    }
+    return false;
+}
+
+bool AnimationContainerWriter::Open(const char* path, uint32_t width, uint32_t height, uint32_t frameRate, uint32_t frameCount,
+    const uint32_t* palette, uint32_t paletteCount)
+{
+    Abort();
+
+    if (width == 0 || height == 0 || width > UINT32_MAX / sizeof(AnimationPixel) / height) {
+        return Fail("Invalid container size", false);
+    }
+
+    if (paletteCount > AnimationContainerMaxPaletteCount || (palette == NULL && paletteCount != 0)) {
+        return Fail("Invalid palette", false);
+    }
+
+    path_ = path;
+    temporaryPath_ = path_ + ".XXXXXX";
+
+    std::vector<char> temporaryPath(temporaryPath_.begin(), temporaryPath_.end());
+    temporaryPath.push_back('\0');
+
+    fd_ = mkstemp(&temporaryPath[0]);
+    if (fd_ == -1) {
+        return Fail("Cannot create temporary file", true);
+    }
+    temporaryPath_ = &temporaryPath[0];
+
+    // mkstemp creates the file private to the user
+    fchmod(fd_, 0644);
+
+    header_.magic = 'anim';
+    header_.version = (palette != NULL) ? 3 : 2;
+    header_.width = width;
+    header_.height = height;
+    header_.frameRate = frameRate;
+    header_.frameCount = frameCount;
+    paletted_ = (palette != NULL);
+
+    buffer_.resize(AnimationContainerWriterBufferSize);
+    buffered_ = 0;
+    offset_ = 0;
+    frame_ = 0;
+
+    if (!Append(&header_, sizeof(header_))) {
+        return false;
+    }
+
+    if (paletted_) {
+        AnimationContainerPaletteHeader paletteHeader;
+        paletteHeader.count = paletteCount;
+        if (!Append(&paletteHeader, sizeof(paletteHeader)) || !Append(palette, paletteCount * sizeof(AnimationPixel))) {
+            return false;
+        }
+    }
+
+    // Reserve room for the frame index. It is filled in as images are
+    // written and stored by Commit once all offsets are known.
+
+    indexOffset_ = offset_;
+    index_.assign(frameCount, AnimationContainerIndexEntry());
+
+    for (uint32_t i = 0; i < frameCount; i++) {
+        if (!Append(&index_[i], sizeof(AnimationContainerIndexEntry))) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+bool AnimationContainerWriter::Validate(const AnimationContainerImageHeader& header)
+{
+    if (frame_ >= header_.frameCount) {
+        return Fail("More images than announced", false);
+    }
+
+    if (header.width > header_.width || header.xoffset > header_.width - header.width
+        || header.height > header_.height || header.yoffset > header_.height - header.height)
+    {
+        return Fail("Image does not fit in the container", false);
+    }
+
+    uint32_t pixelCount = header.width * header.height;
+
+    switch (header.format)
+    {
+        case AnimationContainerImageFormatPNG:
+        case AnimationContainerImageFormatRunLengthCompressedPixels:
+        case AnimationContainerImageFormatDeltaPixels:
+        case AnimationContainerImageFormatCompactRunLengthPixels:
+        case AnimationContainerImageFormatBandedRunLengthPixels:
+            break;
+
+        case AnimationContainerImageFormatUncompressedPixels:
+            if (header.dataLength != pixelCount * sizeof(AnimationPixel)) {
+                return Fail("Uncompressed image length does not match its size", false);
+            }
+            break;
+
+        case AnimationContainerImageFormatBlockCompressedPixels:
+            if (header.xoffset % AnimationPixelBlockSize != 0 || header.yoffset % AnimationPixelBlockSize != 0) {
+                return Fail("Block image does not start on a block", false);
+            }
+            if (header.dataLength != (uint64_t) ((header.width + 3) / 4) * ((header.height + 3) / 4) * AnimationPixelBlockLength) {
+                return Fail("Block image length does not match its size", false);
+            }
+            break;
+
+        case AnimationContainerImageFormatPalette8Pixels:
+        case AnimationContainerImageFormatPalette4Pixels:
+            if (!paletted_) {
+                return Fail("Palette image in a container without palette", false);
+            }
+            if (header.dataLength != ((header.format == AnimationContainerImageFormatPalette8Pixels) ? pixelCount : (pixelCount + 1) / 2)) {
+                return Fail("Palette image length does not match its size", false);
+            }
+            break;
+
+        default:
+            return Fail("Unknown image format", false);
+    }
+
+    if (offset_ + sizeof(header) + header.dataLength > UINT32_MAX) {
+        return Fail("Container larger than 4GB", false);
+    }
+
+    return true;
+}
+
+bool AnimationContainerWriter::WriteImage(const AnimationContainerImageHeader& header, const void* data)
+{
+    if (fd_ == -1) {
+        return Fail("Container is not open", false);
+    }
+
+    if (!Validate(header)) {
+        return false;
+    }
+
+    index_[frame_].offset = (uint32_t) offset_;
+    index_[frame_].length = sizeof(header) + header.dataLength;
+    frame_++;
+
+    if (!Append(&header, sizeof(header))) {
+        return false;
+    }
+
+    if (header.dataLength >= AnimationContainerWriterBufferSize) {
+        if (!Flush(data, header.dataLength)) {
+            return false;
+        }
+    } else if (!Append(data, header.dataLength)) {
+        return false;
+    }
+
+    return Append(kPadding, (4 - (header.dataLength % 4)) % 4);
+}
+
+bool AnimationContainerWriter::Append(const void* data, size_t length)
+{
+    if (length == 0) {
+        return true;
+    }
+
+    if (buffered_ + length > buffer_.size() && !Flush()) {
+        return false;
+    }
+
+    if (length > buffer_.size()) {
+        return Flush(data, length);
+    }
+
+    memcpy(&buffer_[buffered_], data, length);
+    buffered_ += length;
+    offset_ += length;
+
+    return true;
+}
+
+bool AnimationContainerWriter::Flush(const void* data, size_t length)
+{
+    // The buffer and an optional payload go out together in one writev
+
+    struct iovec iov[2];
+    int count = 0;
+
+    if (buffered_ != 0) {
+        iov[count].iov_base = &buffer_[0];
+        iov[count].iov_len = buffered_;
+        count++;
+    }
+
+    if (length != 0) {
+        iov[count].iov_base = const_cast<void*>(data);
+        iov[count].iov_len = length;
+        count++;
+    }
+
+    struct iovec* next = iov;
+    while (count != 0)
+    {
+        ssize_t written = writev(fd_, next, count);
+        if (written == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return Fail("Cannot write container", true);
+        }
+
+        while (count != 0 && (size_t) written >= next->iov_len) {
+            written -= next->iov_len;
+            next++;
+            count--;
+        }
+
+        if (count != 0) {
+            next->iov_base = (uint8_t*) next->iov_base + written;
+            next->iov_len -= written;
+        }
+    }
+
+    buffered_ = 0;
+    offset_ += length;
+
+    return true;
+}
+
+bool AnimationContainerWriter::Commit()
+{
+    if (fd_ == -1) {
+        return Fail("Container is not open", false);
+    }
+
+    if (frame_ != header_.frameCount) {
+        return Fail("Fewer images than announced", false);
+    }
+
+    if (!Flush()) {
+        return false;
+    }
+
+    size_t indexLength = index_.size() * sizeof(AnimationContainerIndexEntry);
+    if (indexLength != 0 && pwrite(fd_, &index_[0], indexLength, indexOffset_) != (ssize_t) indexLength) {
+        return Fail("Cannot write frame index", true);
+    }
+
+    if (fsync(fd_) == -1) {
+        return Fail("Cannot sync container", true);
+    }
+
+    if (close(fd_) == -1) {
+        fd_ = -1;
+        return Fail("Cannot close container", true);
+    }
+    fd_ = -1;
+
+    if (rename(temporaryPath_.c_str(), path_.c_str()) == -1) {
+        return Fail("Cannot rename container into place", true);
+    }
+
+    temporaryPath_.clear();
+
+    return true;
+}
+
+void AnimationContainerWriter::Abort()
+{
+    if (fd_ != -1) {
+        close(fd_);
+        fd_ = -1;
+    }
+
+    if (!temporaryPath_.empty()) {
+        unlink(temporaryPath_.c_str());
+        temporaryPath_.clear();
+    }
+}
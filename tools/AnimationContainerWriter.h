@@ -0,0 +1,88 @@
+/*
+ * (C) Copyright 2010, Stefan Arentz, Arentz Consulting Inc.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANIMATIONCONTAINERWRITER_H
+#define ANIMATIONCONTAINERWRITER_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "../src/AnimationCommon.h"
+
+//
+// Writes an animation container for the tools. Headers and small payloads
+// are collected in a buffer, large payloads go out with the buffer in one
+// writev(2) without being copied. Every image header is checked against the
+// container and its payload before anything is written.
+//
+// The container is written to a temporary file next to the destination and
+// only renamed over it by Commit, so a crashed or failed encode never leaves
+// a partial container behind. Destroying a writer that was not committed
+// removes the temporary file.
+//
+// All methods return false on failure; Error() says what went wrong.
+//
+
+class AnimationContainerWriter {
+public:
+    AnimationContainerWriter();
+    ~AnimationContainerWriter();
+
+    // Writes a version 2 container, or version 3 when a palette is given
+    bool Open(const char* path, uint32_t width, uint32_t height, uint32_t frameRate, uint32_t frameCount,
+        const uint32_t* palette = NULL, uint32_t paletteCount = 0);
+
+    // Appends the next image. data holds header.dataLength bytes; the
+    // padding to the next four byte boundary is added here.
+    bool WriteImage(const AnimationContainerImageHeader& header, const void* data);
+
+    // Writes the frame index, syncs and renames the file into place. All
+    // frames announced to Open must have been written.
+    bool Commit();
+
+    // Drops everything written so far
+    void Abort();
+
+    const char* Error() const { return error_.c_str(); }
+
+private:
+    bool Validate(const AnimationContainerImageHeader& header);
+    bool Append(const void* data, size_t length);
+    bool Flush(const void* data = NULL, size_t length = 0);
+    bool Fail(const char* message, bool useErrno);
+
+    std::string path_;
+    std::string temporaryPath_;
+    int fd_;
+
+    AnimationContainerGlobalHeader header_;
+    bool paletted_;
+
+    std::vector<AnimationContainerIndexEntry> index_;
+    uint32_t frame_;
+    uint64_t indexOffset_;
+    uint64_t offset_;
+
+    std::vector<uint8_t> buffer_;
+    size_t buffered_;
+
+    std::string error_;
+};
+
+#endif
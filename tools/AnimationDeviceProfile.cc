@@ -0,0 +1,235 @@
+/*
+ * (C) Copyright 2010, Stefan Arentz, Arentz Consulting Inc.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include "../src/AnimationCommon.h"
+#include "AnimationDeviceProfile.h"
+
+// Image formats are four character codes, written as such
+
+static std::string FormatName(uint32_t format)
+{
+    char name[5] = { (char) (format >> 24), (char) (format >> 16), (char) (format >> 8), (char) format, 0 };
+    return name;
+}
+
+static uint32_t FormatCode(const char* name)
+{
+    return ((uint32_t) (uint8_t) name[0] << 24) | ((uint32_t) (uint8_t) name[1] << 16) | ((uint32_t) (uint8_t) name[2] << 8) | (uint8_t) name[3];
+}
+
+bool AnimationReadDeviceProfile(const char* path, AnimationDeviceProfile& profile, std::string& error)
+{
+    FILE* file = fopen(path, "r");
+    if (file == NULL) {
+        error = "Cannot open profile";
+        return false;
+    }
+
+    profile.name = path;
+    profile.scale = 1.0;
+    profile.costs.clear();
+
+    char line[256];
+    int number = 0;
+    bool ok = true;
+
+    while (ok && fgets(line, sizeof(line), file) != NULL)
+    {
+        number++;
+
+        char key[64];
+        char value[128];
+        AnimationDecodeCost cost;
+
+        if (line[0] == '#' || sscanf(line, "%63s", key) != 1) {
+            continue;
+        }
+
+        if (strcmp(key, "name") == 0) {
+            ok = (sscanf(line, "%*s %127s", value) == 1);
+            if (ok) {
+                profile.name = value;
+            }
+        } else if (strcmp(key, "scale") == 0) {
+            ok = (sscanf(line, "%*s %lf", &profile.scale) == 1 && profile.scale > 0);
+        } else {
+            ok = (strlen(key) == 4 && sscanf(line, "%*s %lf %lf %lf", &cost.fixed, &cost.perPixel, &cost.perByte) == 3
+                && cost.fixed >= 0 && cost.perPixel >= 0 && cost.perByte >= 0);
+            if (ok) {
+                profile.costs[FormatCode(key)] = cost;
+            }
+        }
+
+        if (!ok) {
+            char message[64];
+            snprintf(message, sizeof(message), "Invalid line %d", number);
+            error = message;
+        }
+    }
+
+    fclose(file);
+    return ok;
+}
+
+bool AnimationWriteDeviceProfile(FILE* file, const AnimationDeviceProfile& profile)
+{
+    fprintf(file, "# format, nanoseconds per image, per pixel, per byte\n");
+    fprintf(file, "name %s\n", profile.name.c_str());
+    fprintf(file, "scale %g\n", profile.scale);
+
+    for (std::map<uint32_t, AnimationDecodeCost>::const_iterator c = profile.costs.begin(); c != profile.costs.end(); ++c) {
+        fprintf(file, "%s %.1f %.4f %.4f\n", FormatName(c->first).c_str(), c->second.fixed, c->second.perPixel, c->second.perByte);
+    }
+
+    return ferror(file) == 0;
+}
+
+double AnimationPredictDecodeTime(const AnimationDeviceProfile& profile, uint32_t format, uint32_t width, uint32_t height, uint32_t length)
+{
+    std::map<uint32_t, AnimationDecodeCost>::const_iterator c = profile.costs.find(format);
+    if (c == profile.costs.end()) {
+        return INFINITY;
+    }
+
+    const AnimationDecodeCost& cost = c->second;
+    return profile.scale * (cost.fixed + cost.perPixel * width * height + cost.perByte * length);
+}
+
+// Solves the normal equations for the terms in use. Returns false if they
+// are singular, like pixels and bytes of uncompressed images, or if a term
+// comes out negative.
+
+static bool FitTerms(const std::vector<AnimationDecodeSample>& samples, const bool use[3], double coefficients[3])
+{
+    double a[3][4] = { { 0 } };
+
+    for (size_t s = 0; s < samples.size(); s++)
+    {
+        // Relative errors count, so small images are fitted as well as big ones
+
+        double weight = 1.0 / std::max(samples[s].time * samples[s].time, 1.0);
+        double x[3] = { 1.0, (double) samples[s].pixels, (double) samples[s].bytes };
+        for (int i = 0; i < 3; i++) {
+            for (int j = 0; j < 3; j++) {
+                a[i][j] += weight * x[i] * x[j];
+            }
+            a[i][3] += weight * x[i] * samples[s].time;
+        }
+    }
+
+    // Unused terms are pinned to 0
+
+    for (int i = 0; i < 3; i++) {
+        if (!use[i]) {
+            for (int j = 0; j < 3; j++) {
+                a[i][j] = 0;
+                a[j][i] = 0;
+            }
+            a[i][i] = 1;
+            a[i][3] = 0;
+        }
+    }
+
+    // Gauss-Jordan with partial pivoting
+
+    for (int column = 0; column < 3; column++)
+    {
+        int pivot = column;
+        for (int row = column + 1; row < 3; row++) {
+            if (fabs(a[row][column]) > fabs(a[pivot][column])) {
+                pivot = row;
+            }
+        }
+
+        double scale = 0;
+        for (int row = 0; row < 3; row++) {
+            scale = std::max(scale, fabs(a[row][column]));
+        }
+        if (fabs(a[pivot][column]) <= scale * 1e-12 || a[pivot][column] == 0) {
+            return false;
+        }
+
+        for (int j = 0; j < 4; j++) {
+            std::swap(a[column][j], a[pivot][j]);
+        }
+
+        for (int row = 0; row < 3; row++) {
+            if (row != column) {
+                double factor = a[row][column] / a[column][column];
+                for (int j = 0; j < 4; j++) {
+                    a[row][j] -= factor * a[column][j];
+                }
+            }
+        }
+    }
+
+    for (int i = 0; i < 3; i++) {
+        coefficients[i] = use[i] ? a[i][3] / a[i][i] : 0;
+        if (coefficients[i] < 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+AnimationDecodeCost AnimationFitDecodeCost(const std::vector<AnimationDecodeSample>& samples)
+{
+    // Of the fits without negative terms the one closest to the samples
+
+    static const bool subsets[][3] = {
+        { true, true, true },
+        { true, true, false },
+        { true, false, true },
+        { false, true, true },
+        { false, true, false },
+        { false, false, true },
+        { true, false, false },
+    };
+
+    AnimationDecodeCost cost = { 0, 0, 0 };
+    double best = INFINITY;
+
+    for (size_t s = 0; s < sizeof(subsets) / sizeof(subsets[0]); s++)
+    {
+        double coefficients[3];
+        if (!FitTerms(samples, subsets[s], coefficients)) {
+            continue;
+        }
+
+        double error = 0;
+        for (size_t i = 0; i < samples.size(); i++) {
+            double fitted = coefficients[0] + coefficients[1] * samples[i].pixels + coefficients[2] * samples[i].bytes;
+            double relative = (fitted - samples[i].time) / std::max(samples[i].time, 1.0);
+            error += relative * relative;
+        }
+
+        if (error < best) {
+            best = error;
+            cost.fixed = coefficients[0];
+            cost.perPixel = coefficients[1];
+            cost.perByte = coefficients[2];
+        }
+    }
+
+    return cost;
+}
@@ -0,0 +1,79 @@
+/*
+ * (C) Copyright 2010, Stefan Arentz, Arentz Consulting Inc.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANIMATIONDEVICEPROFILE_H
+#define ANIMATIONDEVICEPROFILE_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <map>
+#include <string>
+#include <vector>
+
+//
+// Predicts how long a device takes to decode an image. Every image format
+// gets a linear model: a fixed cost per image, a cost per pixel of the
+// image's rectangle and a cost per byte of its data. Run-length formats
+// scale with their bytes, uncompressed and block formats with their pixels,
+// so three terms are enough to rank formats against each other.
+//
+// A profile is a text file with one line per format, as written by
+// AnimationWriteDeviceProfile:
+//
+//   name iphone-3g
+//   scale 8
+//   rlen 1500 0.8 0.4
+//
+// Times are in nanoseconds. scale multiplies every prediction, so a profile
+// measured on one machine can stand in for a device that is so much slower.
+// Lines starting with # are comments.
+//
+
+struct AnimationDecodeCost {
+    double fixed;       // Nanoseconds per image
+    double perPixel;    // Nanoseconds per pixel of the image rectangle
+    double perByte;     // Nanoseconds per byte of image data
+};
+
+struct AnimationDeviceProfile {
+    std::string name;
+    double scale;
+    std::map<uint32_t, AnimationDecodeCost> costs;
+};
+
+// One measured decode, for fitting a cost
+struct AnimationDecodeSample {
+    uint32_t pixels;
+    uint32_t bytes;
+    double time;
+};
+
+bool AnimationReadDeviceProfile(const char* path, AnimationDeviceProfile& profile, std::string& error);
+bool AnimationWriteDeviceProfile(FILE* file, const AnimationDeviceProfile& profile);
+
+// Predicted nanoseconds for a width x height image of length bytes. Formats
+// the profile does not know take forever, so they never meet a deadline.
+double AnimationPredictDecodeTime(const AnimationDeviceProfile& profile, uint32_t format, uint32_t width, uint32_t height, uint32_t length);
+
+// Least squares fit of the samples, by their relative error. Terms that would
+// come out negative are left out, so the cost never goes down with more
+// pixels or bytes.
+AnimationDecodeCost AnimationFitDecodeCost(const std::vector<AnimationDecodeSample>& samples);
+
+#endif
@@ -0,0 +1,157 @@
+/*
+ * (C) Copyright 2010, Stefan Arentz, Arentz Consulting Inc.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "AnimationImageReader.h"
+
+#if defined(__APPLE__)
+
+#include <ApplicationServices/ApplicationServices.h>
+
+static bool ReadPNGImage(CGDataProviderRef provider, uint32_t* pixels, int width, int height, std::string& error)
+{
+    memset(pixels, 0x00, width * height * sizeof(uint32_t));
+
+    if (provider == NULL) {
+        error = "Cannot open image";
+        return false;
+    }
+
+    CGImageRef image = CGImageCreateWithPNGDataProvider(provider, NULL, false, kCGRenderingIntentDefault);
+    CFRelease(provider);
+
+    if (image == NULL) {
+        error = "Not a PNG image";
+        return false;
+    }
+
+    if (CGImageGetWidth(image) != (size_t) width || CGImageGetHeight(image) != (size_t) height) {
+        CGImageRelease(image);
+        error = "Image has the wrong size";
+        return false;
+    }
+
+    // Draw the image straight into pixels
+
+    CGContextRef context = CGBitmapContextCreate(
+        (void*) pixels,
+        width,
+        height,
+        8,                             // Bits per component
+        width * 4,                     // Bytes per row
+        CGImageGetColorSpace(image),
+        kCGImageAlphaPremultipliedLast // RRRRRRRRRGGGGGGGGBBBBBBBBAAAAAAAA
+    );
+
+    if (context == NULL) {
+        CGImageRelease(image);
+        error = "Cannot create bitmap context";
+        return false;
+    }
+
+    CGContextDrawImage(context, CGRectMake(0.0f, 0.0f, width, height), image);
+    CGContextRelease(context);
+    CGImageRelease(image);
+
+    return true;
+}
+
+bool AnimationReadPNGImage(const char* path, uint32_t* pixels, int width, int height, std::string& error)
+{
+    return ReadPNGImage(CGDataProviderCreateWithFilename(path), pixels, width, height, error);
+}
+
+bool AnimationReadPNGData(const void* data, size_t length, uint32_t* pixels, int width, int height, std::string& error)
+{
+    return ReadPNGImage(CGDataProviderCreateWithData(NULL, data, length, NULL), pixels, width, height, error);
+}
+
+#else
+
+#include <png.h>
+
+// Finishes reading an image whose header has been read
+
+static bool ReadPNGImage(png_image& image, uint32_t* pixels, int width, int height, std::string& error)
+{
+    if (image.width != (png_uint_32) width || image.height != (png_uint_32) height) {
+        png_image_free(&image);
+        error = "Image has the wrong size";
+        return false;
+    }
+
+    // libpng converts any PNG, grey, palette or 16-bit, to 8-bit RGBA as it
+    // decodes, writing the rows directly into pixels
+
+    image.format = PNG_FORMAT_RGBA;
+
+    if (!png_image_finish_read(&image, NULL, pixels, width * 4, NULL)) {
+        error = image.message;
+        png_image_free(&image);
+        return false;
+    }
+
+    // PNG alpha is straight, AnimationPixel is premultiplied
+
+    uint8_t* p = (uint8_t*) pixels;
+    for (int i = 0; i < width * height; i++, p += 4)
+    {
+        uint32_t a = p[3];
+        if (a == 0) {
+            p[0] = p[1] = p[2] = 0;
+        } else if (a != 255) {
+            p[0] = (uint8_t) ((p[0] * a + 127) / 255);
+            p[1] = (uint8_t) ((p[1] * a + 127) / 255);
+            p[2] = (uint8_t) ((p[2] * a + 127) / 255);
+        }
+    }
+
+    return true;
+}
+
+bool AnimationReadPNGImage(const char* path, uint32_t* pixels, int width, int height, std::string& error)
+{
+    png_image image;
+    memset(&image, 0, sizeof(image));
+    image.version = PNG_IMAGE_VERSION;
+
+    if (!png_image_begin_read_from_file(&image, path)) {
+        error = image.message;
+        return false;
+    }
+
+    return ReadPNGImage(image, pixels, width, height, error);
+}
+
+bool AnimationReadPNGData(const void* data, size_t length, uint32_t* pixels, int width, int height, std::string& error)
+{
+    png_image image;
+    memset(&image, 0, sizeof(image));
+    image.version = PNG_IMAGE_VERSION;
+
+    if (!png_image_begin_read_from_memory(&image, data, length)) {
+        error = image.message;
+        return false;
+    }
+
+    return ReadPNGImage(image, pixels, width, height, error);
+}
+
+#endif
@@ -0,0 +1,42 @@
+/*
+ * (C) Copyright 2010, Stefan Arentz, Arentz Consulting Inc.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANIMATIONIMAGEREADER_H
+#define ANIMATIONIMAGEREADER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string>
+
+//
+// Reads the PNG at path into a width x height buffer of premultiplied RGBA
+// pixels, the layout AnimationPixel expects. Fails if the file can not be
+// read or has a different size; error then says why.
+//
+// On Mac OS X this goes through CoreGraphics. Everywhere else libpng decodes
+// the rows straight into pixels, which are then premultiplied in place. It
+// keeps no state between calls, so threads can read images concurrently.
+//
+
+bool AnimationReadPNGImage(const char* path, uint32_t* pixels, int width, int height, std::string& error);
+
+// Same for a PNG that is already in memory, like a 'ping' frame
+bool AnimationReadPNGData(const void* data, size_t length, uint32_t* pixels, int width, int height, std::string& error);
+
+#endif
@@ -0,0 +1,128 @@
+/*
+ * (C) Copyright 2010, Stefan Arentz, Arentz Consulting Inc.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <algorithm>
+#include "AnimationImageWriter.h"
+
+#if defined(__APPLE__)
+
+#include <ApplicationServices/ApplicationServices.h>
+
+bool AnimationWritePNGData(const uint32_t* pixels, int width, int height, std::vector<uint8_t>& png, std::string& error)
+{
+    if (width <= 0 || height <= 0) {
+        error = "Image is empty";
+        return false;
+    }
+
+    // ImageIO takes premultiplied pixels as they are and writes straight alpha
+
+    CGDataProviderRef provider = CGDataProviderCreateWithData(NULL, pixels, width * height * sizeof(uint32_t), NULL);
+    CGColorSpaceRef colorSpace = CGColorSpaceCreateDeviceRGB();
+    CGImageRef image = NULL;
+    if (provider != NULL && colorSpace != NULL) {
+        image = CGImageCreate(width, height, 8, 32, width * 4, colorSpace, kCGImageAlphaPremultipliedLast, provider, NULL, false, kCGRenderingIntentDefault);
+    }
+    CGColorSpaceRelease(colorSpace);
+    CGDataProviderRelease(provider);
+
+    if (image == NULL) {
+        error = "Cannot create image";
+        return false;
+    }
+
+    CFMutableDataRef data = CFDataCreateMutable(NULL, 0);
+    CGImageDestinationRef destination = (data != NULL) ? CGImageDestinationCreateWithData(data, CFSTR("public.png"), 1, NULL) : NULL;
+
+    bool written = false;
+    if (destination != NULL) {
+        CGImageDestinationAddImage(destination, image, NULL);
+        written = CGImageDestinationFinalize(destination);
+        CFRelease(destination);
+    }
+    CGImageRelease(image);
+
+    if (written) {
+        png.assign(CFDataGetBytePtr(data), CFDataGetBytePtr(data) + CFDataGetLength(data));
+    } else {
+        error = "Cannot encode image";
+    }
+
+    if (data != NULL) {
+        CFRelease(data);
+    }
+
+    return written;
+}
+
+#else
+
+#include <png.h>
+
+bool AnimationWritePNGData(const uint32_t* pixels, int width, int height, std::vector<uint8_t>& png, std::string& error)
+{
+    if (width <= 0 || height <= 0) {
+        error = "Image is empty";
+        return false;
+    }
+
+    // AnimationPixel is premultiplied, PNG alpha is straight. Color never
+    // exceeds alpha, so rounding both ways gives back the same pixels.
+
+    std::vector<uint32_t> straight(pixels, pixels + width * height);
+
+    uint8_t* p = (uint8_t*) &straight[0];
+    for (int i = 0; i < width * height; i++, p += 4)
+    {
+        uint32_t a = p[3];
+        if (a != 0 && a != 255) {
+            p[0] = (uint8_t) std::min<uint32_t>((p[0] * 255 + a / 2) / a, 255);
+            p[1] = (uint8_t) std::min<uint32_t>((p[1] * 255 + a / 2) / a, 255);
+            p[2] = (uint8_t) std::min<uint32_t>((p[2] * 255 + a / 2) / a, 255);
+        }
+    }
+
+    png_image image;
+    memset(&image, 0, sizeof(image));
+    image.version = PNG_IMAGE_VERSION;
+    image.width = width;
+    image.height = height;
+    image.format = PNG_FORMAT_RGBA;
+
+    // The first call only works out how large the PNG is
+
+    png_alloc_size_t length = 0;
+    if (!png_image_write_to_memory(&image, NULL, &length, 0, &straight[0], width * 4, NULL)) {
+        error = image.message;
+        return false;
+    }
+
+    png.resize(length);
+    if (!png_image_write_to_memory(&image, &png[0], &length, 0, &straight[0], width * 4, NULL)) {
+        error = image.message;
+        return false;
+    }
+    png.resize(length);
+
+    return true;
+}
+
+#endif
@@ -0,0 +1,39 @@
+/*
+ * (C) Copyright 2010, Stefan Arentz, Arentz Consulting Inc.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANIMATIONIMAGEWRITER_H
+#define ANIMATIONIMAGEWRITER_H
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+
+//
+// Encodes width x height premultiplied RGBA pixels as a PNG in memory, for
+// 'ping' frames. PNG alpha is straight, so pixels are divided by alpha on
+// the way out; reading the PNG back with AnimationReadPNGData gives exactly
+// the same pixels. Fails for an empty image; error then says why.
+//
+// On Mac OS X this goes through ImageIO, everywhere else through libpng. It
+// keeps no state between calls, so threads can write images concurrently.
+//
+
+bool AnimationWritePNGData(const uint32_t* pixels, int width, int height, std::vector<uint8_t>& png, std::string& error);
+
+#endif
@@ -0,0 +1,1310 @@
+/*
+ * (C) Copyright 2010, Stefan Arentz, Arentz Consulting Inc.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// animtool.cc - inspects, transcodes and verifies animation containers.
+//
+//   usage: animtool inspect [-f] container*
+//          animtool transcode [options] source destination
+//          animtool transcode [options] -d directory source*
+//          animtool verify [-t max-error] container [original]
+//          animtool profile [-n name] [-s scale] [-o profile]
+//
+//   inspect prints the header of each container and how many frames and
+//     bytes each image format takes, with -f also every frame.
+//
+//   transcode decodes every frame of the source and stores it again in the
+//     encoding that suits it best. frames are decoded in order and encoded
+//     on a pool of worker threads; at most two frames per worker are in
+//     flight, so memory does not grow with the length of the animation.
+//     with -d every source is written to a file of the same name in
+//     directory, which may be where the sources are.
+//
+//     -e list      comma separated encodings to pick from for every frame,
+//                  defaults to rlen,rle2,rleb,pixl. also pal8, pal4 and
+//                  ping. pal8 and pal4 keep the palette of the source and
+//                  are skipped for frames with other colors. the lossy
+//                  rle2-565, rle2-4444 and dxt5 have to be the only one
+//     -p policy    smallest (default) keeps the encoding with the fewest
+//                  bytes, fastest the one that decodes fastest here
+//     -P profile   predict decode times with a device profile instead of
+//                  measuring them here. smallest then keeps the smallest
+//                  encoding that decodes within the deadline, and the
+//                  fastest one for frames where none does
+//     -D deadline  microseconds a frame may take to decode, defaults to
+//                  the frame period
+//     -R report    write the predicted decode time of every frame and the
+//                  worst one of every animation to report, as json
+//     -k interval  also try a delta of the previous frame, except for a
+//                  keyframe every interval frames
+//     -b rows      band height for rleb, defaults to 32
+//     -r rate      frame rate, defaults to that of the source
+//     -j jobs      number of worker threads, defaults to the number of cpus
+//     -n           skip decoding every frame again to check it
+//
+//   verify decodes every frame of a container in order and on its own,
+//     from its keyframe, and checks that both give the same pixels. with an
+//     original every frame is compared to it instead and may differ by up
+//     to max-error per channel, 0 unless given.
+//
+//   profile times decoding synthetic frames of every format on this machine
+//     and fits a device profile to it, see AnimationDeviceProfile.h. -s
+//     sets its scale, for a device that is that much slower than this one.
+//
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+#include "../src/AnimationClock.h"
+#include "../src/AnimationCommon.h"
+#include "../src/AnimationCompression.h"
+#include "../src/AnimationContainer.h"
+#include "../src/AnimationDecoder.h"
+#include "../src/AnimationPlayer.h"
+#include "AnimationContainerWriter.h"
+#include "AnimationDeviceProfile.h"
+#include "AnimationImageReader.h"
+#include "AnimationImageWriter.h"
+
+struct Encoding {
+    const char* name;
+    uint32_t format;
+    AnimationPixelMode pixelMode;
+    bool lossy;
+};
+
+static const Encoding gEncodings[] = {
+    { "pixl",      AnimationContainerImageFormatUncompressedPixels,        AnimationPixelModeRGBA8888, false },
+    { "rlen",      AnimationContainerImageFormatRunLengthCompressedPixels, AnimationPixelModeRGBA8888, false },
+    { "rleb",      AnimationContainerImageFormatBandedRunLengthPixels,     AnimationPixelModeRGBA8888, false },
+    { "rle2",      AnimationContainerImageFormatCompactRunLengthPixels,    AnimationPixelModeRGBA8888, false },
+    { "rle2-565",  AnimationContainerImageFormatCompactRunLengthPixels,    AnimationPixelModeRGB565,   true  },
+    { "rle2-4444", AnimationContainerImageFormatCompactRunLengthPixels,    AnimationPixelModeRGBA4444, true  },
+    { "pal8",      AnimationContainerImageFormatPalette8Pixels,            AnimationPixelModeRGBA8888, false },
+    { "pal4",      AnimationContainerImageFormatPalette4Pixels,            AnimationPixelModeRGBA8888, false },
+    { "dxt5",      AnimationContainerImageFormatBlockCompressedPixels,     AnimationPixelModeRGBA8888, true  },
+    { "ping",      AnimationContainerImageFormatPNG,                       AnimationPixelModeRGBA8888, false },
+};
+
+struct Options {
+    std::vector<const Encoding*> encodings;
+    bool fastest;
+    const AnimationDeviceProfile* profile;
+    double deadline;                    // Nanoseconds, 0 for the frame period
+    int keyframeInterval;
+    uint32_t bandHeight;
+    uint32_t frameRate;
+    int jobs;
+    bool check;
+};
+
+// What encoding and decoding an image needs besides its pixels
+
+struct ImageCodec {
+    uint32_t width;                     // Of the whole frame, the stride of its pixels
+    uint32_t height;
+    const uint32_t* palette;            // Padded with zeros to AnimationContainerMaxPaletteCount
+    uint32_t paletteCount;
+    uint32_t bandHeight;
+};
+
+// A frame slot in the transcoder window. The frame is decoded into it in
+// order, a worker encodes it and the writer drains it.
+
+struct TranscoderFrame {
+    std::vector<uint32_t> pixels;       // The frame as the player will show it
+    std::vector<uint32_t> previous;     // The frame before it, the same way
+    std::vector<uint32_t> data;         // The image that was picked
+    AnimationContainerImageHeader header;
+    double predicted;                   // Its decode time with the device profile
+    std::string error;
+    bool done;
+};
+
+struct Transcoder {
+    const Options* options;
+    const char* path;
+    uint32_t width;
+    uint32_t height;
+    uint32_t frameCount;
+    ImageCodec codec;
+    double deadline;                    // Nanoseconds a frame may take to decode
+    const Encoding* lossy;              // The only encoding, when it is lossy
+
+    AnimationContainer container;
+    AnimationDecoder decoder;
+    AnimationCanvas canvas;
+    std::vector<uint32_t> canvasPixels;
+
+    int windowSize;
+    std::vector<TranscoderFrame> frames;
+
+    pthread_mutex_t lock;
+    pthread_cond_t frameDone;
+    pthread_cond_t frameWritten;
+    uint32_t nextFrame;
+    uint32_t writtenFrames;
+};
+
+// The worst case is a run per pixel, plus the band table of rleb with a band
+// per row
+
+static uint32_t CompressedBufferSize(uint32_t width, uint32_t height)
+{
+    return (width * height * 2 + height + 2) * sizeof(uint32_t);
+}
+
+static std::string FormatName(uint32_t format)
+{
+    char name[5] = { (char) (format >> 24), (char) (format >> 16), (char) (format >> 8), (char) format, 0 };
+    return name;
+}
+
+// Decodes 'ping' frames for the decoder, the only format it leaves to us
+
+static AnimationStatus DecodePNGImage(void* context, const AnimationContainerImageHeader* header, const void* data, AnimationCanvas* canvas)
+{
+    if (header->format != AnimationContainerImageFormatPNG) {
+        return AnimationStatusUnsupportedFormat;
+    }
+
+    std::vector<uint32_t> pixels(header->width * header->height);
+    std::string error;
+    if (pixels.empty() || !AnimationReadPNGData(data, header->dataLength, &pixels[0], header->width, header->height, error)) {
+        return AnimationStatusInvalidHeader;
+    }
+
+    for (uint32_t y = 0; y < header->height; y++) {
+        memcpy(canvas->pixels + (header->yoffset + y) * canvas->width + header->xoffset, &pixels[y * header->width],
+            header->width * sizeof(uint32_t));
+    }
+
+    return AnimationStatusOK;
+}
+
+static bool OpenContainer(const char* path, AnimationContainer* container, AnimationDecoder* decoder)
+{
+    AnimationStatus status = AnimationContainerOpenFile(container, path);
+    if (status != AnimationStatusOK) {
+        fprintf(stderr, "Cannot open %s (status %d)\n", path, status);
+        return false;
+    }
+
+    AnimationDecoderInit(decoder, container, DecodePNGImage, NULL);
+    return true;
+}
+
+// Block compression is lossy. Frames are compressed whole, on the canvas's
+// block grid, and replaced by what the decoder makes of that, like rle does.
+
+static void RoundToBlocks(uint32_t* pixels, uint8_t* blocks, uint32_t width, uint32_t height)
+{
+    uint32_t length = AnimationBlockCompressedLength(width, height);
+    AnimationCompressBlockPixels(blocks, length, pixels, width, height);
+    AnimationDecompressBlockPixelsRect(pixels, width, width, height, blocks, length);
+}
+
+// Grows rect to whole blocks, except where it ends at the edge of the image
+
+static void AlignToBlocks(AnimationRect* rect, uint32_t width, uint32_t height)
+{
+    if (rect->width == 0 || rect->height == 0) {
+        return;
+    }
+
+    uint32_t right = std::min((rect->x + rect->width + 3) & ~3u, width);
+    uint32_t bottom = std::min((rect->y + rect->height + 3) & ~3u, height);
+
+    rect->x &= ~3u;
+    rect->y &= ~3u;
+    rect->width = right - rect->x;
+    rect->height = bottom - rect->y;
+}
+
+// Decodes an image into pixels, a whole frame. A delta goes on top of what
+// pixels hold, everything else only writes its rectangle.
+
+static bool DecodeImage(const ImageCodec* codec, const AnimationContainerImageHeader& header, const uint32_t* data, uint32_t* pixels)
+{
+    uint32_t stride = codec->width;
+    uint32_t* origin = pixels + header.yoffset * stride + header.xoffset;
+    AnimationStatus status = AnimationStatusOK;
+
+    switch (header.format)
+    {
+        case AnimationContainerImageFormatUncompressedPixels:
+            for (uint32_t y = 0; y < header.height; y++) {
+                memcpy(origin + y * stride, data + y * header.width, header.width * sizeof(uint32_t));
+            }
+            break;
+        case AnimationContainerImageFormatRunLengthCompressedPixels:
+            status = AnimationDecompressRunLengthEncodedPixelsRect(origin, stride, header.width, header.height, data, header.dataLength);
+            break;
+        case AnimationContainerImageFormatBandedRunLengthPixels:
+            status = AnimationDecompressBandedRunLengthPixelsRect(origin, stride, header.width, header.height, data, header.dataLength);
+            break;
+        case AnimationContainerImageFormatDeltaPixels:
+            status = AnimationDecompressDeltaPixelsRect(origin, stride, header.width, header.height, data, header.dataLength);
+            break;
+        case AnimationContainerImageFormatCompactRunLengthPixels:
+            status = AnimationDecompressCompactRunLengthPixelsRect(origin, stride, header.width, header.height,
+                (const uint8_t*) data, header.dataLength);
+            break;
+        case AnimationContainerImageFormatPalette8Pixels:
+        case AnimationContainerImageFormatPalette4Pixels:
+            status = AnimationDecompressPalettePixelsRect(origin, stride, header.width, header.height, (const uint8_t*) data,
+                header.dataLength, codec->palette, (header.format == AnimationContainerImageFormatPalette8Pixels) ? 8 : 4);
+            break;
+        case AnimationContainerImageFormatBlockCompressedPixels:
+            status = AnimationDecompressBlockPixelsRect(origin, stride, header.width, header.height, (const uint8_t*) data, header.dataLength);
+            break;
+        case AnimationContainerImageFormatPNG:
+        {
+            AnimationCanvas canvas;
+            AnimationCanvasInit(&canvas, pixels, codec->width, codec->height);
+            status = DecodePNGImage(NULL, &header, data, &canvas);
+            break;
+        }
+        default:
+            status = AnimationStatusUnsupportedFormat;
+            break;
+    }
+
+    return status == AnimationStatusOK;
+}
+
+// Stores the cropped pixels of rect in data with one encoding. Returns the
+// length in bytes, or UINT32_MAX if the encoding can not store them.
+
+static uint32_t EncodeImage(const ImageCodec* codec, const Encoding* encoding, const uint32_t* cropped, const AnimationRect& rect,
+    const uint8_t* blocks, uint32_t* data, uint32_t capacity)
+{
+    uint32_t count = rect.width * rect.height;
+
+    switch (encoding->format)
+    {
+        case AnimationContainerImageFormatUncompressedPixels:
+            memcpy(data, cropped, count * sizeof(uint32_t));
+            return count * sizeof(uint32_t);
+        case AnimationContainerImageFormatRunLengthCompressedPixels:
+            return AnimationCompressRunLengthEncodedPixels(data, (uint32_t*) cropped, count);
+        case AnimationContainerImageFormatBandedRunLengthPixels:
+            return AnimationCompressBandedRunLengthPixels(data, capacity, cropped, rect.width, rect.height, codec->bandHeight);
+        case AnimationContainerImageFormatCompactRunLengthPixels:
+            return AnimationCompressCompactRunLengthPixels((uint8_t*) data, capacity, cropped, count, encoding->pixelMode);
+        case AnimationContainerImageFormatPalette8Pixels:
+        case AnimationContainerImageFormatPalette4Pixels:
+            return AnimationCompressPalettePixels((uint8_t*) data, capacity, cropped, count, codec->palette,
+                codec->paletteCount, (encoding->format == AnimationContainerImageFormatPalette8Pixels) ? 8 : 4);
+        case AnimationContainerImageFormatBlockCompressedPixels:
+        {
+            // The blocks of the rect, copied out of the blocks of the frame
+
+            uint32_t blocksPerRow = (codec->width + 3) / 4;
+            uint32_t columns = (rect.width + 3) / 4;
+            uint32_t rows = (rect.height + 3) / 4;
+
+            for (uint32_t y = 0; y < rows; y++) {
+                memcpy((uint8_t*) data + y * columns * AnimationPixelBlockLength,
+                    blocks + ((rect.y / 4 + y) * blocksPerRow + rect.x / 4) * AnimationPixelBlockLength, columns * AnimationPixelBlockLength);
+            }
+            return rows * columns * AnimationPixelBlockLength;
+        }
+        case AnimationContainerImageFormatPNG:
+        {
+            std::vector<uint8_t> png;
+            std::string error;
+            if (!AnimationWritePNGData(cropped, rect.width, rect.height, png, error) || png.size() > capacity) {
+                return UINT32_MAX;
+            }
+            memcpy(data, &png[0], png.size());
+            return png.size();
+        }
+    }
+
+    return UINT32_MAX;
+}
+
+// Best of a few runs, so a single preemption does not decide the format
+
+static uint64_t MeasureDecode(const ImageCodec* codec, const AnimationContainerImageHeader& header, const uint32_t* data,
+    const uint32_t* previous, uint32_t* scratch)
+{
+    uint64_t best = UINT64_MAX;
+
+    for (int run = 0; run < 3; run++)
+    {
+        memcpy(scratch, previous, codec->width * codec->height * sizeof(uint32_t));
+
+        uint64_t start = AnimationClockNow();
+        DecodeImage(codec, header, data, scratch);
+        best = std::min(best, AnimationClockNow() - start);
+    }
+
+    return best;
+}
+
+struct WorkerBuffers {
+    std::vector<uint32_t> cropped;
+    std::vector<uint32_t> croppedPrevious;
+    std::vector<uint32_t> scratch;
+    std::vector<uint32_t> candidate;
+    std::vector<uint8_t> blocks;
+};
+
+// The image a frame has so far
+
+struct FrameChoice {
+    bool found;
+    bool meetsDeadline;
+    uint32_t length;
+    double predicted;       // Nanoseconds on the device of the profile
+    uint64_t measured;      // Nanoseconds here
+};
+
+// Keeps the candidate in the frame if it is better than what it has. With a
+// device profile the smallest image that meets the deadline wins, or the
+// fastest one as long as none does. Without one the fastest policy goes by
+// decoding the candidate here.
+
+static void OfferImage(const Transcoder* transcoder, TranscoderFrame* frame, FrameChoice* choice, uint32_t format, const AnimationRect& rect,
+    uint32_t length, WorkerBuffers* buffers)
+{
+    if (length == UINT32_MAX) {
+        return;
+    }
+
+    const Options* options = transcoder->options;
+
+    AnimationContainerImageHeader header;
+    header.width = rect.width;
+    header.height = rect.height;
+    header.xoffset = rect.x;
+    header.yoffset = rect.y;
+    header.format = format;
+    header.dataLength = length;
+
+    double predicted = 0;
+    uint64_t measured = 0;
+    if (options->profile != NULL) {
+        predicted = AnimationPredictDecodeTime(*options->profile, format, rect.width, rect.height, length);
+    } else if (options->fastest) {
+        measured = MeasureDecode(&transcoder->codec, header, &buffers->candidate[0], &frame->previous[0], &buffers->scratch[0]);
+    }
+
+    bool meetsDeadline = (predicted <= transcoder->deadline);
+    bool better;
+
+    if (!choice->found) {
+        better = true;
+    } else if (options->profile != NULL && options->fastest) {
+        better = (predicted < choice->predicted);
+    } else if (options->profile != NULL && meetsDeadline != choice->meetsDeadline) {
+        better = meetsDeadline;
+    } else if (options->profile != NULL && !meetsDeadline) {
+        better = (predicted < choice->predicted);
+    } else if (options->fastest) {
+        better = (measured < choice->measured);
+    } else {
+        better = (length < choice->length);
+    }
+
+    if (better) {
+        choice->found = true;
+        choice->meetsDeadline = meetsDeadline;
+        choice->length = length;
+        choice->predicted = predicted;
+        choice->measured = measured;
+
+        frame->header = header;
+        frame->predicted = predicted;
+        frame->data.swap(buffers->candidate);
+    }
+}
+
+static void EncodeFrame(const Transcoder* transcoder, uint32_t i, TranscoderFrame* frame, WorkerBuffers* buffers)
+{
+    const Options* options = transcoder->options;
+    uint32_t width = transcoder->width;
+    uint32_t height = transcoder->height;
+    uint32_t pixelCount = width * height;
+    uint32_t capacity = CompressedBufferSize(width, height);
+
+    uint32_t* pixels = &frame->pixels[0];
+    uint32_t* previous = &frame->previous[0];
+
+    // A lossy encoding works on what the player will see, for this frame and
+    // for the one a delta is made against. 565 falls back to 32-bit pixels
+    // for frames that are not opaque.
+
+    const Encoding* lossy = transcoder->lossy;
+    Encoding fallback = { "rle2", AnimationContainerImageFormatCompactRunLengthPixels, AnimationPixelModeRGBA8888, false };
+
+    if (lossy != NULL && lossy->format == AnimationContainerImageFormatBlockCompressedPixels) {
+        RoundToBlocks(previous, &buffers->blocks[0], width, height);
+        RoundToBlocks(pixels, &buffers->blocks[0], width, height);
+    } else if (lossy != NULL) {
+        AnimationQuantizePixels(previous, pixelCount, lossy->pixelMode);
+        if (!AnimationQuantizePixels(pixels, pixelCount, lossy->pixelMode)) {
+            lossy = &fallback;
+        }
+    }
+
+    // Every encoding of the frame on its own, cropped to its content
+
+    AnimationRect rect;
+    AnimationFindContentRect(pixels, width, height, &rect);
+    if (lossy != NULL && lossy->format == AnimationContainerImageFormatBlockCompressedPixels) {
+        AlignToBlocks(&rect, width, height);
+    }
+    AnimationCopyRect(&buffers->cropped[0], pixels, width, &rect);
+
+    FrameChoice choice = { false, false, 0, 0, 0 };
+
+    if (lossy != NULL) {
+        OfferImage(transcoder, frame, &choice, lossy->format, rect,
+            EncodeImage(&transcoder->codec, lossy, &buffers->cropped[0], rect, &buffers->blocks[0], &buffers->candidate[0], capacity), buffers);
+    } else {
+        for (size_t e = 0; e < options->encodings.size(); e++) {
+            OfferImage(transcoder, frame, &choice, options->encodings[e]->format, rect,
+                EncodeImage(&transcoder->codec, options->encodings[e], &buffers->cropped[0], rect, NULL, &buffers->candidate[0], capacity), buffers);
+        }
+    }
+
+    // A delta of the rectangle that changed since the previous frame
+
+    if (options->keyframeInterval > 0 && (i % options->keyframeInterval) != 0)
+    {
+        AnimationRect changed;
+        AnimationFindChangedRect(pixels, previous, width, height, &changed);
+        AnimationCopyRect(&buffers->cropped[0], pixels, width, &changed);
+        AnimationCopyRect(&buffers->croppedPrevious[0], previous, width, &changed);
+
+        OfferImage(transcoder, frame, &choice, AnimationContainerImageFormatDeltaPixels, changed,
+            AnimationCompressDeltaPixels(&buffers->candidate[0], capacity, &buffers->cropped[0], &buffers->croppedPrevious[0],
+                changed.width * changed.height), buffers);
+    }
+
+    if (!choice.found) {
+        char message[64];
+        snprintf(message, sizeof(message), "No encoding can store frame %u", i);
+        frame->error = message;
+        return;
+    }
+
+    // Decode what was picked the way the player will and compare
+
+    if (options->check)
+    {
+        uint32_t* scratch = &buffers->scratch[0];
+        if (frame->header.format == AnimationContainerImageFormatDeltaPixels) {
+            memcpy(scratch, previous, pixelCount * sizeof(uint32_t));
+        } else {
+            memset(scratch, 0, pixelCount * sizeof(uint32_t));
+        }
+
+        if (!DecodeImage(&transcoder->codec, frame->header, &frame->data[0], scratch) || memcmp(scratch, pixels, pixelCount * sizeof(uint32_t)) != 0) {
+            char message[64];
+            snprintf(message, sizeof(message), "Frame %u does not decode to the same pixels", i);
+            frame->error = message;
+        }
+    }
+}
+
+static void* TranscoderWorker(void* argument)
+{
+    Transcoder* transcoder = (Transcoder*) argument;
+
+    uint32_t pixelCount = transcoder->width * transcoder->height;
+    uint32_t words = CompressedBufferSize(transcoder->width, transcoder->height) / sizeof(uint32_t);
+
+    // Scratch memory lives as long as the worker
+
+    WorkerBuffers buffers;
+    buffers.cropped.resize(pixelCount + 1);
+    buffers.croppedPrevious.resize(pixelCount + 1);
+    buffers.scratch.resize(pixelCount + 1);
+    buffers.candidate.resize(words);
+    buffers.blocks.resize(AnimationBlockCompressedLength(transcoder->width, transcoder->height) + 1);
+
+    while (true)
+    {
+        // Claim the next frame once its slot in the window is free. Frames
+        // are decoded in order under the lock, so every frame is a single
+        // image on top of the one before it.
+
+        pthread_mutex_lock(&transcoder->lock);
+        while (transcoder->nextFrame < transcoder->frameCount && transcoder->nextFrame - transcoder->writtenFrames >= (uint32_t) transcoder->windowSize) {
+            pthread_cond_wait(&transcoder->frameWritten, &transcoder->lock);
+        }
+
+        uint32_t i = transcoder->nextFrame;
+        if (i >= transcoder->frameCount) {
+            pthread_mutex_unlock(&transcoder->lock);
+            break;
+        }
+        transcoder->nextFrame++;
+
+        TranscoderFrame* frame = &transcoder->frames[i % transcoder->windowSize];
+        memcpy(&frame->previous[0], transcoder->canvas.pixels, pixelCount * sizeof(uint32_t));
+
+        AnimationContainerWillNeedImage(&transcoder->container, i + 1);
+        AnimationStatus status = AnimationDecoderDrawFrame(&transcoder->decoder, i, &transcoder->canvas);
+        AnimationContainerDiscardImage(&transcoder->container, i);
+
+        memcpy(&frame->pixels[0], transcoder->canvas.pixels, pixelCount * sizeof(uint32_t));
+        pthread_mutex_unlock(&transcoder->lock);
+
+        frame->error.clear();
+        if (status != AnimationStatusOK) {
+            char message[64];
+            snprintf(message, sizeof(message), "Cannot decode frame %u (status %d)", i, status);
+            frame->error = message;
+        } else {
+            EncodeFrame(transcoder, i, frame, &buffers);
+        }
+
+        pthread_mutex_lock(&transcoder->lock);
+        frame->done = true;
+        pthread_cond_broadcast(&transcoder->frameDone);
+        pthread_mutex_unlock(&transcoder->lock);
+    }
+
+    return NULL;
+}
+
+// Quotes a path for the report
+
+static std::string JSONString(const char* text)
+{
+    std::string quoted = "\"";
+    for (const char* c = text; *c != 0; c++) {
+        if (*c == '"' || *c == '\\') {
+            quoted += '\\';
+        }
+        quoted += *c;
+    }
+    return quoted + "\"";
+}
+
+// With a device profile the predicted decode time of every frame is added
+// to report, as one animation of the JSON report
+
+static bool Transcode(const Options& options, const char* source, const char* destination, std::string* report)
+{
+    Transcoder transcoder;
+    transcoder.options = &options;
+    transcoder.path = source;
+
+    if (!OpenContainer(source, &transcoder.container, &transcoder.decoder)) {
+        return false;
+    }
+
+    const AnimationContainerGlobalHeader* header = transcoder.container.header;
+    transcoder.width = header->width;
+    transcoder.height = header->height;
+    transcoder.frameCount = header->frameCount;
+    transcoder.codec.width = header->width;
+    transcoder.codec.height = header->height;
+    transcoder.codec.palette = transcoder.decoder.palette;
+    transcoder.codec.paletteCount = transcoder.container.paletteCount;
+    transcoder.codec.bandHeight = options.bandHeight;
+
+    uint32_t frameRate = options.frameRate ? options.frameRate : header->frameRate;
+    transcoder.deadline = options.deadline;
+    if (transcoder.deadline == 0) {
+        transcoder.deadline = 1e9 / (frameRate ? frameRate : AnimationPlayerDefaultFrameRate);
+    }
+    transcoder.lossy = options.encodings[0]->lossy ? options.encodings[0] : NULL;
+
+    // Palette encodings keep the palette of the source
+
+    size_t paletteEncodings = 0;
+    for (size_t e = 0; e < options.encodings.size(); e++) {
+        paletteEncodings += (options.encodings[e]->format == AnimationContainerImageFormatPalette8Pixels
+            || options.encodings[e]->format == AnimationContainerImageFormatPalette4Pixels);
+    }
+
+    bool paletted = (paletteEncodings != 0 && transcoder.container.paletteCount != 0);
+    if (paletteEncodings == options.encodings.size() && !paletted) {
+        fprintf(stderr, "%s has no palette to keep\n", source);
+        AnimationContainerClose(&transcoder.container);
+        return false;
+    }
+
+    uint32_t pixelCount = transcoder.width * transcoder.height;
+    transcoder.canvasPixels.resize(pixelCount + 1);
+    AnimationCanvasInit(&transcoder.canvas, &transcoder.canvasPixels[0], transcoder.width, transcoder.height);
+
+    // Two slots per worker keeps every worker busy while the writer drains
+    // finished frames
+
+    transcoder.windowSize = options.jobs * 2;
+    transcoder.frames.resize(transcoder.windowSize);
+    for (int i = 0; i < transcoder.windowSize; i++) {
+        transcoder.frames[i].pixels.resize(pixelCount + 1);
+        transcoder.frames[i].previous.resize(pixelCount + 1);
+        transcoder.frames[i].data.resize(CompressedBufferSize(transcoder.width, transcoder.height) / sizeof(uint32_t));
+        transcoder.frames[i].done = false;
+    }
+
+    transcoder.nextFrame = 0;
+    transcoder.writtenFrames = 0;
+    pthread_mutex_init(&transcoder.lock, NULL);
+    pthread_cond_init(&transcoder.frameDone, NULL);
+    pthread_cond_init(&transcoder.frameWritten, NULL);
+
+    AnimationContainerWriter writer;
+    bool ok = writer.Open(destination, transcoder.width, transcoder.height, frameRate,
+        transcoder.frameCount, paletted ? transcoder.container.palette : NULL, paletted ? transcoder.container.paletteCount : 0);
+    if (!ok) {
+        fprintf(stderr, "Cannot create %s: %s\n", destination, writer.Error());
+        AnimationContainerClose(&transcoder.container);
+        return false;
+    }
+
+    std::vector<pthread_t> threads(options.jobs);
+    for (int i = 0; i < options.jobs; i++) {
+        pthread_create(&threads[i], NULL, TranscoderWorker, &transcoder);
+    }
+
+    // Write all the images, in order, as they are finished
+
+    std::map<uint32_t, std::pair<uint32_t, uint64_t> > formats;
+    uint64_t bytes = 0;
+    uint64_t sourceBytes = 0;
+
+    std::string frames;
+    double worstTime = 0;
+    uint32_t worstFrame = 0;
+    uint32_t missed = 0;
+
+    for (uint32_t i = 0; i < transcoder.frameCount; i++)
+    {
+        TranscoderFrame* frame = &transcoder.frames[i % transcoder.windowSize];
+
+        pthread_mutex_lock(&transcoder.lock);
+        while (!frame->done) {
+            pthread_cond_wait(&transcoder.frameDone, &transcoder.lock);
+        }
+        pthread_mutex_unlock(&transcoder.lock);
+
+        if (ok && !frame->error.empty()) {
+            fprintf(stderr, "%s: %s\n", source, frame->error.c_str());
+            ok = false;
+        }
+        if (ok && !writer.WriteImage(frame->header, &frame->data[0])) {
+            fprintf(stderr, "Cannot write %s: %s\n", destination, writer.Error());
+            ok = false;
+        }
+        if (ok) {
+            formats[frame->header.format].first++;
+            formats[frame->header.format].second += frame->header.dataLength;
+            bytes += frame->header.dataLength;
+
+            // Decoding already checked the source image
+            const AnimationContainerImageHeader* image;
+            const void* data;
+            AnimationContainerGetImage(&transcoder.container, i, &image, &data);
+            sourceBytes += image->dataLength;
+
+            if (options.profile != NULL)
+            {
+                if (frame->predicted > worstTime || i == 0) {
+                    worstTime = frame->predicted;
+                    worstFrame = i;
+                }
+                missed += (frame->predicted > transcoder.deadline);
+
+                char entry[160];
+                snprintf(entry, sizeof(entry), "%s        {\"frame\": %u, \"format\": \"%s\", \"bytes\": %u, \"predicted_us\": %.1f}",
+                    (i == 0) ? "" : ",\n", i, FormatName(frame->header.format).c_str(), frame->header.dataLength, frame->predicted / 1e3);
+                frames += entry;
+            }
+        }
+
+        // After a failure the rest is drained without being written
+
+        pthread_mutex_lock(&transcoder.lock);
+        frame->done = false;
+        transcoder.writtenFrames++;
+        pthread_cond_broadcast(&transcoder.frameWritten);
+        pthread_mutex_unlock(&transcoder.lock);
+    }
+
+    for (int i = 0; i < options.jobs; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    // The source stays mapped until its frames are all written, so a
+    // destination that replaces it is only renamed over it at the end
+
+    if (ok && !writer.Commit()) {
+        fprintf(stderr, "Cannot write %s: %s\n", destination, writer.Error());
+        ok = false;
+    }
+    if (!ok) {
+        writer.Abort();
+    }
+
+    AnimationContainerClose(&transcoder.container);
+    pthread_cond_destroy(&transcoder.frameWritten);
+    pthread_cond_destroy(&transcoder.frameDone);
+    pthread_mutex_destroy(&transcoder.lock);
+
+    if (ok)
+    {
+        printf("%s: %u frames, %llu bytes of images, was %llu:", destination, transcoder.frameCount,
+            (unsigned long long) bytes, (unsigned long long) sourceBytes);
+        for (std::map<uint32_t, std::pair<uint32_t, uint64_t> >::const_iterator f = formats.begin(); f != formats.end(); ++f) {
+            printf(" %s %u (%llu)", FormatName(f->first).c_str(), f->second.first, (unsigned long long) f->second.second);
+        }
+        printf("\n");
+
+        if (options.profile != NULL) {
+            printf("%s: worst frame %u takes %.0f us on %s, %u frames over the %.0f us deadline\n", destination, worstFrame,
+                worstTime / 1e3, options.profile->name.c_str(), missed, transcoder.deadline / 1e3);
+        }
+    }
+
+    if (ok && report != NULL && options.profile != NULL)
+    {
+        char summary[320];
+        snprintf(summary, sizeof(summary), "      \"frames\": %u, \"bytes\": %llu, \"deadline_us\": %.1f, \"worst_frame\": %u, \"worst_us\": %.1f, \"missed_frames\": %u,\n",
+            transcoder.frameCount, (unsigned long long) bytes, transcoder.deadline / 1e3, worstFrame, worstTime / 1e3, missed);
+
+        *report += report->empty() ? "" : ",\n";
+        *report += "    {\n      \"source\": " + JSONString(source) + ", \"destination\": " + JSONString(destination) + ",\n";
+        *report += summary;
+        *report += "      \"per_frame\": [\n" + frames + "\n      ]\n    }";
+    }
+
+    return ok;
+}
+
+static const Encoding* FindEncoding(const char* name, size_t length)
+{
+    for (size_t e = 0; e < sizeof(gEncodings) / sizeof(gEncodings[0]); e++) {
+        if (strlen(gEncodings[e].name) == length && strncmp(gEncodings[e].name, name, length) == 0) {
+            return &gEncodings[e];
+        }
+    }
+    return NULL;
+}
+
+static int TranscodeCommand(int argc, char** argv)
+{
+    const char* usage = "usage: animtool transcode [-e encodings] [-p smallest|fastest] [-P profile] [-D deadline-us] [-R report] "
+        "[-k interval] [-b rows] [-r rate] [-j jobs] [-n] (source destination | -d directory source*)\n";
+
+    Options options;
+    options.fastest = false;
+    options.profile = NULL;
+    options.deadline = 0;
+    options.keyframeInterval = 0;
+    options.bandHeight = 32;
+    options.frameRate = 0;
+    options.jobs = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    options.check = true;
+
+    const char* encodings = "rlen,rle2,rleb,pixl";
+    const char* directory = NULL;
+    const char* reportPath = NULL;
+    AnimationDeviceProfile profile;
+    std::string error;
+
+    int option;
+    while ((option = getopt(argc, argv, "e:p:P:D:R:k:b:r:j:nd:")) != -1) {
+        switch (option) {
+            case 'e': encodings = optarg; break;
+            case 'p':
+                if (strcmp(optarg, "smallest") != 0 && strcmp(optarg, "fastest") != 0) {
+                    fprintf(stderr, "Unknown policy %s\n", optarg);
+                    return 1;
+                }
+                options.fastest = (strcmp(optarg, "fastest") == 0);
+                break;
+            case 'P':
+                if (!AnimationReadDeviceProfile(optarg, profile, error)) {
+                    fprintf(stderr, "Cannot read %s: %s\n", optarg, error.c_str());
+                    return 1;
+                }
+                options.profile = &profile;
+                break;
+            case 'D': options.deadline = atof(optarg) * 1e3; break;
+            case 'R': reportPath = optarg; break;
+            case 'k': options.keyframeInterval = atoi(optarg); break;
+            case 'b': options.bandHeight = std::max(atoi(optarg), 1); break;
+            case 'r': options.frameRate = atoi(optarg); break;
+            case 'j': options.jobs = std::max(atoi(optarg), 1); break;
+            case 'n': options.check = false; break;
+            case 'd': directory = optarg; break;
+            default:
+                fprintf(stderr, "%s", usage);
+                return 1;
+        }
+    }
+
+    for (const char* name = encodings; *name != 0; )
+    {
+        size_t length = strcspn(name, ",");
+        const Encoding* encoding = FindEncoding(name, length);
+        if (encoding == NULL) {
+            fprintf(stderr, "Unknown encoding %.*s\n", (int) length, name);
+            return 1;
+        }
+        options.encodings.push_back(encoding);
+        name += length + (name[length] == ',');
+    }
+
+    if (options.encodings.empty()) {
+        fprintf(stderr, "%s", usage);
+        return 1;
+    }
+
+    for (size_t e = 0; e < options.encodings.size(); e++) {
+        if (options.encodings[e]->lossy && options.encodings.size() > 1) {
+            fprintf(stderr, "The lossy %s can not be combined with other encodings\n", options.encodings[e]->name);
+            return 1;
+        }
+    }
+
+    argc -= optind;
+    argv += optind;
+
+    if ((directory == NULL && argc != 2) || (directory != NULL && argc < 1)) {
+        fprintf(stderr, "%s", usage);
+        return 1;
+    }
+
+    if (reportPath != NULL && options.profile == NULL) {
+        fprintf(stderr, "A report needs a device profile\n");
+        return 1;
+    }
+
+    // A batch keeps going past sources that fail
+
+    std::string report;
+    int failed = 0;
+
+    if (directory == NULL) {
+        failed += !Transcode(options, argv[0], argv[1], &report);
+    } else {
+        for (int i = 0; i < argc; i++)
+        {
+            const char* name = strrchr(argv[i], '/');
+            std::string destination = std::string(directory) + "/" + ((name != NULL) ? name + 1 : argv[i]);
+            failed += !Transcode(options, argv[i], destination.c_str(), &report);
+        }
+
+        if (failed != 0) {
+            fprintf(stderr, "%d of %d containers failed\n", failed, argc);
+        }
+    }
+
+    if (reportPath != NULL)
+    {
+        FILE* file = fopen(reportPath, "w");
+        if (file == NULL) {
+            fprintf(stderr, "Cannot create %s\n", reportPath);
+            return 1;
+        }
+
+        fprintf(file, "{\n");
+        fprintf(file, "  \"report\": \"animation-decode-cost\",\n");
+        fprintf(file, "  \"profile\": %s, \"scale\": %g,\n", JSONString(profile.name.c_str()).c_str(), profile.scale);
+        fprintf(file, "  \"animations\": [\n%s\n  ]\n", report.c_str());
+        fprintf(file, "}\n");
+
+        if (fclose(file) != 0) {
+            fprintf(stderr, "Cannot write %s\n", reportPath);
+            return 1;
+        }
+    }
+
+    return (failed != 0) ? 1 : 0;
+}
+
+static int InspectCommand(int argc, char** argv)
+{
+    bool frames = false;
+
+    int option;
+    while ((option = getopt(argc, argv, "f")) != -1) {
+        switch (option) {
+            case 'f': frames = true; break;
+            default:
+                fprintf(stderr, "usage: animtool inspect [-f] container*\n");
+                return 1;
+        }
+    }
+
+    int failed = 0;
+
+    for (int i = optind; i < argc; i++)
+    {
+        AnimationContainer container;
+        AnimationStatus status = AnimationContainerOpenFile(&container, argv[i]);
+        if (status != AnimationStatusOK) {
+            fprintf(stderr, "Cannot open %s (status %d)\n", argv[i], status);
+            failed++;
+            continue;
+        }
+
+        const AnimationContainerGlobalHeader* header = container.header;
+        printf("%s: version %u, %ux%u, %u fps, %u frames, %u palette colors, %llu bytes\n", argv[i], header->version,
+            header->width, header->height, header->frameRate, header->frameCount, container.paletteCount,
+            (unsigned long long) container.length);
+
+        std::map<uint32_t, std::pair<uint32_t, uint64_t> > formats;
+        uint32_t keyframes = 0;
+        uint32_t largest = 0;
+        uint32_t largestLength = 0;
+
+        for (uint32_t frame = 0; frame < header->frameCount; frame++)
+        {
+            const AnimationContainerImageHeader* image;
+            const void* data;
+            status = AnimationContainerGetImage(&container, frame, &image, &data);
+            if (status != AnimationStatusOK) {
+                printf("  frame %u: invalid (status %d)\n", frame, status);
+                failed++;
+                break;
+            }
+
+            formats[image->format].first++;
+            formats[image->format].second += image->dataLength;
+            keyframes += (image->format != AnimationContainerImageFormatDeltaPixels);
+            if (image->dataLength > largestLength) {
+                largest = frame;
+                largestLength = image->dataLength;
+            }
+
+            if (frames) {
+                printf("  frame %u: %s %ux%u+%u+%u, %u bytes\n", frame, FormatName(image->format).c_str(),
+                    image->width, image->height, image->xoffset, image->yoffset, image->dataLength);
+            }
+        }
+
+        for (std::map<uint32_t, std::pair<uint32_t, uint64_t> >::const_iterator f = formats.begin(); f != formats.end(); ++f) {
+            printf("  %s: %u frames, %llu bytes, %llu per frame\n", FormatName(f->first).c_str(), f->second.first,
+                (unsigned long long) f->second.second, (unsigned long long) (f->second.second / f->second.first));
+        }
+        printf("  %u keyframes, largest frame %u with %u bytes\n", keyframes, largest, largestLength);
+
+        AnimationContainerClose(&container);
+    }
+
+    return (failed != 0) ? 1 : 0;
+}
+
+static int VerifyCommand(int argc, char** argv)
+{
+    int tolerance = 0;
+
+    int option;
+    while ((option = getopt(argc, argv, "t:")) != -1) {
+        switch (option) {
+            case 't': tolerance = atoi(optarg); break;
+            default:
+                fprintf(stderr, "usage: animtool verify [-t max-error] container [original]\n");
+                return 1;
+        }
+    }
+
+    argc -= optind;
+    argv += optind;
+
+    if (argc < 1 || argc > 2) {
+        fprintf(stderr, "usage: animtool verify [-t max-error] container [original]\n");
+        return 1;
+    }
+
+    AnimationContainer containers[2];
+    AnimationDecoder decoders[2];
+    int count = argc;
+
+    for (int i = 0; i < count; i++) {
+        if (!OpenContainer(argv[i], &containers[i], &decoders[i])) {
+            return 1;
+        }
+    }
+
+    const AnimationContainerGlobalHeader* header = containers[0].header;
+    if (count == 2 && (containers[1].header->width != header->width || containers[1].header->height != header->height
+        || containers[1].header->frameCount != header->frameCount))
+    {
+        fprintf(stderr, "%s and %s differ in size or length\n", argv[0], argv[1]);
+        return 1;
+    }
+
+    // Without an original every frame is also decoded on its own canvas,
+    // which decodes it from its keyframe
+
+    uint32_t pixelCount = header->width * header->height;
+    std::vector<uint32_t> pixels[2];
+    AnimationCanvas canvases[2];
+    for (int i = 0; i < 2; i++) {
+        pixels[i].resize(pixelCount + 1);
+        AnimationCanvasInit(&canvases[i], &pixels[i][0], header->width, header->height);
+    }
+
+    int worst = 0;
+    double worstPSNR = INFINITY;
+    uint32_t failed = 0;
+
+    for (uint32_t frame = 0; frame < header->frameCount; frame++)
+    {
+        AnimationStatus status = AnimationDecoderDrawFrame(&decoders[0], frame, &canvases[0]);
+        if (status == AnimationStatusOK) {
+            if (count == 1) {
+                AnimationCanvasInvalidate(&canvases[1]);
+            }
+            status = AnimationDecoderDrawFrame(&decoders[count - 1], frame, &canvases[1]);
+        }
+        if (status != AnimationStatusOK) {
+            printf("%s: frame %u does not decode (status %d)\n", argv[0], frame, status);
+            failed++;
+            continue;
+        }
+
+        int error = 0;
+        double squares = 0;
+        const uint8_t* a = (const uint8_t*) &pixels[0][0];
+        const uint8_t* b = (const uint8_t*) &pixels[1][0];
+        for (uint32_t p = 0; p < pixelCount * 4; p++) {
+            int d = abs((int) a[p] - (int) b[p]);
+            error = std::max(error, d);
+            squares += d * d;
+        }
+
+        if (error > tolerance) {
+            printf("%s: frame %u differs by up to %d\n", argv[0], frame, error);
+            failed++;
+        }
+
+        worst = std::max(worst, error);
+        if (squares != 0) {
+            worstPSNR = std::min(worstPSNR, 10 * log10(255.0 * 255.0 * pixelCount * 4 / squares));
+        }
+    }
+
+    if (failed == 0) {
+        printf("%s: %u frames ok", argv[0], header->frameCount);
+        if (count == 2 && worst != 0) {
+            printf(", largest error %d, lowest PSNR %.1f dB", worst, worstPSNR);
+        }
+        printf("\n");
+    }
+
+    for (int i = 0; i < count; i++) {
+        AnimationContainerClose(&containers[i]);
+    }
+
+    return (failed != 0) ? 1 : 0;
+}
+
+// Synthetic frames for calibration: flat color, long runs, noise and mostly
+// transparent with scattered pixels, all from a small palette so pal4 and
+// pal8 can store them.
+
+static const uint32_t gProfileColors[16] = {
+    0x00000000, 0xff0000ff, 0xff00ff00, 0xffff0000, 0xff00ffff, 0xffff00ff, 0xffffff00, 0xffffffff,
+    0xff000000, 0xff808080, 0xff404080, 0xff408040, 0xff804040, 0x80404040, 0x80000080, 0x40202020,
+};
+
+static void MakeProfileImage(uint32_t* pixels, uint32_t width, uint32_t height, int kind, uint32_t seed)
+{
+    uint32_t state = seed * 2654435761u + 1;
+    uint32_t color = 1;
+
+    for (uint32_t i = 0; i < width * height; i++)
+    {
+        state ^= state << 13;
+        state ^= state >> 17;
+        state ^= state << 5;
+
+        switch (kind) {
+            case 0: color = seed % 15 + 1; break;
+            case 1: color = ((state & 31) == 0) ? state >> 28 : color; break;
+            case 2: color = state >> 28; break;
+            case 3: color = ((state & 15) == 0) ? state >> 28 : 0; break;
+        }
+
+        pixels[i] = gProfileColors[color];
+    }
+}
+
+static int ProfileCommand(int argc, char** argv)
+{
+    const char* usage = "usage: animtool profile [-n name] [-s scale] [-o profile]\n";
+
+    AnimationDeviceProfile profile;
+    profile.name = "host";
+    profile.scale = 1;
+    const char* output = NULL;
+
+    int option;
+    while ((option = getopt(argc, argv, "n:s:o:")) != -1) {
+        switch (option) {
+            case 'n': profile.name = optarg; break;
+            case 's': profile.scale = atof(optarg); break;
+            case 'o': output = optarg; break;
+            default:
+                fprintf(stderr, "%s", usage);
+                return 1;
+        }
+    }
+
+    if (optind != argc || profile.scale <= 0) {
+        fprintf(stderr, "%s", usage);
+        return 1;
+    }
+
+    // Every lossless format, the same ones with the lossy pixel modes of
+    // rle2 take as long, and deltas
+
+    std::vector<uint32_t> formats;
+    for (size_t e = 0; e < sizeof(gEncodings) / sizeof(gEncodings[0]); e++) {
+        if (!gEncodings[e].lossy || gEncodings[e].format == AnimationContainerImageFormatBlockCompressedPixels) {
+            formats.push_back(gEncodings[e].format);
+        }
+    }
+    formats.push_back(AnimationContainerImageFormatDeltaPixels);
+
+    std::vector<uint32_t> palette(AnimationContainerMaxPaletteCount, 0);
+    std::copy(gProfileColors, gProfileColors + 16, palette.begin());
+
+    std::map<uint32_t, std::vector<AnimationDecodeSample> > samples;
+    static const uint32_t widths[] = { 40, 80, 160, 320 };
+
+    for (size_t w = 0; w < sizeof(widths) / sizeof(widths[0]); w++)
+    {
+        uint32_t width = widths[w];
+        uint32_t height = width * 3 / 4;
+        uint32_t count = width * height;
+
+        ImageCodec codec = { width, height, &palette[0], 16, 32 };
+        AnimationRect rect = { 0, 0, width, height };
+        uint32_t capacity = CompressedBufferSize(width, height);
+
+        std::vector<uint32_t> pixels(count), previous(count), scratch(count), data(capacity / sizeof(uint32_t));
+        std::vector<uint8_t> blocks(AnimationBlockCompressedLength(width, height));
+
+        for (int kind = 0; kind < 4; kind++)
+        {
+            MakeProfileImage(&pixels[0], width, height, kind, 1);
+            MakeProfileImage(&previous[0], width, height, kind, 2);
+            AnimationCompressBlockPixels(&blocks[0], blocks.size(), &pixels[0], width, height);
+
+            for (size_t f = 0; f < formats.size(); f++)
+            {
+                uint32_t length = UINT32_MAX;
+                if (formats[f] == AnimationContainerImageFormatDeltaPixels) {
+                    length = AnimationCompressDeltaPixels(&data[0], capacity, &pixels[0], &previous[0], count);
+                } else {
+                    for (size_t e = 0; e < sizeof(gEncodings) / sizeof(gEncodings[0]) && length == UINT32_MAX; e++) {
+                        if (gEncodings[e].format == formats[f]) {
+                            length = EncodeImage(&codec, &gEncodings[e], &pixels[0], rect, &blocks[0], &data[0], capacity);
+                        }
+                    }
+                }
+
+                if (length == UINT32_MAX) {
+                    continue;
+                }
+
+                AnimationContainerImageHeader header;
+                header.width = width;
+                header.height = height;
+                header.xoffset = 0;
+                header.yoffset = 0;
+                header.format = formats[f];
+                header.dataLength = length;
+
+                AnimationDecodeSample sample = { count, length, (double) MeasureDecode(&codec, header, &data[0], &previous[0], &scratch[0]) };
+                samples[formats[f]].push_back(sample);
+            }
+        }
+    }
+
+    // How far the fit is from what was measured tells how much to trust it
+
+    for (std::map<uint32_t, std::vector<AnimationDecodeSample> >::const_iterator i = samples.begin(); i != samples.end(); ++i)
+    {
+        AnimationDecodeCost cost = AnimationFitDecodeCost(i->second);
+        profile.costs[i->first] = cost;
+
+        double worst = 0;
+        for (size_t s = 0; s < i->second.size(); s++) {
+            const AnimationDecodeSample& sample = i->second[s];
+            double fitted = cost.fixed + cost.perPixel * sample.pixels + cost.perByte * sample.bytes;
+            worst = std::max(worst, fabs(fitted - sample.time) / std::max(sample.time, 1.0));
+        }
+
+        fprintf(stderr, "%s: %.0f ns + %.3f ns/pixel + %.3f ns/byte, within %.0f%% of %zu samples\n", FormatName(i->first).c_str(),
+            cost.fixed, cost.perPixel, cost.perByte, worst * 100, i->second.size());
+    }
+
+    FILE* file = (output != NULL) ? fopen(output, "w") : stdout;
+    if (file == NULL) {
+        fprintf(stderr, "Cannot create %s\n", output);
+        return 1;
+    }
+
+    bool ok = AnimationWriteDeviceProfile(file, profile);
+    if (output != NULL) {
+        ok = (fclose(file) == 0) && ok;
+    }
+
+    if (!ok) {
+        fprintf(stderr, "Cannot write %s\n", (output != NULL) ? output : "profile");
+        return 1;
+    }
+
+    return 0;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc >= 2)
+    {
+        // Each subcommand parses its own options, starting at its name
+
+        if (strcmp(argv[1], "inspect") == 0) {
+            return InspectCommand(argc - 1, argv + 1);
+        } else if (strcmp(argv[1], "transcode") == 0) {
+            return TranscodeCommand(argc - 1, argv + 1);
+        } else if (strcmp(argv[1], "verify") == 0) {
+            return VerifyCommand(argc - 1, argv + 1);
+        } else if (strcmp(argv[1], "profile") == 0) {
+            return ProfileCommand(argc - 1, argv + 1);
+        }
+    }
+
+    fprintf(stderr, "usage: animtool inspect|transcode|verify|profile [options] ...\n");
+    return 1;
+}
@@ -0,0 +1,282 @@
+/*
+ * (C) Copyright 2010, Stefan Arentz, Arentz Consulting Inc.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// archive.cc - combine animation containers into one archive. identical
+//     images are stored once, no matter how many animations or frames use
+//     them, and the player decodes them once.
+//
+//   usage: archive destination.animations [name=]source.animation*
+//
+//     animations are named after their file without the extension unless a
+//     name is given
+//
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <map>
+#include <string>
+#include <vector>
+#include "../src/AnimationCommon.h"
+#include "../src/AnimationContainer.h"
+
+struct Source {
+    std::string name;
+    std::string path;
+    AnimationContainer container;
+};
+
+static bool CompareSources(const Source* a, const Source* b)
+{
+    return a->name < b->name;
+}
+
+// An image already in the archive, with the palette it indexes into
+struct StoredImage {
+    uint32_t offset;
+    const AnimationPixel* palette;
+    uint32_t paletteCount;
+};
+
+static uint64_t HashBytes(uint64_t hash, const void* bytes, size_t length)
+{
+    const uint8_t* p = (const uint8_t*) bytes;
+    for (size_t i = 0; i < length; i++) {
+        hash = (hash ^ p[i]) * 1099511628211ULL;
+    }
+    return hash;
+}
+
+static uint32_t Append(std::vector<uint8_t>& archive, const void* bytes, size_t length)
+{
+    if (archive.size() + length > UINT32_MAX) {
+        fprintf(stderr, "Archive larger than 4GB\n");
+        exit(1);
+    }
+
+    uint32_t offset = (uint32_t) archive.size();
+    archive.insert(archive.end(), (const uint8_t*) bytes, (const uint8_t*) bytes + length);
+    archive.resize((archive.size() + 3) & ~(size_t) 3, 0);
+    return offset;
+}
+
+static bool IsPaletteImage(const AnimationContainerImageHeader* header)
+{
+    return header->format == AnimationContainerImageFormatPalette8Pixels || header->format == AnimationContainerImageFormatPalette4Pixels;
+}
+
+int main(int argc, char** argv)
+{
+    if (argc < 3) {
+        fprintf(stderr, "usage: archive destination.animations [name=]source.animation*\n");
+        exit(1);
+    }
+
+    // Open all sources
+
+    std::vector<Source> sources(argc - 2);
+    std::vector<Source*> sorted;
+
+    for (int i = 2; i < argc; i++)
+    {
+        Source& source = sources[i - 2];
+
+        const char* equals = strchr(argv[i], '=');
+        if (equals != NULL) {
+            source.name.assign(argv[i], equals - argv[i]);
+            source.path = equals + 1;
+        } else {
+            source.path = argv[i];
+            const char* slash = strrchr(argv[i], '/');
+            source.name = (slash != NULL) ? slash + 1 : argv[i];
+            size_t dot = source.name.rfind('.');
+            if (dot != std::string::npos && dot != 0) {
+                source.name.erase(dot);
+            }
+        }
+
+        AnimationStatus status = AnimationContainerOpenFile(&source.container, source.path.c_str());
+        if (status != AnimationStatusOK) {
+            fprintf(stderr, "Cannot open %s (status %d)\n", source.path.c_str(), status);
+            exit(1);
+        }
+
+        sorted.push_back(&source);
+    }
+
+    // The directory is searched by name, so it is stored sorted
+
+    std::sort(sorted.begin(), sorted.end(), CompareSources);
+
+    for (size_t i = 1; i < sorted.size(); i++) {
+        if (sorted[i]->name == sorted[i - 1]->name) {
+            fprintf(stderr, "Animation %s is given twice\n", sorted[i]->name.c_str());
+            exit(1);
+        }
+    }
+
+    std::vector<uint8_t> archive;
+
+    AnimationArchiveHeader header;
+    header.magic = 'arch';
+    header.version = 1;
+    header.count = sorted.size();
+    header.reserved = 0;
+    Append(archive, &header, sizeof(header));
+
+    std::vector<AnimationArchiveEntry> entries(sorted.size());
+    uint32_t entriesOffset = Append(archive, &entries[0], entries.size() * sizeof(AnimationArchiveEntry));
+
+    for (size_t i = 0; i < sorted.size(); i++) {
+        entries[i].nameOffset = Append(archive, sorted[i]->name.data(), sorted[i]->name.size());
+        entries[i].nameLength = sorted[i]->name.size();
+        entries[i].reserved = 0;
+    }
+
+    // Write each animation as an embedded container. Images are looked up by
+    // a hash of their header and data, and only stored the first time.
+
+    std::multimap<uint64_t, StoredImage> stored;
+    size_t frameCount = 0;
+    size_t imageCount = 0;
+    uint64_t savedBytes = 0;
+
+    for (size_t i = 0; i < sorted.size(); i++)
+    {
+        const AnimationContainer* container = &sorted[i]->container;
+
+        AnimationContainerGlobalHeader globalHeader = *container->header;
+        globalHeader.version = (container->palette != NULL) ? 3 : 2;
+        entries[i].containerOffset = Append(archive, &globalHeader, sizeof(globalHeader));
+
+        if (container->palette != NULL) {
+            AnimationContainerPaletteHeader paletteHeader;
+            paletteHeader.count = container->paletteCount;
+            Append(archive, &paletteHeader, sizeof(paletteHeader));
+            Append(archive, container->palette, container->paletteCount * sizeof(AnimationPixel));
+        }
+
+        std::vector<AnimationContainerIndexEntry> index(globalHeader.frameCount);
+        uint32_t indexOffset = Append(archive, &index[0], index.size() * sizeof(AnimationContainerIndexEntry));
+
+        for (uint32_t frame = 0; frame < globalHeader.frameCount; frame++)
+        {
+            const AnimationContainerImageHeader* imageHeader;
+            const void* data;
+
+            AnimationStatus status = AnimationContainerGetImage(container, frame, &imageHeader, &data);
+            if (status != AnimationStatusOK) {
+                fprintf(stderr, "Cannot read frame %u of %s (status %d)\n", frame, sorted[i]->path.c_str(), status);
+                exit(1);
+            }
+
+            size_t length = sizeof(AnimationContainerImageHeader) + imageHeader->dataLength;
+            bool paletted = IsPaletteImage(imageHeader);
+
+            // Palette images are only the same if their palettes are too
+
+            uint64_t hash = HashBytes(14695981039346656037ULL, imageHeader, length);
+            if (paletted) {
+                hash = HashBytes(hash, container->palette, container->paletteCount * sizeof(AnimationPixel));
+            }
+
+            uint32_t offset = 0;
+            bool found = false;
+
+            std::pair<std::multimap<uint64_t, StoredImage>::iterator, std::multimap<uint64_t, StoredImage>::iterator> range = stored.equal_range(hash);
+            for (std::multimap<uint64_t, StoredImage>::iterator s = range.first; s != range.second && !found; ++s)
+            {
+                if (archive.size() - s->second.offset < length || memcmp(&archive[s->second.offset], imageHeader, length) != 0) {
+                    continue;
+                }
+                if (paletted && (s->second.paletteCount != container->paletteCount
+                    || memcmp(s->second.palette, container->palette, container->paletteCount * sizeof(AnimationPixel)) != 0))
+                {
+                    continue;
+                }
+                offset = s->second.offset;
+                found = true;
+            }
+
+            if (found) {
+                savedBytes += length;
+            } else {
+                offset = Append(archive, imageHeader, length);
+                StoredImage image = { offset, container->palette, container->paletteCount };
+                stored.insert(std::make_pair(hash, image));
+                imageCount++;
+            }
+
+            index[frame].offset = offset;
+            index[frame].length = length;
+            frameCount++;
+        }
+
+        memcpy(&archive[indexOffset], &index[0], index.size() * sizeof(AnimationContainerIndexEntry));
+    }
+
+    memcpy(&archive[entriesOffset], &entries[0], entries.size() * sizeof(AnimationArchiveEntry));
+
+    // Write to a temporary file and move it into place
+
+    std::string temporaryPath = std::string(argv[1]) + ".XXXXXX";
+    std::vector<char> path(temporaryPath.begin(), temporaryPath.end());
+    path.push_back('\0');
+
+    int fd = mkstemp(&path[0]);
+    if (fd == -1) {
+        fprintf(stderr, "Cannot create %s: %s\n", argv[1], strerror(errno));
+        exit(1);
+    }
+    fchmod(fd, 0644);
+
+    size_t written = 0;
+    while (written < archive.size()) {
+        ssize_t n = write(fd, &archive[written], archive.size() - written);
+        if (n == -1 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            fprintf(stderr, "Cannot write %s: %s\n", argv[1], strerror(errno));
+            unlink(&path[0]);
+            exit(1);
+        }
+        written += n;
+    }
+
+    if (fsync(fd) == -1 || close(fd) == -1 || rename(&path[0], argv[1]) == -1) {
+        fprintf(stderr, "Cannot write %s: %s\n", argv[1], strerror(errno));
+        unlink(&path[0]);
+        exit(1);
+    }
+
+    printf("%zu animations, %zu frames, %zu images stored, %llu bytes saved\n",
+        sorted.size(), frameCount, imageCount, (unsigned long long) savedBytes);
+
+    for (size_t i = 0; i < sources.size(); i++) {
+        AnimationContainerClose(&sources[i].container);
+    }
+
+    return 0;
+}
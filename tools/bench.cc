@@ -0,0 +1,554 @@
+/*
+ * (C) Copyright 2010, Stefan Arentz, Arentz Consulting Inc.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// bench.cc - reproducible encode/decode benchmarks for the compression core.
+//     runs every codec over synthetic frame sets (solid, gradient, sprites on
+//     a transparent background and noise) and over the frames of any
+//     animation containers given on the command line. results are written
+//     to stdout as json so they can be compared between releases.
+//
+//   usage: bench [-w width] [-h height] [-f frames] [-r repetitions] [-j threads] [containers*]
+//
+//     the -over codecs composite each frame over the previous one instead of
+//     replacing it, compare them with their plain codec plus pixl-over, the
+//     blend of a decoded frame. haze is a translucent layer for them, noise
+//     with every kind of alpha.
+//
+//     rleb-parallel decodes the bands of a frame on a thread pool of
+//     threads workers plus the benchmark thread, defaults to the number of
+//     cpus - 1. compare its latencies with rleb at large sizes, e.g. -w 1920
+//     -h 1080.
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "../src/AnimationCommon.h"
+#include "../src/AnimationCompression.h"
+#include "../src/AnimationContainer.h"
+#include "../src/AnimationDecoder.h"
+#include "../src/AnimationThreadPool.h"
+
+struct FrameSet {
+    std::string name;
+    uint32_t width;
+    uint32_t height;
+    std::vector<uint32_t*> frames;
+};
+
+// A codec compresses frame i of a set into dst and returns the length in
+// bytes. Decompression gets dst already holding frame i - 1, so codecs that
+// work on deltas can be measured the same way as the others. Lossy codecs
+// are checked against the frame rounded to the pixel mode they store.
+
+struct Codec {
+    const char* name;
+    uint32_t (*compress)(uint32_t* dst, const FrameSet& set, size_t i);
+    void (*decompress)(uint32_t* dst, const uint32_t* src, uint32_t length, const FrameSet& set, size_t i);
+    AnimationPixelMode mode;
+    bool over;          // Composites over dst, checked against Over()
+};
+
+static uint64_t Now()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+// A fixed xorshift generator so every run sees exactly the same pixels
+
+static uint32_t gRandomState = 0x9e3779b9;
+
+static uint32_t Random()
+{
+    gRandomState ^= gRandomState << 13;
+    gRandomState ^= gRandomState >> 17;
+    gRandomState ^= gRandomState << 5;
+    return gRandomState;
+}
+
+static uint32_t Premultiply(uint32_t r, uint32_t g, uint32_t b, uint32_t a)
+{
+    r = r * a / 255;
+    g = g * a / 255;
+    b = b * a / 255;
+    return r | (g << 8) | (b << 16) | (a << 24);
+}
+
+static FrameSet CreateFrameSet(const char* name, uint32_t width, uint32_t height, size_t frameCount)
+{
+    FrameSet set;
+    set.name = name;
+    set.width = width;
+    set.height = height;
+
+    for (size_t f = 0; f < frameCount; f++)
+    {
+        uint32_t* pixels = (uint32_t*) calloc(width * height, sizeof(uint32_t));
+        if (pixels == NULL) {
+            fprintf(stderr, "Can't allocate memory\n");
+            exit(1);
+        }
+
+        if (set.name == "solid")
+        {
+            uint32_t c = Premultiply(f * 7, 128, 255 - f * 3, 255);
+            for (uint32_t i = 0; i < width * height; i++) {
+                pixels[i] = c;
+            }
+        }
+        else if (set.name == "gradient")
+        {
+            for (uint32_t y = 0; y < height; y++) {
+                for (uint32_t x = 0; x < width; x++) {
+                    pixels[y * width + x] = Premultiply((x + f) & 0xff, (y + f) & 0xff, 128, 255);
+                }
+            }
+        }
+        else if (set.name == "sprites")
+        {
+            // A few semi-transparent sprites moving over a transparent background
+
+            for (int s = 0; s < 8; s++)
+            {
+                uint32_t size = 32 + s * 8;
+                uint32_t x0 = (s * 97 + f * (s + 1) * 3) % (width > size ? width - size : 1);
+                uint32_t y0 = (s * 53 + f * 2) % (height > size ? height - size : 1);
+                uint32_t c = Premultiply(40 * s, 255 - 30 * s, 128, s == 0 ? 128 : 255);
+
+                for (uint32_t y = y0; y < y0 + size && y < height; y++) {
+                    for (uint32_t x = x0; x < x0 + size && x < width; x++) {
+                        pixels[y * width + x] = c;
+                    }
+                }
+            }
+        }
+        else if (set.name == "noise")
+        {
+            for (uint32_t i = 0; i < width * height; i++) {
+                pixels[i] = Premultiply(Random() & 0xff, Random() & 0xff, Random() & 0xff, 255);
+            }
+        }
+        else if (set.name == "haze")
+        {
+            // Runs of transparent, opaque and translucent noise
+
+            static const uint32_t alphas[] = { 0, 255, 0, 64, 192 };
+            uint32_t a = 0;
+            for (uint32_t i = 0; i < width * height; i++) {
+                if ((i % 24) == 0) {
+                    a = alphas[(i / 24 + f) % 5];
+                }
+                pixels[i] = Premultiply(Random() & 0xff, Random() & 0xff, Random() & 0xff, (a == 64 || a == 192) ? Random() & 0xff : a);
+            }
+        }
+
+        set.frames.push_back(pixels);
+    }
+
+    return set;
+}
+
+// Decodes all frames of a container into full size frames
+
+static bool LoadFrameSet(const char* path, FrameSet& set)
+{
+    AnimationContainer container;
+    if (AnimationContainerOpenFile(&container, path) != AnimationStatusOK) {
+        return false;
+    }
+
+    set.name = path;
+    set.width = container.header->width;
+    set.height = container.header->height;
+
+    AnimationDecoder decoder;
+    AnimationDecoderInit(&decoder, &container, NULL, NULL);
+
+    uint32_t* pixels = (uint32_t*) calloc(set.width * set.height, sizeof(uint32_t));
+
+    AnimationCanvas canvas;
+    AnimationCanvasInit(&canvas, pixels, set.width, set.height);
+
+    bool ok = true;
+
+    for (uint32_t i = 0; i < container.header->frameCount && ok; i++)
+    {
+        if (AnimationDecoderDrawFrame(&decoder, i, &canvas) != AnimationStatusOK) {
+            fprintf(stderr, "Cannot decode frame %d of %s\n", i, path);
+            ok = false;
+            break;
+        }
+
+        uint32_t* frame = (uint32_t*) malloc(set.width * set.height * sizeof(uint32_t));
+        memcpy(frame, pixels, set.width * set.height * sizeof(uint32_t));
+        set.frames.push_back(frame);
+    }
+
+    free(pixels);
+    AnimationContainerClose(&container);
+
+    return ok;
+}
+
+// Codecs
+
+static uint32_t CompressRunLength(uint32_t* dst, const FrameSet& set, size_t i)
+{
+    return AnimationCompressRunLengthEncodedPixels(dst, set.frames[i], set.width * set.height);
+}
+
+static void DecompressRunLength(uint32_t* dst, const uint32_t* src, uint32_t length, const FrameSet& set, size_t i)
+{
+    AnimationDecompressRunLengthEncodedPixels(dst, (uint32_t*) src, set.width * set.height);
+}
+
+static void DecompressRunLengthScalar(uint32_t* dst, const uint32_t* src, uint32_t length, const FrameSet& set, size_t i)
+{
+    AnimationDecompressRunLengthEncodedPixelsScalar(dst, (uint32_t*) src, set.width * set.height);
+}
+
+static void DecompressRunLengthChecked(uint32_t* dst, const uint32_t* src, uint32_t length, const FrameSet& set, size_t i)
+{
+    AnimationDecompressRunLengthEncodedPixelsChecked(dst, set.width * set.height, src, length);
+}
+
+// Bands of 32 rows, like rle -e rleb
+
+static uint32_t CompressBandedRunLength(uint32_t* dst, const FrameSet& set, size_t i)
+{
+    return AnimationCompressBandedRunLengthPixels(dst, set.width * set.height * 12, set.frames[i], set.width, set.height, 32);
+}
+
+static void DecompressBandedRunLength(uint32_t* dst, const uint32_t* src, uint32_t length, const FrameSet& set, size_t i)
+{
+    AnimationDecompressBandedRunLengthPixelsRect(dst, set.width, set.width, set.height, src, length);
+}
+
+static AnimationThreadPool* gThreadPool;
+
+struct BandJob {
+    uint32_t* dst;
+    const uint32_t* src;
+    uint32_t length;
+    const FrameSet* set;
+};
+
+static void DecompressBand(void* context, uint32_t band)
+{
+    BandJob* job = (BandJob*) context;
+    AnimationDecompressBandedRunLengthPixelsBand(job->dst, job->set->width, job->set->width, job->set->height, job->src, job->length, band);
+}
+
+static void DecompressBandedRunLengthParallel(uint32_t* dst, const uint32_t* src, uint32_t length, const FrameSet& set, size_t i)
+{
+    uint32_t bandCount;
+    if (AnimationBandedRunLengthPixelsGetBandCount(src, length, set.height, &bandCount) == AnimationStatusOK) {
+        BandJob job = { dst, src, length, &set };
+        AnimationThreadPoolRun(gThreadPool, bandCount, DecompressBand, &job);
+    }
+}
+
+static uint32_t CompressDelta(uint32_t* dst, const FrameSet& set, size_t i)
+{
+    // The first frame is a delta against a transparent frame
+
+    static std::vector<uint32_t> empty;
+    empty.resize(set.width * set.height);
+
+    const uint32_t* previous = (i == 0) ? &empty[0] : set.frames[i - 1];
+    return AnimationCompressDeltaPixels(dst, set.width * set.height * 12, set.frames[i], previous, set.width * set.height);
+}
+
+static void DecompressDelta(uint32_t* dst, const uint32_t* src, uint32_t length, const FrameSet& set, size_t i)
+{
+    AnimationDecompressDeltaPixelsChecked(dst, set.width * set.height, src, length);
+}
+
+static uint32_t CompressCompactRunLength(uint32_t* dst, const FrameSet& set, size_t i)
+{
+    return AnimationCompressCompactRunLengthPixels((uint8_t*) dst, set.width * set.height * 12, set.frames[i],
+        set.width * set.height, AnimationPixelModeRGBA8888);
+}
+
+static uint32_t CompressCompactRunLength4444(uint32_t* dst, const FrameSet& set, size_t i)
+{
+    return AnimationCompressCompactRunLengthPixels((uint8_t*) dst, set.width * set.height * 12, set.frames[i],
+        set.width * set.height, AnimationPixelModeRGBA4444);
+}
+
+static void DecompressCompactRunLength(uint32_t* dst, const uint32_t* src, uint32_t length, const FrameSet& set, size_t i)
+{
+    AnimationDecompressCompactRunLengthPixelsChecked(dst, set.width * set.height, (const uint8_t*) src, length);
+}
+
+// Compositing decoders
+
+static uint32_t CompressUncompressed(uint32_t* dst, const FrameSet& set, size_t i)
+{
+    memcpy(dst, set.frames[i], set.width * set.height * sizeof(uint32_t));
+    return set.width * set.height * sizeof(uint32_t);
+}
+
+static void CompositeUncompressed(uint32_t* dst, const uint32_t* src, uint32_t length, const FrameSet& set, size_t i)
+{
+    AnimationCompositePixelsRect(dst, set.width, src, set.width, set.width, set.height);
+}
+
+static void CompositeRunLength(uint32_t* dst, const uint32_t* src, uint32_t length, const FrameSet& set, size_t i)
+{
+    AnimationCompositeRunLengthEncodedPixelsRect(dst, set.width, set.width, set.height, src, length);
+}
+
+static void CompositeBandedRunLength(uint32_t* dst, const uint32_t* src, uint32_t length, const FrameSet& set, size_t i)
+{
+    AnimationCompositeBandedRunLengthPixelsRect(dst, set.width, set.width, set.height, src, length);
+}
+
+static void CompositeCompactRunLength(uint32_t* dst, const uint32_t* src, uint32_t length, const FrameSet& set, size_t i)
+{
+    AnimationCompositeCompactRunLengthPixelsRect(dst, set.width, set.width, set.height, (const uint8_t*) src, length);
+}
+
+static const Codec kCodecs[] = {
+    { "rlen",           CompressRunLength,            DecompressRunLength,               AnimationPixelModeRGBA8888, false },
+    { "rlen-scalar",    CompressRunLength,            DecompressRunLengthScalar,         AnimationPixelModeRGBA8888, false },
+    { "rlen-checked",   CompressRunLength,            DecompressRunLengthChecked,        AnimationPixelModeRGBA8888, false },
+    { "rleb",           CompressBandedRunLength,      DecompressBandedRunLength,         AnimationPixelModeRGBA8888, false },
+    { "rleb-parallel",  CompressBandedRunLength,      DecompressBandedRunLengthParallel, AnimationPixelModeRGBA8888, false },
+    { "delt",           CompressDelta,                DecompressDelta,                   AnimationPixelModeRGBA8888, false },
+    { "rle2",           CompressCompactRunLength,     DecompressCompactRunLength,        AnimationPixelModeRGBA8888, false },
+    { "rle2-4444",      CompressCompactRunLength4444, DecompressCompactRunLength,        AnimationPixelModeRGBA4444, false },
+    { "pixl-over",      CompressUncompressed,         CompositeUncompressed,             AnimationPixelModeRGBA8888, true  },
+    { "rlen-over",      CompressRunLength,            CompositeRunLength,                AnimationPixelModeRGBA8888, true  },
+    { "rleb-over",      CompressBandedRunLength,      CompositeBandedRunLength,          AnimationPixelModeRGBA8888, true  },
+    { "rle2-over",      CompressCompactRunLength,     CompositeCompactRunLength,         AnimationPixelModeRGBA8888, true  },
+    { "rle2-4444-over", CompressCompactRunLength4444, CompositeCompactRunLength,         AnimationPixelModeRGBA4444, true  },
+};
+
+// Premultiplied source over, one channel at a time, as a reference for the
+// compositing decoders
+
+static uint32_t Over(uint32_t d, uint32_t s)
+{
+    uint32_t a = s >> 24;
+    uint32_t result = 0;
+
+    for (int shift = 0; shift < 32; shift += 8) {
+        uint32_t c = ((s >> shift) & 0xff) + (((d >> shift) & 0xff) * (255 - a) + 127) / 255;
+        result |= std::min(c, 255u) << shift;
+    }
+
+    return result;
+}
+
+// Measurements
+
+struct Measurement {
+    uint64_t bytes;
+    uint64_t pixels;
+    uint64_t nanoseconds;
+    std::vector<uint64_t> latencies;
+};
+
+static uint64_t Percentile(const std::vector<uint64_t>& sorted, double p)
+{
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t i = (size_t) (p * (sorted.size() - 1) + 0.5);
+    return sorted[i];
+}
+
+static void PrintMeasurement(const FrameSet& set, const Codec& codec, const char* operation, Measurement& m, uint64_t compressedBytes, bool last)
+{
+    std::sort(m.latencies.begin(), m.latencies.end());
+
+    double seconds = m.nanoseconds / 1e9;
+    uint64_t uncompressedBytes = (uint64_t) set.frames.size() * set.width * set.height * sizeof(uint32_t);
+
+    printf("    {\"set\": \"%s\", \"codec\": \"%s\", \"operation\": \"%s\", ", set.name.c_str(), codec.name, operation);
+    printf("\"frames\": %zu, \"uncompressed_bytes\": %llu, \"compressed_bytes\": %llu, \"ratio\": %.3f, ",
+        set.frames.size(), (unsigned long long) uncompressedBytes, (unsigned long long) compressedBytes,
+        compressedBytes ? (double) uncompressedBytes / compressedBytes : 0.0);
+    printf("\"mb_per_second\": %.1f, \"mpixels_per_second\": %.1f, ",
+        seconds > 0 ? m.bytes / seconds / 1e6 : 0.0, seconds > 0 ? m.pixels / seconds / 1e6 : 0.0);
+    printf("\"latency_us\": {\"p50\": %.2f, \"p95\": %.2f, \"p99\": %.2f, \"max\": %.2f}}%s\n",
+        Percentile(m.latencies, 0.50) / 1e3, Percentile(m.latencies, 0.95) / 1e3,
+        Percentile(m.latencies, 0.99) / 1e3, Percentile(m.latencies, 1.0) / 1e3, last ? "" : ",");
+}
+
+static void RunBenchmark(const FrameSet& set, const Codec& codec, int repetitions, bool last)
+{
+    size_t pixelCount = set.width * set.height;
+    size_t frameCount = set.frames.size();
+
+    // Room for the worst case of every codec: a delta triple per pixel
+
+    std::vector<uint32_t*> compressed(frameCount);
+    std::vector<uint32_t> lengths(frameCount);
+    for (size_t i = 0; i < frameCount; i++) {
+        compressed[i] = (uint32_t*) malloc(pixelCount * 3 * sizeof(uint32_t) + 16);
+    }
+
+    uint32_t* decompressed = (uint32_t*) calloc(pixelCount, sizeof(uint32_t));
+    uint32_t* expected = (uint32_t*) malloc(pixelCount * sizeof(uint32_t));
+
+    Measurement compress = { 0, 0, 0 };
+    Measurement decompress = { 0, 0, 0 };
+    uint64_t compressedBytes = 0;
+
+    for (int r = 0; r < repetitions; r++)
+    {
+        compressedBytes = 0;
+
+        for (size_t i = 0; i < frameCount; i++)
+        {
+            uint64_t start = Now();
+            lengths[i] = codec.compress(compressed[i], set, i);
+            uint64_t elapsed = Now() - start;
+
+            compress.nanoseconds += elapsed;
+            compress.latencies.push_back(elapsed);
+            compress.bytes += pixelCount * sizeof(uint32_t);
+            compress.pixels += pixelCount;
+            compressedBytes += lengths[i];
+        }
+
+        for (size_t i = 0; i < frameCount; i++)
+        {
+            if (i == 0) {
+                memset(decompressed, 0, pixelCount * sizeof(uint32_t));
+            } else {
+                memcpy(decompressed, set.frames[i - 1], pixelCount * sizeof(uint32_t));
+            }
+
+            uint64_t start = Now();
+            codec.decompress(decompressed, compressed[i], lengths[i], set, i);
+            uint64_t elapsed = Now() - start;
+
+            decompress.nanoseconds += elapsed;
+            decompress.latencies.push_back(elapsed);
+            decompress.bytes += pixelCount * sizeof(uint32_t);
+            decompress.pixels += pixelCount;
+
+            if (r == 0)
+            {
+                memcpy(expected, set.frames[i], pixelCount * sizeof(uint32_t));
+                AnimationQuantizePixels(expected, pixelCount, codec.mode);
+
+                if (codec.over) {
+                    for (size_t p = 0; p < pixelCount; p++) {
+                        expected[p] = Over((i == 0) ? 0 : set.frames[i - 1][p], expected[p]);
+                    }
+                }
+
+                if (memcmp(decompressed, expected, pixelCount * sizeof(uint32_t)) != 0) {
+                    fprintf(stderr, "%s: %s does not round-trip frame %zu\n", set.name.c_str(), codec.name, i);
+                    exit(1);
+                }
+            }
+        }
+    }
+
+    PrintMeasurement(set, codec, "compress", compress, compressedBytes, false);
+    PrintMeasurement(set, codec, "decompress", decompress, compressedBytes, last);
+
+    for (size_t i = 0; i < frameCount; i++) {
+        free(compressed[i]);
+    }
+    free(expected);
+    free(decompressed);
+}
+
+int main(int argc, char** argv)
+{
+    uint32_t width = 480;
+    uint32_t height = 320;
+    size_t frameCount = 24;
+    int repetitions = 5;
+    int threads = 0;
+
+    int option;
+    while ((option = getopt(argc, argv, "w:h:f:r:j:")) != -1) {
+        switch (option) {
+            case 'w': width = atoi(optarg); break;
+            case 'h': height = atoi(optarg); break;
+            case 'f': frameCount = atoi(optarg); break;
+            case 'r': repetitions = atoi(optarg); break;
+            case 'j': threads = atoi(optarg); break;
+            default:
+                fprintf(stderr, "usage: bench [-w width] [-h height] [-f frames] [-r repetitions] [-j threads] [containers*]\n");
+                exit(1);
+        }
+    }
+
+    gThreadPool = AnimationThreadPoolCreate(threads);
+    if (gThreadPool == NULL) {
+        fprintf(stderr, "Can't create the thread pool\n");
+        exit(1);
+    }
+
+    std::vector<FrameSet> sets;
+    sets.push_back(CreateFrameSet("solid", width, height, frameCount));
+    sets.push_back(CreateFrameSet("gradient", width, height, frameCount));
+    sets.push_back(CreateFrameSet("sprites", width, height, frameCount));
+    sets.push_back(CreateFrameSet("noise", width, height, frameCount));
+    sets.push_back(CreateFrameSet("haze", width, height, frameCount));
+
+    for (int i = optind; i < argc; i++) {
+        FrameSet set;
+        if (!LoadFrameSet(argv[i], set)) {
+            fprintf(stderr, "Cannot load %s\n", argv[i]);
+            exit(1);
+        }
+        sets.push_back(set);
+    }
+
+    size_t codecCount = sizeof(kCodecs) / sizeof(kCodecs[0]);
+
+    printf("{\n");
+    printf("  \"benchmark\": \"animation-compression\",\n");
+    printf("  \"implementation\": \"%s\",\n", AnimationCompressionImplementationName());
+    printf("  \"repetitions\": %d,\n", repetitions);
+    printf("  \"threads\": %u,\n", AnimationThreadPoolGetThreadCount(gThreadPool));
+    printf("  \"results\": [\n");
+
+    for (size_t s = 0; s < sets.size(); s++) {
+        for (size_t c = 0; c < codecCount; c++) {
+            RunBenchmark(sets[s], kCodecs[c], repetitions, s == sets.size() - 1 && c == codecCount - 1);
+        }
+    }
+
+    printf("  ]\n");
+    printf("}\n");
+
+    AnimationThreadPoolDestroy(gThreadPool);
+
+    return 0;
+}
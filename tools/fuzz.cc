@@ -0,0 +1,158 @@
+/*
+ * (C) Copyright 2010, Stefan Arentz, Arentz Consulting Inc.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+//
+// fuzz.cc - fuzz the container parser and the checked decoders. this runs
+//     the same validation as -[Animation initWithContentsOfFile:] and then
+//     decodes every frame with the same decoder as -[Animation drawFrame:intoFrameBuffer:].
+//     inputs are also tried as archives of animations.
+//
+//   usage: fuzz corpus-directory       (built with libFuzzer, make fuzz)
+//          fuzz files*                 (replay, make fuzz-replay)
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include "../src/AnimationCommon.h"
+#include "../src/AnimationArchive.h"
+#include "../src/AnimationCompression.h"
+#include "../src/AnimationContainer.h"
+#include "../src/AnimationDecoder.h"
+
+// Keep the fuzzer from spending its time in huge allocations
+static const uint32_t kMaximumFuzzPixels = 1024 * 1024;
+
+static void DecodeContainer(const AnimationContainer* container)
+{
+    uint32_t count = container->header->width * container->header->height;
+    if (count > kMaximumFuzzPixels) {
+        return;
+    }
+
+    AnimationPixel* pixels = (AnimationPixel*) malloc((count + 1) * sizeof(AnimationPixel));
+    AnimationPixel* target = (AnimationPixel*) calloc(count + 1, sizeof(AnimationPixel));
+    if (pixels == NULL || target == NULL) {
+        free(pixels);
+        free(target);
+        return;
+    }
+
+    AnimationDecoder decoder;
+    AnimationDecoderInit(&decoder, container, NULL, NULL);
+
+    AnimationCanvas canvas;
+    AnimationCanvasInit(&canvas, pixels, container->header->width, container->header->height);
+
+    // In order first, which applies deltas one by one, then backwards,
+    // which decodes every delta chain from its keyframe
+
+    for (uint32_t i = 0; i < container->header->frameCount; i++) {
+        AnimationDecoderDrawFrame(&decoder, i, &canvas);
+    }
+
+    for (uint32_t i = container->header->frameCount; i > 0; i--) {
+        AnimationDecoderDrawFrame(&decoder, i - 1, &canvas);
+    }
+
+    // Composited over one another, straight from the data where possible
+
+    for (uint32_t i = 0; i < container->header->frameCount; i++) {
+        AnimationDecoderCompositeFrame(&decoder, i, &canvas, target, container->header->width, NULL);
+    }
+
+    free(target);
+    free(pixels);
+}
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, size_t size)
+{
+    // The parser casts headers straight out of the buffer, like it does with
+    // the NSData bytes, so hand it an aligned copy.
+
+    uint32_t* bytes = (uint32_t*) malloc(size + sizeof(uint32_t));
+    if (bytes == NULL) {
+        return 0;
+    }
+    memcpy(bytes, data, size);
+
+    AnimationContainer container;
+    if (AnimationContainerOpen(&container, bytes, size) == AnimationStatusOK) {
+        DecodeContainer(&container);
+        AnimationContainerClose(&container);
+    }
+
+    // The same input as an archive, decoding every animation in it
+
+    AnimationArchive archive;
+    if (AnimationArchiveOpen(&archive, bytes, size) == AnimationStatusOK)
+    {
+        for (uint32_t i = 0; i < AnimationArchiveGetCount(&archive); i++) {
+            if (AnimationArchiveOpenAnimation(&archive, i, &container) == AnimationStatusOK) {
+                DecodeContainer(&container);
+                AnimationContainerClose(&container);
+            }
+        }
+
+        AnimationArchiveClose(&archive);
+    }
+
+    free(bytes);
+
+    return 0;
+}
+
+#if !defined(ANIMATION_LIBFUZZER)
+
+int main(int argc, char** argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        int fd = open(argv[i], O_RDONLY);
+        if (fd == -1) {
+            fprintf(stderr, "Cannot open %s: %s\n", argv[i], strerror(errno));
+            exit(1);
+        }
+
+        struct stat st;
+        fstat(fd, &st);
+
+        uint8_t* data = (uint8_t*) malloc(st.st_size + 1);
+        if (data == NULL || read(fd, data, st.st_size) != st.st_size) {
+            fprintf(stderr, "Cannot read %s\n", argv[i]);
+            exit(1);
+        }
+
+        close(fd);
+
+        printf("Running %s\n", argv[i]);
+        LLVMFuzzerTestOneInput(data, st.st_size);
+
+        free(data);
+    }
+
+    return 0;
+}
+
+#endif
@@ -0,0 +1,325 @@
+/*
+ * (C) Copyright 2010, Stefan Arentz, Arentz Consulting Inc.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+//
+// hub.cc - plays containers to many simulated views through a hub, in real
+//     time, and reports how many frames were decoded for how many views.
+//     every view is a software sink that is checked against the shared
+//     canvas each time it gets a frame. with -i every view gets its own
+//     channel, which is what views cost without sharing. with -d every
+//     eighth frame takes that many milliseconds longer to decode, so the
+//     channels fall behind and seek, and views count frames that were shown
+//     out of order. results are written to stdout as json.
+//
+//     hub-trace is the same built with -DANIMATION_TRACE. its -T writes
+//     the decodes, deadline misses and presents of the run to trace.json,
+//     for chrome://tracing, and to trace.csv.
+//
+//   usage: hub [-v views] [-t tick-rate] [-s seconds] [-d stall-ms] [-i] container...
+//          hub-trace [-T trace] ...
+//
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "../src/AnimationClock.h"
+#include "../src/AnimationCommon.h"
+#include "../src/AnimationContainer.h"
+#include "../src/AnimationDecoder.h"
+#include "../src/AnimationHub.h"
+#include "../src/AnimationSink.h"
+#include "../src/AnimationTrace.h"
+
+// Frames are decoded this many frames ahead, minus the one on screen
+#define HubDepth 3
+
+// Frames that are a multiple of this stall with -d
+#define HubStallInterval 8
+
+#if defined(ANIMATION_TRACE)
+#define HubOptions "v:t:s:d:iT:"
+#define HubUsage "usage: hub-trace [-v views] [-t tick-rate] [-s seconds] [-d stall-ms] [-i] [-T trace] container...\n"
+// Enough for a few seconds of many views
+#define HubTraceCapacity 65536
+#else
+#define HubOptions "v:t:s:d:i"
+#define HubUsage "usage: hub [-v views] [-t tick-rate] [-s seconds] [-d stall-ms] [-i] container...\n"
+#endif
+
+struct Channel {
+    AnimationDecoder decoder;
+    useconds_t stall;
+};
+
+struct View {
+    AnimationSink* sink;
+    AnimationHubSubscriber* subscriber;
+    uint32_t frameCount;
+    uint32_t frame;             // Shown last, AnimationFrameNone before the first
+    uint64_t frames;
+    uint64_t errors;            // Frames where the view and the canvas differ
+    uint64_t reordered;         // Frames shown after a later one
+#if defined(ANIMATION_TRACE)
+    AnimationTrace* trace;
+#endif
+};
+
+static AnimationStatus DecodeFrame(void* context, uint32_t frame, AnimationCanvas* canvas)
+{
+    Channel* channel = (Channel*) context;
+    if (channel->stall != 0 && frame % HubStallInterval == 0) {
+        usleep(channel->stall);
+    }
+    return AnimationDecoderDrawFrame(&channel->decoder, frame, canvas);
+}
+
+static void PresentFrame(void* context, const AnimationCanvas* canvas, const AnimationRect* dirty)
+{
+    View* view = (View*) context;
+
+    if (canvas == NULL) {
+        view->frame = AnimationFrameNone;
+        return;
+    }
+
+    // Frames may be dropped, but none is shown twice or after a later one.
+    // A frame that came too early is never more than the decoded frames
+    // ahead, anything further back is a skip across the end of the loop.
+
+    if (view->frame != AnimationFrameNone) {
+        uint32_t behind = (view->frame + view->frameCount - canvas->frame) % view->frameCount;
+        if (behind < HubDepth) {
+            view->reordered++;
+        }
+    }
+    view->frame = canvas->frame;
+
+    ANIMATION_TRACE_BEGIN(presentStart);
+    AnimationSinkPresent(view->sink, canvas, dirty);
+    ANIMATION_TRACE_END(view->trace, AnimationTraceEventPresent, canvas->frame, presentStart);
+    view->frames++;
+
+    if (memcmp(AnimationSoftwareSinkGetPixels(view->sink), canvas->pixels, canvas->width * canvas->height * sizeof(AnimationPixel)) != 0) {
+        view->errors++;
+    }
+}
+
+#if defined(ANIMATION_TRACE)
+
+static void WriteTrace(AnimationTrace* trace, const std::string& path, bool csv)
+{
+    FILE* file = fopen(path.c_str(), "w");
+    if (file == NULL) {
+        fprintf(stderr, "Cannot create %s\n", path.c_str());
+        exit(1);
+    }
+
+    AnimationStatus status = csv ? AnimationTraceWriteCSV(trace, file) : AnimationTraceWriteJSON(trace, file);
+    if (fclose(file) != 0 || status != AnimationStatusOK) {
+        fprintf(stderr, "Cannot write %s\n", path.c_str());
+        exit(1);
+    }
+}
+
+#endif
+
+int main(int argc, char** argv)
+{
+    uint32_t viewCount = 16;
+    uint32_t tickRate = 60;
+    double seconds = 2.0;
+    uint32_t stall = 0;
+    bool independent = false;
+    const char* tracePath = NULL;
+
+    int option;
+    while ((option = getopt(argc, argv, HubOptions)) != -1) {
+        switch (option) {
+            case 'v': viewCount = atoi(optarg); break;
+            case 't': tickRate = atoi(optarg); break;
+            case 's': seconds = atof(optarg); break;
+            case 'd': stall = atoi(optarg); break;
+            case 'i': independent = true; break;
+            case 'T': tracePath = optarg; break;
+            default:
+                fprintf(stderr, HubUsage);
+                exit(1);
+        }
+    }
+
+    if (optind >= argc || viewCount == 0 || tickRate == 0 || seconds <= 0) {
+        fprintf(stderr, HubUsage);
+        exit(1);
+    }
+
+    uint32_t animationCount = argc - optind;
+
+    std::vector<AnimationContainer> containers(animationCount);
+    for (uint32_t i = 0; i < animationCount; i++) {
+        AnimationStatus status = AnimationContainerOpenFile(&containers[i], argv[optind + i]);
+        if (status != AnimationStatusOK) {
+            fprintf(stderr, "Cannot open %s (status %d)\n", argv[optind + i], status);
+            exit(1);
+        }
+    }
+
+    AnimationHub* hub = AnimationHubCreate(HubDepth);
+    if (hub == NULL) {
+        fprintf(stderr, "Can't allocate memory\n");
+        exit(1);
+    }
+
+#if defined(ANIMATION_TRACE)
+    // Channels pick up the trace when they are made, so it is set first
+    AnimationTrace* trace = NULL;
+    if (tracePath != NULL) {
+        trace = AnimationTraceCreate(HubTraceCapacity);
+        if (trace == NULL) {
+            fprintf(stderr, "Can't allocate memory\n");
+            exit(1);
+        }
+        AnimationHubSetTrace(hub, trace);
+    }
+#endif
+
+    // Views take turns between the containers. A decoder keeps the frame
+    // history of one channel, so there is one per channel.
+
+    std::vector<Channel> channels(independent ? viewCount : animationCount);
+    std::vector<View> views(viewCount);
+
+    for (uint32_t i = 0; i < viewCount; i++)
+    {
+        AnimationContainer* container = &containers[i % animationCount];
+        Channel* channel = &channels[independent ? i : i % animationCount];
+
+        if (independent || i < animationCount) {
+            AnimationDecoderInit(&channel->decoder, container, NULL, NULL);
+            channel->stall = stall * 1000;
+        }
+
+        AnimationHubSource source;
+        source.key = channel;
+        source.width = container->header->width;
+        source.height = container->header->height;
+        source.frameCount = container->header->frameCount;
+        source.frameRate = container->header->frameRate;
+        source.decode = DecodeFrame;
+        source.context = channel;
+
+        View* view = &views[i];
+        view->frameCount = source.frameCount;
+        view->frame = AnimationFrameNone;
+        view->frames = 0;
+        view->errors = 0;
+        view->reordered = 0;
+#if defined(ANIMATION_TRACE)
+        view->trace = trace;
+#endif
+        view->sink = AnimationSoftwareSinkCreate(source.width, source.height);
+        view->subscriber = (view->sink != NULL) ? AnimationHubSubscribe(hub, &source, PresentFrame, view) : NULL;
+        if (view->subscriber == NULL) {
+            fprintf(stderr, "Can't allocate memory\n");
+            exit(1);
+        }
+    }
+
+    // One timer for everything, like a display link
+
+    uint64_t start = AnimationClockNow();
+    uint64_t duration = (uint64_t) (seconds * AnimationClockNanosecondsPerSecond);
+    uint64_t busy = 0;
+
+    for (uint64_t tick = 0; ; tick++)
+    {
+        uint64_t time = start + tick * AnimationClockNanosecondsPerSecond / tickRate;
+        uint64_t now = AnimationClockNow();
+        if (time >= start + duration) {
+            break;
+        }
+        if (time > now) {
+            usleep((useconds_t) ((time - now) / 1000));
+        }
+
+        uint64_t tickStart = AnimationClockNow();
+        AnimationHubTick(hub, tickStart);
+        busy += AnimationClockNow() - tickStart;
+    }
+
+    AnimationHubStatistics statistics;
+    AnimationHubGetStatistics(hub, &statistics);
+
+    // Decoding happens on the channels' prefetchers, each counted once
+
+    uint64_t decoded = 0;
+    uint64_t viewFrames = 0;
+    uint64_t errors = 0;
+    uint64_t reordered = 0;
+
+    for (uint32_t i = 0; i < viewCount; i++)
+    {
+        if (independent || i < animationCount) {
+            AnimationPrefetcherStatistics prefetcher;
+            AnimationHubGetPrefetcherStatistics(views[i].subscriber, &prefetcher);
+            decoded += prefetcher.decodedFrames;
+        }
+        viewFrames += views[i].frames;
+        errors += views[i].errors;
+        reordered += views[i].reordered;
+    }
+
+    printf("{\n");
+    printf("  \"benchmark\": \"animation-hub\",\n");
+    printf("  \"animations\": %u, \"views\": %u, \"channels\": %u, \"tick_rate\": %u, \"seconds\": %.1f,\n",
+        animationCount, viewCount, statistics.channels, tickRate, seconds);
+    printf("  \"ticks\": %llu, \"frames\": %llu, \"deliveries\": %llu, \"underruns\": %llu, \"decoded\": %llu,\n",
+        (unsigned long long) statistics.ticks, (unsigned long long) statistics.frames,
+        (unsigned long long) statistics.deliveries, (unsigned long long) statistics.underruns, (unsigned long long) decoded);
+    printf("  \"decoded_per_view_frame\": %.3f, \"tick_us\": %.1f, \"errors\": %llu, \"reordered\": %llu\n",
+        viewFrames ? (double) decoded / viewFrames : 0.0, statistics.ticks ? busy / 1e3 / statistics.ticks : 0.0,
+        (unsigned long long) errors, (unsigned long long) reordered);
+    printf("}\n");
+
+#if defined(ANIMATION_TRACE)
+    if (trace != NULL) {
+        WriteTrace(trace, std::string(tracePath) + ".json", false);
+        WriteTrace(trace, std::string(tracePath) + ".csv", true);
+    }
+#endif
+
+    for (uint32_t i = 0; i < viewCount; i++) {
+        AnimationHubUnsubscribe(hub, views[i].subscriber);
+        AnimationSoftwareSinkDestroy(views[i].sink);
+    }
+    AnimationHubDestroy(hub);
+
+#if defined(ANIMATION_TRACE)
+    AnimationTraceDestroy(trace);
+#endif
+
+    for (uint32_t i = 0; i < animationCount; i++) {
+        AnimationContainerClose(&containers[i]);
+    }
+
+    return 0;
+}
@@ -0,0 +1,297 @@
+/*
+ * (C) Copyright 2010, Stefan Arentz, Arentz Consulting Inc.
+ *
+ * Licensed to the Apache Software Foundation (ASF) under one or more
+ * contributor license agreements.  See the NOTICE file distributed with
+ * this work for additional information regarding copyright ownership.
+ * The ASF licenses this file to You under the Apache License, Version 2.0
+ * (the "License"); you may not use this file except in compliance with
+ * the License.  You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+//
+// pace.cc - runs the player against a simulated display and reports how
+//     evenly frames reach the screen. the clock is simulated, so a run is
+//     repeatable and takes no real time. with a container every frame is
+//     really decoded and the measured decode time is added to the clock, and
+//     frames go to a software sink that counts the bytes dirty rectangles
+//     save and checks that it ends up with the same pixels as the decoder.
+//     with -b block compressed frames go to the sink as blocks, without
+//     being decoded. results are written to stdout as json.
+//
+//   usage: pace [-m drop|hold] [-r frame-rate] [-t tick-rate] [-j jitter-us]
+//               [-d decode-us] [-s seconds] [-b] [container]
+//
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "../src/AnimationClock.h"
+#include "../src/AnimationCommon.h"
+#include "../src/AnimationContainer.h"
+#include "../src/AnimationDecoder.h"
+#include "../src/AnimationPlayer.h"
+#include "../src/AnimationSink.h"
+
+struct Display {
+    uint64_t now;               // Simulated time of the tick being handled
+    uint64_t busyUntil;         // The display is drawing until then
+    uint64_t decodeCost;        // Simulated nanoseconds per frame
+    AnimationDecoder* decoder;
+    AnimationCanvas* canvas;
+    AnimationSink* sink;
+    bool blocks;                // Pass block compressed frames through
+    uint64_t sinkErrors;        // Frames where the sink and the canvas differ
+    std::vector<uint64_t> presentTimes;
+    uint64_t errors;
+};
+
+// A fixed xorshift generator so every run sees exactly the same jitter
+
+static uint32_t gRandomState = 0x9e3779b9;
+
+static uint32_t Random()
+{
+    gRandomState ^= gRandomState << 13;
+    gRandomState ^= gRandomState >> 17;
+    gRandomState ^= gRandomState << 5;
+    return gRandomState;
+}
+
+static AnimationStatus DrawFrame(void* context, uint32_t frame)
+{
+    Display* display = (Display*) context;
+
+    uint64_t cost = display->decodeCost;
+
+    if (display->decoder != NULL) {
+        const AnimationCanvas* canvas = display->canvas;
+
+        uint64_t start = AnimationClockNow();
+        bool passed = display->blocks && AnimationSinkPresentBlocks(display->sink, display->decoder->container, frame) == AnimationStatusOK;
+        if (!passed && AnimationDecoderDrawFrame(display->decoder, frame, display->canvas) != AnimationStatusOK) {
+            display->errors++;
+        }
+        cost += AnimationClockNow() - start;
+
+        // Frames that went through as blocks are still decoded, outside of
+        // the measured time, to check what the sink shows
+
+        const AnimationPixel* shown;
+        if (display->blocks) {
+            if (passed) {
+                AnimationDecoderDrawFrame(display->decoder, frame, display->canvas);
+            } else {
+                AnimationSinkPresent(display->sink, canvas, &canvas->dirty);
+            }
+            shown = AnimationBlockSinkGetPixels(display->sink);
+        } else {
+            AnimationSinkPresent(display->sink, canvas, &canvas->dirty);
+            shown = AnimationSoftwareSinkGetPixels(display->sink);
+        }
+
+        if (memcmp(shown, canvas->pixels, canvas->width * canvas->height * sizeof(AnimationPixel)) != 0) {
+            display->sinkErrors++;
+        }
+    }
+
+    display->busyUntil = display->now + cost;
+    display->presentTimes.push_back(display->busyUntil);
+
+    return AnimationStatusOK;
+}
+
+static uint64_t Percentile(const std::vector<uint64_t>& sorted, double p)
+{
+    if (sorted.empty()) {
+        return 0;
+    }
+    size_t i = (size_t) (p * (sorted.size() - 1) + 0.5);
+    return sorted[i];
+}
+
+int main(int argc, char** argv)
+{
+    AnimationPlayerMode mode = AnimationPlayerModeDrop;
+    uint32_t frameRate = 0;
+    uint32_t tickRate = 60;
+    uint64_t jitter = 2000;
+    uint64_t decodeCost = 0;
+    double seconds = 10.0;
+    bool blocks = false;
+
+    int option;
+    while ((option = getopt(argc, argv, "m:r:t:j:d:s:b")) != -1) {
+        switch (option) {
+            case 'm': mode = (strcmp(optarg, "hold") == 0) ? AnimationPlayerModeHold : AnimationPlayerModeDrop; break;
+            case 'r': frameRate = atoi(optarg); break;
+            case 't': tickRate = atoi(optarg); break;
+            case 'j': jitter = strtoull(optarg, NULL, 10) * 1000; break;
+            case 'd': decodeCost = strtoull(optarg, NULL, 10) * 1000; break;
+            case 's': seconds = atof(optarg); break;
+            case 'b': blocks = true; break;
+            default:
+                fprintf(stderr, "usage: pace [-m drop|hold] [-r frame-rate] [-t tick-rate] [-j jitter-us] [-d decode-us] [-s seconds] [-b] [container]\n");
+                exit(1);
+        }
+    }
+
+    if (tickRate == 0 || seconds <= 0) {
+        fprintf(stderr, "The tick rate and the duration have to be positive\n");
+        exit(1);
+    }
+
+    Display display;
+    display.now = 0;
+    display.busyUntil = 0;
+    display.decodeCost = decodeCost;
+    display.decoder = NULL;
+    display.canvas = NULL;
+    display.sink = NULL;
+    display.blocks = blocks;
+    display.sinkErrors = 0;
+    display.errors = 0;
+
+    // Without a container the player runs a second worth of frames
+
+    uint32_t frameCount = (frameRate != 0) ? frameRate : AnimationPlayerDefaultFrameRate;
+
+    AnimationContainer container;
+    AnimationDecoder decoder;
+    AnimationCanvas canvas;
+    std::vector<AnimationPixel> pixels;
+
+    if (optind < argc)
+    {
+        AnimationStatus status = AnimationContainerOpenFile(&container, argv[optind]);
+        if (status != AnimationStatusOK) {
+            fprintf(stderr, "Cannot open %s (status %d)\n", argv[optind], status);
+            exit(1);
+        }
+
+        if (frameRate == 0) {
+            frameRate = container.header->frameRate;
+        }
+        frameCount = container.header->frameCount;
+
+        pixels.resize((size_t) container.header->width * container.header->height);
+        AnimationDecoderInit(&decoder, &container, NULL, NULL);
+        AnimationCanvasInit(&canvas, &pixels[0], container.header->width, container.header->height);
+
+        display.decoder = &decoder;
+        display.canvas = &canvas;
+        if (blocks) {
+            display.sink = AnimationBlockSinkCreate(container.header->width, container.header->height);
+        } else {
+            display.sink = AnimationSoftwareSinkCreate(container.header->width, container.header->height);
+        }
+        if (display.sink == NULL) {
+            fprintf(stderr, "Can't allocate memory\n");
+            exit(1);
+        }
+    }
+
+    AnimationPlayer player;
+    AnimationPlayerInit(&player, frameCount, frameRate, mode, DrawFrame, &display);
+    AnimationPlayerStart(&player, 0, 0);
+
+    // Ticks come at the tick rate, each up to the jitter late. A tick that
+    // comes while the previous frame is still being drawn waits for it.
+
+    uint64_t duration = (uint64_t) (seconds * AnimationClockNanosecondsPerSecond);
+    uint64_t lastTick = 0;
+
+    for (uint64_t tick = 0; ; tick++)
+    {
+        uint64_t time = tick * AnimationClockNanosecondsPerSecond / tickRate + ((jitter != 0) ? Random() % jitter : 0);
+        if (time >= duration) {
+            break;
+        }
+        if (time < display.busyUntil) {
+            continue;
+        }
+
+        display.now = time;
+        AnimationPlayerTick(&player, time);
+        lastTick = time;
+    }
+
+    // How evenly frames reached the screen
+
+    std::vector<uint64_t> intervals;
+    for (size_t i = 1; i < display.presentTimes.size(); i++) {
+        intervals.push_back(display.presentTimes[i] - display.presentTimes[i - 1]);
+    }
+
+    double mean = 0;
+    for (size_t i = 0; i < intervals.size(); i++) {
+        mean += intervals[i];
+    }
+    mean = intervals.empty() ? 0 : mean / intervals.size();
+
+    double variance = 0;
+    for (size_t i = 0; i < intervals.size(); i++) {
+        variance += (intervals[i] - mean) * (intervals[i] - mean);
+    }
+    variance = intervals.empty() ? 0 : variance / intervals.size();
+
+    std::sort(intervals.begin(), intervals.end());
+
+    // Drift is how far the frame on screen is behind the one the clock said
+    // was due at the last tick, with the same tolerance as the player
+
+    const AnimationPlayerStatistics& statistics = player.statistics;
+    uint64_t expected = (lastTick + AnimationPlayerTolerance) * player.frameRate / AnimationClockNanosecondsPerSecond;
+    double drift = (double) expected - (double) player.position;
+
+    printf("{\n");
+    printf("  \"benchmark\": \"animation-pacing\",\n");
+    printf("  \"mode\": \"%s\", \"frame_rate\": %u, \"tick_rate\": %u, \"jitter_us\": %llu, \"decode_us\": %llu, \"seconds\": %.1f,\n",
+        (mode == AnimationPlayerModeHold) ? "hold" : "drop", player.frameRate, tickRate,
+        (unsigned long long) (jitter / 1000), (unsigned long long) (decodeCost / 1000), seconds);
+    printf("  \"ticks\": %llu, \"presented\": %llu, \"dropped\": %llu, \"held\": %llu, \"missed\": %llu, \"slipped\": %llu, \"errors\": %llu,\n",
+        (unsigned long long) statistics.ticks, (unsigned long long) statistics.presented, (unsigned long long) statistics.dropped,
+        (unsigned long long) statistics.held, (unsigned long long) statistics.missed, (unsigned long long) statistics.slipped,
+        (unsigned long long) display.errors);
+    printf("  \"lateness_us\": {\"mean\": %.1f, \"max\": %.1f},\n",
+        statistics.presented ? statistics.totalLateness / 1e3 / statistics.presented : 0.0, statistics.maxLateness / 1e3);
+    printf("  \"interval_us\": {\"expected\": %.1f, \"mean\": %.1f, \"stddev\": %.1f, \"p50\": %.1f, \"p95\": %.1f, \"max\": %.1f},\n",
+        1e6 / player.frameRate, mean / 1e3, sqrt(variance) / 1e3, Percentile(intervals, 0.50) / 1e3,
+        Percentile(intervals, 0.95) / 1e3, Percentile(intervals, 1.0) / 1e3);
+    printf("  \"drift_frames\": %.0f%s\n", drift, (display.sink != NULL) ? "," : "");
+
+    if (display.sink != NULL) {
+        const AnimationSinkStatistics& sink = display.sink->statistics;
+        printf("  \"sink\": {\"frames\": %llu, \"unchanged_frames\": %llu, \"block_frames\": %llu, \"presented_bytes\": %llu, \"frame_bytes\": %llu, \"saved\": %.3f, \"errors\": %llu}\n",
+            (unsigned long long) sink.frames, (unsigned long long) sink.unchangedFrames, (unsigned long long) sink.blockFrames,
+            (unsigned long long) sink.presentedBytes,
+            (unsigned long long) sink.frameBytes, sink.frameBytes ? 1.0 - (double) sink.presentedBytes / sink.frameBytes : 0.0,
+            (unsigned long long) display.sinkErrors);
+    }
+
+    printf("}\n");
+
+    if (display.decoder != NULL) {
+        if (blocks) {
+            AnimationBlockSinkDestroy(display.sink);
+        } else {
+            AnimationSoftwareSinkDestroy(display.sink);
+        }
+        AnimationContainerClose(&container);
+    }
+
+    return 0;
+}
@@ -18,169 +18,115 @@
  */
 
 //
-// raw.cc - compress a collection of images to an animation container
+// raw.cc - compress a collection of images to an animation container. images
+//     are cropped to their content and stored as uncompressed pixels.
 //
-//  usage: raw destination.animation width height files*
+//  usage: raw [-r rate] destination.animation width height files*
+//
+//     -r rate      frame rate stored in the container, defaults to 12
 //
 
-#include <ApplicationServices/ApplicationServices.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
 #include "../src/AnimationCommon.h"
+#include "../src/AnimationCompression.h"
+#include "AnimationContainerWriter.h"
+#include "AnimationImageReader.h"
 
-void GetCropBox(uint32_t* buffer, int width, int height, int& top, int& left, int& bottom, int& right)
+int main(int argc, char** argv)
 {
-    top = left = bottom = right = -1;
-
-    for (int y = 0, done = 0; y < height && done == 0; y++) {
-        for (int x = 0; x < width && done == 0; x++) {
-            if (buffer[(y * width) + x] != 0) {
-                done = 1;
-                top = y;
-            }
-        }
-    }
-    
-    for (int x = 0, done = 0; x < width && done == 0; x++) {
-        for (int y = 0; y < height && done == 0; y++) {
-            if (buffer[(y * width) + x] != 0) {
-                done = 1;
-                left = x;
-            }
+    // Parse command line arguments
+
+    int frameRate = 12;
+
+    int option;
+    while ((option = getopt(argc, argv, "r:")) != -1) {
+        switch (option) {
+            case 'r':
+                frameRate = atoi(optarg);
+                break;
+            default:
+                fprintf(stderr, "usage: raw [-r rate] destination.animation width height files*\n");
+                exit(1);
         }
     }
 
-    for (int y = height-1, done = 0; y >= 0 && done == 0; y--) {
-        for (int x = 0; x < width && done == 0; x++) {
-            if (buffer[(y * width) + x] != 0) {
-                done = 1;
-                bottom = y;
-            }
-        }
+    argc -= optind;
+    argv += optind;
+
+    if (argc < 3 || frameRate < 1) {
+        fprintf(stderr, "usage: raw [-r rate] destination.animation width height files*\n");
+        exit(1);
     }
-    
-    for (int x = width - 1, done = 0; x >= 0 && done == 0; x--) {
-        for (int y = 0; y < height && done == 0; y++) {
-            if (buffer[(y * width) + x] != 0) {
-                done = 1;
-                right = x;
-            }
-        }
+
+    int width = atoi(argv[1]);
+    int height = atoi(argv[2]);
+    int frameCount = argc - 3;
+
+    // Create the animation container
+
+    AnimationContainerWriter writer;
+    if (!writer.Open(argv[0], width, height, frameRate, frameCount)) {
+        fprintf(stderr, "Cannot create %s: %s\n", argv[0], writer.Error());
+        exit(1);
     }
-}
 
-int main(int argc, char** argv)
-{
-    // Parse command line arguments
+    // Create a buffer for the images
 
-    int width = atoi(argv[2]);
-    int height = atoi(argv[3]);
+    uint32_t* buffer = (uint32_t*) calloc(width * height, sizeof(uint32_t));
+    uint32_t* croppedBuffer = (uint32_t*) calloc(width * height, sizeof(uint32_t));
+    if (buffer == NULL || croppedBuffer == NULL) {
+        fprintf(stderr, "Can't allocate memory\n");
+        exit(1);
+    }
 
-    // Create the animation container
+    // Write all the images
 
-    int fd = open(argv[1], O_WRONLY | O_CREAT | O_TRUNC, 0644);
-    if (fd != -1)
+    for (int i = 3; i < argc; i++)
     {
-        // Create a buffer for the images
-
-        uint32_t* buffer = (uint32_t*) calloc( width * height, sizeof(uint32_t));
-
-        // Write the container header
-
-        AnimationContainerGlobalHeader containerHeader;
-        containerHeader.magic = 'anim';
-        containerHeader.version = 1;
-        containerHeader.width = width;
-        containerHeader.height = height;
-        containerHeader.frameRate = 12;
-        containerHeader.frameCount = argc - 4;
-
-        write(fd, &containerHeader, sizeof(containerHeader));
-
-        // Write all the images
-
-        for (int i = 4; i < argc; i++)
-        {
-            char* path = argv[i];
-
-            // Write the image header
-            
-            AnimationContainerImageHeader imageHeader;
-            imageHeader.width = width;
-            imageHeader.height = height;
-            imageHeader.xoffset = 0;
-            imageHeader.yoffset = 0;
-            imageHeader.format = AnimationContainerImageFormatUncompressedPixels;
-            imageHeader.dataLength = width * height * 4;
-
-            write(fd, &imageHeader, sizeof(imageHeader));
-
-            // Uncompress the image
-
-            memset(buffer, 0x00, width * height * sizeof(uint32_t));
-
-            CGDataProviderRef provider = CGDataProviderCreateWithFilename(path);
-            if (provider != NULL)
-            {
-                CGImageRef image = CGImageCreateWithPNGDataProvider(provider, NULL, false, kCGRenderingIntentDefault);
-                if (image != NULL)
-                {
-                    size_t imageWidth = CGImageGetWidth(image);
-                    size_t imageHeight = CGImageGetHeight(image);
-
-                    if (imageWidth != width || imageHeight != height) {
-                        fprintf(stderr, "Image %s is not of size %dx%d\n", path, width, height);
-                        exit(1);
-                    }
-                    
-                    // Create a new bitmap
-                    
-                    CGContextRef context = CGBitmapContextCreate(
-                        (void*) buffer,
-                        width,
-                        height,
-                        8,                             // Bits per component
-                        width * 4,                     // Bytes per row
-                        CGImageGetColorSpace(image),
-                        kCGImageAlphaPremultipliedLast // RRRRRRRRRGGGGGGGGBBBBBBBBAAAAAAAA
-                    );
-                        
-                    if (context != NULL)
-                    {
-                        CGContextDrawImage(context, CGRectMake(0.0f, 0.0f, width, height), image);
-                        CGContextRelease(context);
-                    }
-                    
-                    CGImageRelease(image);
-                }
-                
-                CFRelease(provider);
-            }
-
-            // Crop the image
-
-            int top, left, bottom, right;
-            GetCropBox(buffer, width, height, top, left, bottom, right);
-            
-            int croppedWidth = right - left;
-            int croppedHeight = bottom - top;
-
-            uint32_t* croppedBuffer = (uint32_t*) calloc(width * height, sizeof(uint32_t));
-            if (croppedBuffer != NULL)
-            {
-                uint32_t* p = croppedBuffer;
-                for (int y = top; y <= bottom; y++) {
-                    for (int x = left; x <= right; x++) {
-                        *p++ = buffer[(y * width) + x];
-                    }
-                }
-
-                // Write the image data
-                write(fd, croppedBuffer, croppedWidth * croppedHeight * sizeof(uint32_t));
-
-                free(croppedBuffer);
-            }
+        char* path = argv[i];
 
+        // Uncompress the image
+
+        std::string error;
+        if (!AnimationReadPNGImage(path, buffer, width, height, error)) {
+            fprintf(stderr, "Cannot read %s: %s\n", path, error.c_str());
+            writer.Abort();
+            exit(1);
+        }
+
+        // Crop the image
+
+        AnimationRect rect;
+        AnimationFindContentRect(buffer, width, height, &rect);
+        AnimationCopyRect(croppedBuffer, buffer, width, &rect);
+
+        // Write the image
+        
+        AnimationContainerImageHeader imageHeader;
+        imageHeader.width = rect.width;
+        imageHeader.height = rect.height;
+        imageHeader.xoffset = rect.x;
+        imageHeader.yoffset = rect.y;
+        imageHeader.format = AnimationContainerImageFormatUncompressedPixels;
+        imageHeader.dataLength = rect.width * rect.height * sizeof(uint32_t);
+
+        if (!writer.WriteImage(imageHeader, croppedBuffer)) {
+            fprintf(stderr, "Cannot write %s: %s\n", argv[0], writer.Error());
+            writer.Abort();
+            exit(1);
         }
+    }
+
+    free(croppedBuffer);
+    free(buffer);
+
+    // Write the frame index and move the container into place
 
-        close(fd);
+    if (!writer.Commit()) {
+        fprintf(stderr, "Cannot write %s: %s\n", argv[0], writer.Error());
+        exit(1);
     }
 }
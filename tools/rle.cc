@@ -19,155 +19,790 @@
 
 //
 // rle.cc - compress a collection of images to an animation container. images are
-//     compressed using a simple run-length encoding.
+//     cropped to their content, compressed using a simple run-length encoding
+//     on a pool of worker threads and written to the container in order.
 //
-//   usage: raw destination.animation width height files*
+//   usage: rle [-e encoding] [-b rows] [-j jobs] [-k interval] [-r rate] [-n] destination.animation width height files*
+//
+//     -e encoding  rlen (default), rleb, rle2, rle2-565 or rle2-4444. rleb is
+//                  rlen cut into bands of rows that players can decode on
+//                  several cores at once. rle2 stores run
+//                  counts as varints and unique pixels as literal spans. the
+//                  565 and 4444 variants round pixels to 16 bits; rle2-565
+//                  falls back to 32-bit pixels for frames that are not opaque.
+//                  pal8 and pal4 store an index per pixel into a palette of
+//                  at most 256 or 16 colors shared by all frames. all images
+//                  are read once up front to pick the palette.
+//                  dxt5 stores 4x4 blocks of 16 bytes in the BC3 layout
+//                  that GPUs can show without decoding. it is lossy, frames
+//                  are rounded to what the blocks decode to before deltas
+//                  are made
+//     -b rows      band height for rleb, defaults to 32
+//     -j jobs      number of worker threads, defaults to the number of cpus
+//     -k interval  store frames as deltas of the previous frame, with a full
+//                  keyframe every interval frames. deltas are only used when
+//                  they are smaller than the full frame
+//     -r rate      frame rate stored in the container, defaults to 12
+//     -n           skip the decompress-and-compare sanity check
 //
 
-#include <ApplicationServices/ApplicationServices.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <algorithm>
+#include <map>
+#include <vector>
 #include "../src/AnimationCommon.h"
 #include "../src/AnimationCompression.h"
+#include "../src/AnimationBufferPool.h"
+#include "AnimationContainerWriter.h"
+#include "AnimationImageReader.h"
 
-int main(int argc, char** argv)
+// A frame slot in the encoder window. Workers fill it, the writer drains it.
+
+struct EncoderFrame {
+    uint32_t* compressedBuffer;
+    uint32_t compressedLength;
+    uint32_t format;
+    AnimationRect rect;
+    bool done;
+};
+
+struct Encoder {
+    int width;
+    int height;
+    int frameCount;
+    char** paths;
+    bool check;
+    int keyframeInterval;
+    uint32_t format;
+    AnimationPixelMode pixelMode;
+    uint32_t bandHeight;
+
+    // For palette encodings, the palette and what each color in the images
+    // maps to. Both are filled before the workers start and only read after.
+
+    std::vector<uint32_t> palette;
+    std::map<uint32_t, uint32_t> paletteMap;
+
+    // At most windowSize frames are in flight between the workers and the
+    // writer, which bounds memory no matter how many frames there are.
+
+    int windowSize;
+    EncoderFrame* frames;
+    AnimationBufferPool* compressedBuffers;
+    uint64_t arenaAllocations;
+
+    pthread_mutex_t lock;
+    pthread_cond_t frameDone;
+    pthread_cond_t frameWritten;
+    int nextFrame;
+    int writtenFrames;
+};
+
+// The worst case is a run per pixel, plus the band table of rleb with a band
+// per row
+
+static uint32_t CompressedBufferSize(int width, int height)
 {
-    // Parse command line arguments
+    return (width * height * 2 + height + 2) * sizeof(uint32_t);
+}
 
-    int width = atoi(argv[2]);
-    int height = atoi(argv[3]);
+// Block compression is lossy. Frames are compressed whole, on the canvas's
+// block grid, and replaced by what the decoder makes of that, so cropping,
+// deltas and the sanity check all see what the player will see.
 
-    // Create the animation container
+static void RoundToBlocks(uint32_t* pixels, uint8_t* blocks, int width, int height)
+{
+    uint32_t length = AnimationBlockCompressedLength(width, height);
+    AnimationCompressBlockPixels(blocks, length, pixels, width, height);
+    AnimationDecompressBlockPixelsRect(pixels, width, width, height, blocks, length);
+}
+
+// Grows rect to whole blocks, except where it ends at the edge of the image
+
+static void AlignToBlocks(AnimationRect* rect, int width, int height)
+{
+    if (rect->width == 0 || rect->height == 0) {
+        return;
+    }
+
+    uint32_t right = std::min((rect->x + rect->width + 3) & ~3u, (uint32_t) width);
+    uint32_t bottom = std::min((rect->y + rect->height + 3) & ~3u, (uint32_t) height);
+
+    rect->x &= ~3u;
+    rect->y &= ~3u;
+    rect->width = right - rect->x;
+    rect->height = bottom - rect->y;
+}
+
+// Copies the blocks of an aligned rect out of the blocks of the whole image
+
+static uint32_t CopyBlocks(uint8_t* dst, const uint8_t* blocks, int width, const AnimationRect& rect)
+{
+    uint32_t blocksPerRow = (width + 3) / 4;
+    uint32_t columns = (rect.width + 3) / 4;
+    uint32_t rows = (rect.height + 3) / 4;
+
+    for (uint32_t y = 0; y < rows; y++) {
+        memcpy(dst + y * columns * AnimationPixelBlockLength,
+            blocks + ((rect.y / 4 + y) * blocksPerRow + rect.x / 4) * AnimationPixelBlockLength, columns * AnimationPixelBlockLength);
+    }
+
+    return rows * columns * AnimationPixelBlockLength;
+}
 
-    int fd = open(argv[1], O_WRONLY | O_CREAT | O_TRUNC, 0644);
-    if (fd == -1) {
-        fprintf(stderr, "Cannot create %s: %s\n", argv[1], strerror(errno));
+static void DecodeImage(const char* path, uint32_t* buffer, int width, int height)
+{
+    std::string error;
+    if (!AnimationReadPNGImage(path, buffer, width, height, error)) {
+        fprintf(stderr, "Cannot read %s: %s\n", path, error.c_str());
         exit(1);
     }
+}
 
-    // Create a buffer for the images
+// Palette selection. If the images use few enough colors they are the
+// palette. Otherwise colors are grouped by median cut: the box of colors
+// with the widest channel is split at the weighted median of that channel
+// until there are enough boxes, and each box becomes its weighted mean.
+// Fully transparent is always kept exact so cropping still works.
 
-    uint32_t* buffer = (uint32_t*) calloc(width * height, sizeof(uint32_t));
+struct PaletteColor {
+    uint32_t color;
+    uint64_t count;
+};
 
-    // Write the container header
+struct PaletteBox {
+    size_t begin;
+    size_t end;
+    int channel;
+    uint32_t range;
+};
 
-    AnimationContainerGlobalHeader containerHeader;
-    containerHeader.magic = 'anim';
-    containerHeader.version = 1;
-    containerHeader.width = width;
-    containerHeader.height = height;
-    containerHeader.frameRate = 12;
-    containerHeader.frameCount = argc - 4;
+struct PaletteChannelOrder {
+    int shift;
+    bool operator()(const PaletteColor& a, const PaletteColor& b) const {
+        return ((a.color >> shift) & 0xff) < ((b.color >> shift) & 0xff);
+    }
+};
 
-    write(fd, &containerHeader, sizeof(containerHeader));
+static void MeasureBox(const std::vector<PaletteColor>& colors, PaletteBox& box)
+{
+    box.range = 0;
+    box.channel = 0;
 
-    // Write all the images
+    for (int channel = 0; channel < 4; channel++)
+    {
+        uint32_t low = 255, high = 0;
+        for (size_t i = box.begin; i < box.end; i++) {
+            uint32_t v = (colors[i].color >> (channel * 8)) & 0xff;
+            low = std::min(low, v);
+            high = std::max(high, v);
+        }
+        if (high - low > box.range || channel == 0) {
+            box.range = high - low;
+            box.channel = channel;
+        }
+    }
+}
+
+static void BuildPalette(Encoder* encoder, const std::map<uint32_t, uint64_t>& histogram, size_t maxColors)
+{
+    std::vector<PaletteColor> colors;
+    bool transparent = false;
+
+    for (std::map<uint32_t, uint64_t>::const_iterator i = histogram.begin(); i != histogram.end(); ++i) {
+        if (i->first == 0) {
+            transparent = true;
+        } else {
+            PaletteColor color = { i->first, i->second };
+            colors.push_back(color);
+        }
+    }
 
-    for (int i = 4; i < argc; i++)
+    if (transparent) {
+        encoder->palette.push_back(0);
+        maxColors--;
+    }
+
+    // Fully transparent images have no colors to split, the palette is
+    // just the transparent entry
+
+    std::vector<PaletteBox> boxes;
+    if (!colors.empty()) {
+        PaletteBox box = { 0, colors.size(), 0, 0 };
+        MeasureBox(colors, box);
+        boxes.push_back(box);
+    }
+
+    while (!boxes.empty() && boxes.size() < maxColors)
     {
-        char* path = argv[i];
-        printf("Processing %s\n", path);
-        
-        // Uncompress the image
-        
-        memset(buffer, 0x00, width * height * sizeof(uint32_t));
-        
-        CGDataProviderRef provider = CGDataProviderCreateWithFilename(path);
-        if (provider != NULL)
+        size_t widest = 0;
+        for (size_t i = 1; i < boxes.size(); i++) {
+            if (boxes[i].range > boxes[widest].range) {
+                widest = i;
+            }
+        }
+
+        PaletteBox box = boxes[widest];
+        if (box.range == 0) {
+            break;
+        }
+
+        PaletteChannelOrder order = { box.channel * 8 };
+        std::sort(colors.begin() + box.begin, colors.begin() + box.end, order);
+
+        uint64_t total = 0;
+        for (size_t i = box.begin; i < box.end; i++) {
+            total += colors[i].count;
+        }
+
+        size_t split = box.begin + 1;
+        for (uint64_t sum = colors[box.begin].count; split < box.end - 1 && sum * 2 < total; split++) {
+            sum += colors[split].count;
+        }
+
+        PaletteBox low = { box.begin, split, 0, 0 };
+        PaletteBox high = { split, box.end, 0, 0 };
+        MeasureBox(colors, low);
+        MeasureBox(colors, high);
+
+        boxes[widest] = low;
+        boxes.push_back(high);
+    }
+
+    // Weighted means keep color <= alpha, so the palette stays premultiplied
+
+    for (size_t b = 0; b < boxes.size(); b++)
+    {
+        uint64_t sums[4] = { 0, 0, 0, 0 };
+        uint64_t total = 0;
+
+        for (size_t i = boxes[b].begin; i < boxes[b].end; i++) {
+            for (int channel = 0; channel < 4; channel++) {
+                sums[channel] += ((colors[i].color >> (channel * 8)) & 0xff) * colors[i].count;
+            }
+            total += colors[i].count;
+        }
+
+        uint32_t color = 0;
+        for (int channel = 0; channel < 4; channel++) {
+            color |= (uint32_t) ((sums[channel] + total / 2) / total) << (channel * 8);
+        }
+        encoder->palette.push_back(color);
+    }
+
+    // Map every color that occurs to the nearest palette entry
+
+    for (std::map<uint32_t, uint64_t>::const_iterator i = histogram.begin(); i != histogram.end(); ++i)
+    {
+        uint32_t best = 0;
+        uint32_t bestDistance = UINT32_MAX;
+
+        for (size_t p = 0; p < encoder->palette.size() && bestDistance != 0; p++)
         {
-            CGImageRef image = CGImageCreateWithPNGDataProvider(provider, NULL, false, kCGRenderingIntentDefault);
-            if (image != NULL)
-            {
-                size_t imageWidth = CGImageGetWidth(image);
-                size_t imageHeight = CGImageGetHeight(image);
-                
-                if (imageWidth != width || imageHeight != height) {
-                    fprintf(stderr, "Image %s is not of size %dx%d\n", path, width, height);
-                    exit(1);
-                }
-                
-                // Create a new bitmap
-                
-                CGContextRef context = CGBitmapContextCreate(
-                    (void*) buffer,
-                    width,
-                    height,
-                    8,                             // Bits per component
-                    width * 4,                     // Bytes per row
-                    CGImageGetColorSpace(image),
-                    kCGImageAlphaPremultipliedLast // RRRRRRRRRGGGGGGGGBBBBBBBBAAAAAAAA
-                );
-                        
-                if (context != NULL)
-                {
-                    CGContextDrawImage(context, CGRectMake(0.0f, 0.0f, width, height), image);
-                    CGContextRelease(context);
-                }
-                
-                CGImageRelease(image);
+            uint32_t distance = 0;
+            for (int channel = 0; channel < 4; channel++) {
+                int d = (int) ((i->first >> (channel * 8)) & 0xff) - (int) ((encoder->palette[p] >> (channel * 8)) & 0xff);
+                distance += d * d;
+            }
+            if (distance < bestDistance) {
+                best = encoder->palette[p];
+                bestDistance = distance;
             }
-            
-            CFRelease(provider);
         }
 
-        // Compress the buffer
-        
-        uint32_t* compressedBuffer = (uint32_t*) malloc(width * height * sizeof(uint32_t) * 2);
-        if (compressedBuffer == NULL) {
+        encoder->paletteMap[i->first] = best;
+    }
+}
+
+static void ApplyPalette(Encoder* encoder, uint32_t* pixels, int count)
+{
+    uint32_t last = 0;
+    uint32_t mapped = encoder->paletteMap.count(0) ? encoder->paletteMap.find(0)->second : 0;
+
+    for (int i = 0; i < count; i++) {
+        if (pixels[i] != last) {
+            last = pixels[i];
+            mapped = encoder->paletteMap.find(last)->second;
+        }
+        pixels[i] = mapped;
+    }
+}
+
+static void* EncoderWorker(void* argument)
+{
+    Encoder* encoder = (Encoder*) argument;
+
+    int pixelCount = encoder->width * encoder->height;
+    uint32_t compressedSize = CompressedBufferSize(encoder->width, encoder->height);
+
+    // The decoded image and the previous one live as long as the worker. The
+    // other buffers only live for one frame and come from a scratch arena
+    // that is reset per frame, sized up front for the worst case.
+
+    uint32_t* buffer = (uint32_t*) calloc(pixelCount, sizeof(uint32_t));
+    uint32_t* previousBuffer = (uint32_t*) calloc(pixelCount, sizeof(uint32_t));
+    if (buffer == NULL || previousBuffer == NULL) {
+        printf("Can't allocate memory\n");
+        exit(1);
+    }
+
+    // Per frame: the cropped image, the blocks for dxt5, the cropped
+    // previous image and the delta for -k, and the image for the check
+
+    size_t arenaSize = pixelCount * sizeof(uint32_t) * 5 + AnimationBufferAlignment * 5;
+    if (encoder->format == AnimationContainerImageFormatBlockCompressedPixels) {
+        arenaSize += AnimationBlockCompressedLength(encoder->width, encoder->height);
+    }
+
+    AnimationArena arena;
+    AnimationArenaInit(&arena, arenaSize);
+
+    // The frame currently in previousBuffer. A worker that gets consecutive
+    // frames does not have to decode the previous image again for a delta.
+
+    int previousFrame = -1;
+
+    while (true)
+    {
+        // Claim the next frame once its slot in the window is free
+
+        pthread_mutex_lock(&encoder->lock);
+        while (encoder->nextFrame < encoder->frameCount && encoder->nextFrame - encoder->writtenFrames >= encoder->windowSize) {
+            pthread_cond_wait(&encoder->frameWritten, &encoder->lock);
+        }
+        int i = encoder->nextFrame;
+        if (i < encoder->frameCount) {
+            encoder->nextFrame++;
+        }
+        pthread_mutex_unlock(&encoder->lock);
+
+        if (i >= encoder->frameCount) {
+            break;
+        }
+
+        EncoderFrame* frame = &encoder->frames[i % encoder->windowSize];
+
+        // The window never holds more frames than the pool has buffers
+
+        frame->compressedBuffer = (uint32_t*) AnimationBufferPoolAcquire(encoder->compressedBuffers);
+
+        AnimationArenaReset(&arena);
+        uint32_t* croppedBuffer = (uint32_t*) AnimationArenaAllocate(&arena, pixelCount * sizeof(uint32_t));
+        if (frame->compressedBuffer == NULL || croppedBuffer == NULL) {
             printf("Can't allocate memory\n");
             exit(1);
         }
 
-        uint32_t compressedLength = AnimationCompressRunLengthEncodedPixels(compressedBuffer, buffer, width * height);
-        printf("Compressed length = %d\n", compressedLength);
+        // Uncompress the image. With a 16-bit pixel mode the image is rounded
+        // right away, so everything below works on what the player will see.
+
+        DecodeImage(encoder->paths[i], buffer, encoder->width, encoder->height);
+
+        AnimationPixelMode pixelMode = encoder->pixelMode;
+        if (!AnimationQuantizePixels(buffer, pixelCount, pixelMode)) {
+            pixelMode = AnimationPixelModeRGBA8888;
+        }
+
+        if (!encoder->palette.empty()) {
+            ApplyPalette(encoder, buffer, pixelCount);
+        }
+
+        bool blocks = (encoder->format == AnimationContainerImageFormatBlockCompressedPixels);
+        uint8_t* blockBuffer = NULL;
+
+        if (blocks) {
+            blockBuffer = (uint8_t*) AnimationArenaAllocate(&arena, AnimationBlockCompressedLength(encoder->width, encoder->height));
+            if (blockBuffer == NULL) {
+                printf("Can't allocate memory\n");
+                exit(1);
+            }
+            RoundToBlocks(buffer, blockBuffer, encoder->width, encoder->height);
+        }
+
+        // Crop the image to its content and compress that
+
+        AnimationFindContentRect(buffer, encoder->width, encoder->height, &frame->rect);
+        if (blocks) {
+            AlignToBlocks(&frame->rect, encoder->width, encoder->height);
+        }
+        AnimationCopyRect(croppedBuffer, buffer, encoder->width, &frame->rect);
+
+        frame->format = encoder->format;
+        if (frame->format == AnimationContainerImageFormatCompactRunLengthPixels) {
+            frame->compressedLength = AnimationCompressCompactRunLengthPixels((uint8_t*) frame->compressedBuffer, compressedSize,
+                croppedBuffer, frame->rect.width * frame->rect.height, pixelMode);
+            if (frame->compressedLength == UINT32_MAX) {
+                printf("Compressed %s does not fit\n", encoder->paths[i]);
+                exit(1);
+            }
+        } else if (frame->format == AnimationContainerImageFormatPalette8Pixels || frame->format == AnimationContainerImageFormatPalette4Pixels) {
+            frame->compressedLength = AnimationCompressPalettePixels((uint8_t*) frame->compressedBuffer, compressedSize,
+                croppedBuffer, frame->rect.width * frame->rect.height, &encoder->palette[0], encoder->palette.size(),
+                (frame->format == AnimationContainerImageFormatPalette8Pixels) ? 8 : 4);
+            if (frame->compressedLength == UINT32_MAX) {
+                printf("Compressed %s does not fit\n", encoder->paths[i]);
+                exit(1);
+            }
+        } else if (frame->format == AnimationContainerImageFormatBlockCompressedPixels) {
+            frame->compressedLength = CopyBlocks((uint8_t*) frame->compressedBuffer, blockBuffer, encoder->width, frame->rect);
+        } else if (frame->format == AnimationContainerImageFormatBandedRunLengthPixels) {
+            frame->compressedLength = AnimationCompressBandedRunLengthPixels(frame->compressedBuffer, compressedSize,
+                croppedBuffer, frame->rect.width, frame->rect.height, encoder->bandHeight);
+            if (frame->compressedLength == UINT32_MAX) {
+                printf("Compressed %s does not fit\n", encoder->paths[i]);
+                exit(1);
+            }
+        } else {
+            frame->compressedLength = AnimationCompressRunLengthEncodedPixels(frame->compressedBuffer, croppedBuffer, frame->rect.width * frame->rect.height);
+        }
+
+        // Try a delta of the rectangle that changed since the previous image,
+        // keeping it only if it is smaller than the full frame
+
+        if (encoder->keyframeInterval > 0 && (i % encoder->keyframeInterval) != 0 && frame->compressedLength != 0)
+        {
+            if (previousFrame != i - 1) {
+                DecodeImage(encoder->paths[i - 1], previousBuffer, encoder->width, encoder->height);
+                AnimationQuantizePixels(previousBuffer, pixelCount, encoder->pixelMode);
+                if (!encoder->palette.empty()) {
+                    ApplyPalette(encoder, previousBuffer, pixelCount);
+                }
+                if (blocks) {
+                    RoundToBlocks(previousBuffer, blockBuffer, encoder->width, encoder->height);
+                }
+            }
+
+            uint32_t deltaSize = pixelCount * sizeof(uint32_t) * 2;
+            uint32_t* croppedPreviousBuffer = (uint32_t*) AnimationArenaAllocate(&arena, pixelCount * sizeof(uint32_t));
+            uint32_t* deltaBuffer = (uint32_t*) AnimationArenaAllocate(&arena, deltaSize);
+            if (croppedPreviousBuffer == NULL || deltaBuffer == NULL) {
+                printf("Can't allocate memory\n");
+                exit(1);
+            }
+
+            AnimationRect rect;
+            AnimationFindChangedRect(buffer, previousBuffer, encoder->width, encoder->height, &rect);
+            AnimationCopyRect(croppedBuffer, buffer, encoder->width, &rect);
+            AnimationCopyRect(croppedPreviousBuffer, previousBuffer, encoder->width, &rect);
+
+            // The delta only has to beat the full frame, but it can't grow
+            // past its buffer either
+
+            uint32_t deltaLength = AnimationCompressDeltaPixels(deltaBuffer, std::min(frame->compressedLength - 1, deltaSize),
+                croppedBuffer, croppedPreviousBuffer, rect.width * rect.height);
+            if (deltaLength != UINT32_MAX) {
+                memcpy(frame->compressedBuffer, deltaBuffer, deltaLength);
+                frame->compressedLength = deltaLength;
+                frame->format = AnimationContainerImageFormatDeltaPixels;
+                frame->rect = rect;
+            }
+        }
 
 #if 0
         printf("Compressed buffer:\n");
-        for (int i = 0; i < compressedLength / sizeof(uint32_t); i++) {
-            printf(" Buffer[%.4d] = 0x%.8x\n", i, compressedBuffer[i]);
+        for (int i = 0; i < frame->compressedLength / sizeof(uint32_t); i++) {
+            printf(" Buffer[%.4d] = 0x%.8x\n", i, frame->compressedBuffer[i]);
         }
 #endif
 
-#if 1
-        // Sanity check
-        
-        uint32_t* uncompressedBuffer = (uint32_t*) malloc(width * height * sizeof(uint32_t));
-        if (uncompressedBuffer == NULL) {
+        // Sanity check, this also checks the crop rectangle
+
+        if (encoder->check)
+        {
+            uint32_t* uncompressedBuffer = (uint32_t*) AnimationArenaAllocate(&arena, pixelCount * sizeof(uint32_t));
+            if (uncompressedBuffer == NULL) {
+                printf("Can't allocate memory\n");
+                exit(1);
+            }
+
+            uint32_t* origin = uncompressedBuffer + frame->rect.y * encoder->width + frame->rect.x;
+
+            if (frame->format == AnimationContainerImageFormatDeltaPixels) {
+                memcpy(uncompressedBuffer, previousBuffer, pixelCount * sizeof(uint32_t));
+                AnimationDecompressDeltaPixelsRect(origin, encoder->width, frame->rect.width, frame->rect.height,
+                    frame->compressedBuffer, frame->compressedLength);
+            } else if (frame->format == AnimationContainerImageFormatCompactRunLengthPixels) {
+                memset(uncompressedBuffer, 0, pixelCount * sizeof(uint32_t));
+                AnimationDecompressCompactRunLengthPixelsRect(origin, encoder->width, frame->rect.width, frame->rect.height,
+                    (const uint8_t*) frame->compressedBuffer, frame->compressedLength);
+            } else if (frame->format == AnimationContainerImageFormatPalette8Pixels || frame->format == AnimationContainerImageFormatPalette4Pixels) {
+                uint32_t palette[AnimationContainerMaxPaletteCount] = { 0 };
+                std::copy(encoder->palette.begin(), encoder->palette.end(), palette);
+                memset(uncompressedBuffer, 0, pixelCount * sizeof(uint32_t));
+                AnimationDecompressPalettePixelsRect(origin, encoder->width, frame->rect.width, frame->rect.height,
+                    (const uint8_t*) frame->compressedBuffer, frame->compressedLength, palette,
+                    (frame->format == AnimationContainerImageFormatPalette8Pixels) ? 8 : 4);
+            } else if (frame->format == AnimationContainerImageFormatBlockCompressedPixels) {
+                memset(uncompressedBuffer, 0, pixelCount * sizeof(uint32_t));
+                AnimationDecompressBlockPixelsRect(origin, encoder->width, frame->rect.width, frame->rect.height,
+                    (const uint8_t*) frame->compressedBuffer, frame->compressedLength);
+            } else if (frame->format == AnimationContainerImageFormatBandedRunLengthPixels) {
+                memset(uncompressedBuffer, 0, pixelCount * sizeof(uint32_t));
+                AnimationDecompressBandedRunLengthPixelsRect(origin, encoder->width, frame->rect.width, frame->rect.height,
+                    frame->compressedBuffer, frame->compressedLength);
+            } else {
+                memset(uncompressedBuffer, 0, pixelCount * sizeof(uint32_t));
+                AnimationDecompressRunLengthEncodedPixelsRect(origin, encoder->width, frame->rect.width, frame->rect.height,
+                    frame->compressedBuffer, frame->compressedLength);
+            }
+            
+            if (memcmp(buffer, uncompressedBuffer, pixelCount * sizeof(uint32_t)) != 0) {
+                printf("Decompression fail. Buffers are not equal!\n");
+                exit(1);
+            }
+        }
+
+        uint32_t* swap = previousBuffer;
+        previousBuffer = buffer;
+        buffer = swap;
+        previousFrame = i;
+
+        pthread_mutex_lock(&encoder->lock);
+        frame->done = true;
+        pthread_cond_broadcast(&encoder->frameDone);
+        pthread_mutex_unlock(&encoder->lock);
+    }
+
+    pthread_mutex_lock(&encoder->lock);
+    encoder->arenaAllocations += arena.allocations;
+    pthread_mutex_unlock(&encoder->lock);
+
+    AnimationArenaDestroy(&arena);
+    free(previousBuffer);
+    free(buffer);
+
+    return NULL;
+}
+
+int main(int argc, char** argv)
+{
+    // Parse command line arguments
+
+    int jobs = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    bool check = true;
+    int keyframeInterval = 0;
+    uint32_t format = AnimationContainerImageFormatRunLengthCompressedPixels;
+    AnimationPixelMode pixelMode = AnimationPixelModeRGBA8888;
+    int bandHeight = 32;
+    int frameRate = 12;
+
+    int option;
+    while ((option = getopt(argc, argv, "e:b:j:k:r:n")) != -1) {
+        switch (option) {
+            case 'e':
+                if (strcmp(optarg, "rlen") == 0) {
+                    format = AnimationContainerImageFormatRunLengthCompressedPixels;
+                } else if (strcmp(optarg, "rleb") == 0) {
+                    format = AnimationContainerImageFormatBandedRunLengthPixels;
+                } else if (strcmp(optarg, "rle2") == 0) {
+                    format = AnimationContainerImageFormatCompactRunLengthPixels;
+                } else if (strcmp(optarg, "rle2-565") == 0) {
+                    format = AnimationContainerImageFormatCompactRunLengthPixels;
+                    pixelMode = AnimationPixelModeRGB565;
+                } else if (strcmp(optarg, "rle2-4444") == 0) {
+                    format = AnimationContainerImageFormatCompactRunLengthPixels;
+                    pixelMode = AnimationPixelModeRGBA4444;
+                } else if (strcmp(optarg, "pal8") == 0) {
+                    format = AnimationContainerImageFormatPalette8Pixels;
+                } else if (strcmp(optarg, "pal4") == 0) {
+                    format = AnimationContainerImageFormatPalette4Pixels;
+                } else if (strcmp(optarg, "dxt5") == 0) {
+                    format = AnimationContainerImageFormatBlockCompressedPixels;
+                } else {
+                    fprintf(stderr, "Unknown encoding %s\n", optarg);
+                    exit(1);
+                }
+                break;
+            case 'b':
+                bandHeight = atoi(optarg);
+                break;
+            case 'j':
+                jobs = atoi(optarg);
+                break;
+            case 'k':
+                keyframeInterval = atoi(optarg);
+                break;
+            case 'r':
+                frameRate = atoi(optarg);
+                break;
+            case 'n':
+                check = false;
+                break;
+            default:
+                fprintf(stderr, "usage: rle [-e encoding] [-b rows] [-j jobs] [-k interval] [-r rate] [-n] destination.animation width height files*\n");
+                exit(1);
+        }
+    }
+
+    argc -= optind;
+    argv += optind;
+
+    if (argc < 3 || frameRate < 1) {
+        fprintf(stderr, "usage: rle [-e encoding] [-b rows] [-j jobs] [-k interval] [-r rate] [-n] destination.animation width height files*\n");
+        exit(1);
+    }
+
+    if (jobs < 1) {
+        jobs = 1;
+    }
+
+    if (bandHeight < 1) {
+        bandHeight = 1;
+    }
+
+    int width = atoi(argv[1]);
+    int height = atoi(argv[2]);
+
+    // Set up the encoder window. Two slots per worker keeps every worker busy
+    // while the writer drains finished frames.
+
+    Encoder encoder;
+    encoder.width = width;
+    encoder.height = height;
+    encoder.frameCount = argc - 3;
+    encoder.paths = argv + 3;
+    encoder.check = check;
+    encoder.keyframeInterval = keyframeInterval;
+    encoder.format = format;
+    encoder.pixelMode = pixelMode;
+    encoder.bandHeight = bandHeight;
+
+    // Palette encodings need all colors before the first frame is encoded,
+    // so every image is read once to count them
+
+    bool paletted = (format == AnimationContainerImageFormatPalette8Pixels || format == AnimationContainerImageFormatPalette4Pixels);
+    if (paletted)
+    {
+        uint32_t* pixels = (uint32_t*) malloc(width * height * sizeof(uint32_t));
+        if (pixels == NULL) {
             printf("Can't allocate memory\n");
             exit(1);
         }
 
-        AnimationDecompressRunLengthEncodedPixels(uncompressedBuffer, compressedBuffer, width * height);
-        
-        if (memcmp(buffer, uncompressedBuffer, width * height * sizeof(uint32_t)) != 0) {
-            printf("Decompression fail. Buffers are not equal!\n");
-            exit(1);
+        std::map<uint32_t, uint64_t> histogram;
+        for (int i = 0; i < encoder.frameCount; i++)
+        {
+            DecodeImage(encoder.paths[i], pixels, width, height);
+
+            // Count runs of a color instead of looking up every pixel
+            for (int p = 0, n; p < width * height; p += n) {
+                for (n = 1; p + n < width * height && pixels[p + n] == pixels[p]; n++) {
+                }
+                histogram[pixels[p]] += n;
+            }
         }
-#endif
-        
-        // Write the image header
-        
+        free(pixels);
+
+        BuildPalette(&encoder, histogram, (format == AnimationContainerImageFormatPalette8Pixels) ? 256 : 16);
+        printf("Palette of %zu colors for %zu colors in the images\n", encoder.palette.size(), histogram.size());
+    }
+    encoder.windowSize = jobs * 2;
+    encoder.nextFrame = 0;
+    encoder.writtenFrames = 0;
+
+    pthread_mutex_init(&encoder.lock, NULL);
+    pthread_cond_init(&encoder.frameDone, NULL);
+    pthread_cond_init(&encoder.frameWritten, NULL);
+
+    encoder.frames = (EncoderFrame*) calloc(encoder.windowSize, sizeof(EncoderFrame));
+    if (encoder.frames == NULL) {
+        printf("Can't allocate memory\n");
+        exit(1);
+    }
+
+    // Compressed frames are handed from the workers to the writer in buffers
+    // from a pool with one buffer per window slot
+
+    encoder.compressedBuffers = AnimationBufferPoolCreate(CompressedBufferSize(width, height), encoder.windowSize);
+    if (encoder.compressedBuffers == NULL) {
+        printf("Can't allocate memory\n");
+        exit(1);
+    }
+    encoder.arenaAllocations = 0;
+
+    // Create the animation container
+
+    AnimationContainerWriter writer;
+    if (!writer.Open(argv[0], width, height, frameRate, encoder.frameCount,
+        paletted ? &encoder.palette[0] : NULL, paletted ? encoder.palette.size() : 0))
+    {
+        fprintf(stderr, "Cannot create %s: %s\n", argv[0], writer.Error());
+        exit(1);
+    }
+
+    // Start the workers
+
+    pthread_t* threads = (pthread_t*) calloc(jobs, sizeof(pthread_t));
+    for (int i = 0; i < jobs; i++) {
+        pthread_create(&threads[i], NULL, EncoderWorker, &encoder);
+    }
+
+    // Write all the images, in order, as they are finished
+
+    for (int i = 0; i < encoder.frameCount; i++)
+    {
+        EncoderFrame* frame = &encoder.frames[i % encoder.windowSize];
+
+        pthread_mutex_lock(&encoder.lock);
+        while (!frame->done) {
+            pthread_cond_wait(&encoder.frameDone, &encoder.lock);
+        }
+        pthread_mutex_unlock(&encoder.lock);
+
+        uint32_t compressedLength = frame->compressedLength;
+        printf("Processed %s, compressed length = %d\n", encoder.paths[i], compressedLength);
+
         AnimationContainerImageHeader imageHeader;
-        imageHeader.width = width;
-        imageHeader.height = height;
-        imageHeader.xoffset = 0;
-        imageHeader.yoffset = 0;
-        imageHeader.format = AnimationContainerImageFormatRunLengthCompressedPixels;
+        imageHeader.width = frame->rect.width;
+        imageHeader.height = frame->rect.height;
+        imageHeader.xoffset = frame->rect.x;
+        imageHeader.yoffset = frame->rect.y;
+        imageHeader.format = frame->format;
         imageHeader.dataLength = compressedLength;
-        
-        write(fd, &imageHeader, sizeof(imageHeader));
-        
-        // Write the compressed image data
-        
-        write(fd, compressedBuffer, compressedLength);
-        free(compressedBuffer);
-        
-        // Write the padding if needed
-        
-        if ((compressedLength % 4) > 0) {
-            write(fd, "\0\0\0", 4 - (compressedLength % 4));
-        }
-    }
-    
-    // Close the animation container
-    
-    close(fd);
+
+        if (!writer.WriteImage(imageHeader, frame->compressedBuffer)) {
+            fprintf(stderr, "Cannot write %s: %s\n", argv[0], writer.Error());
+            writer.Abort();
+            exit(1);
+        }
+
+        // Hand the slot back to the workers
+
+        AnimationBufferPoolRelease(encoder.compressedBuffers, frame->compressedBuffer);
+        frame->compressedBuffer = NULL;
+
+        pthread_mutex_lock(&encoder.lock);
+        frame->done = false;
+        encoder.writtenFrames++;
+        pthread_cond_broadcast(&encoder.frameWritten);
+        pthread_mutex_unlock(&encoder.lock);
+    }
+
+    for (int i = 0; i < jobs; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    // Write the frame index and move the container into place
+
+    if (!writer.Commit()) {
+        fprintf(stderr, "Cannot write %s: %s\n", argv[0], writer.Error());
+        exit(1);
+    }
+
+    // Everything is allocated up front, none of these should grow with the
+    // number of frames
+
+    AnimationBufferPoolStatistics statistics;
+    AnimationBufferPoolGetStatistics(encoder.compressedBuffers, &statistics);
+    printf("Buffers: %llu pool allocations, %llu exhausted, %llu scratch allocations\n",
+        (unsigned long long) statistics.allocations, (unsigned long long) statistics.exhausted,
+        (unsigned long long) encoder.arenaAllocations);
+
+    AnimationBufferPoolDestroy(encoder.compressedBuffers);
+    free(encoder.frames);
+    free(threads);
 }